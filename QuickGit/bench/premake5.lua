@@ -0,0 +1,79 @@
+project "QuickGitBench"
+	kind "ConsoleApp"
+	language "C++"
+	cppdialect "C++20"
+	staticruntime "off"
+	warnings "extra"
+	externalwarnings "off"
+	rtti "off"
+
+	flags { "FatalWarnings" }
+
+	targetdir ("%{wks.location}/bin/" .. outputdir .. "/%{prj.name}")
+	objdir ("%{wks.location}/bin-int/" .. outputdir .. "/%{prj.name}")
+
+	pchheader "pch.h"
+	pchsource "../src/pch.cpp"
+
+	files
+	{
+		"src/**.h",
+		"src/**.cpp",
+		"../src/pch.cpp",
+		"../src/TextSearch.cpp",
+	}
+
+	includedirs
+	{
+		"src",
+		"../src"
+	}
+
+	externalincludedirs
+	{
+		"../vendor/spdlog/include",
+		"%{IncludeDir.LibGit2}",
+		"%{IncludeDir.EABase}",
+		"%{IncludeDir.EASTL}",
+	}
+
+	links
+	{
+		"EASTL",
+	}
+
+	postbuildcommands
+	{
+		'{COPYFILE} %{LibDir.LibGit2}/git2.dll "%{cfg.targetdir}"',
+	}
+
+	filter "system:windows"
+		systemversion "latest"
+		links
+		{
+			"%{LibDir.LibGit2}/git2.lib",
+		}
+
+	filter "system:linux"
+		pic "On"
+		systemversion "latest"
+		links
+		{
+			"%{LibDir.LibGit2}/git2.lib",
+		}
+
+	filter "configurations:Debug"
+		defines "QG_DEBUG"
+		runtime "Debug"
+		symbols "on"
+
+	filter "configurations:Release"
+		defines "QG_RELEASE"
+		runtime "Release"
+		optimize "speed"
+
+	filter "configurations:Dist"
+		defines "QG_DIST"
+		runtime "Release"
+		optimize "speed"
+		symbols "off"
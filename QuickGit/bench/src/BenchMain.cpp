@@ -0,0 +1,30 @@
+#include "pch.h"
+#include "Benchmark.h"
+
+int main(int argc, const char** argv)
+{
+	// Without arguments every benchmark runs, otherwise only the named ones
+	auto wanted = [argc, argv](const char* name)
+	{
+		if (argc < 2)
+			return true;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			if (strcmp(argv[i], name) == 0)
+				return true;
+		}
+
+		return false;
+	};
+
+	git_libgit2_init();
+
+	if (wanted("oidmap"))
+		QuickGit::Benchmark::RunOidMap();
+	if (wanted("textsearch"))
+		QuickGit::Benchmark::RunTextSearch();
+
+	git_libgit2_shutdown();
+	return 0;
+}
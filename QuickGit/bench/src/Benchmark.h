@@ -0,0 +1,35 @@
+#pragma once
+
+// Runs a benchmark at least this many times and for at least this long, the fastest run is reported
+#define BENCHMARK_MIN_RUNS 5
+#define BENCHMARK_MIN_TIME_MS 500
+
+namespace QuickGit::Benchmark
+{
+	template<typename Func>
+	double MeasureMs(Func&& func)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		double fastest = std::numeric_limits<double>::max();
+		const auto end = Clock::now() + std::chrono::milliseconds(BENCHMARK_MIN_TIME_MS);
+		for (int run = 0; run < BENCHMARK_MIN_RUNS || Clock::now() < end; ++run)
+		{
+			const auto start = Clock::now();
+			func();
+			fastest = eastl::min(fastest, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		return fastest;
+	}
+
+	// Keeps a result alive so the measured work isn't optimized away
+	inline void Consume(uint64_t value)
+	{
+		static volatile uint64_t s_Sink = 0;
+		s_Sink = s_Sink + value;
+	}
+
+	void RunOidMap();
+	void RunTextSearch();
+}
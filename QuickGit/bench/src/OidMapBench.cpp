@@ -0,0 +1,68 @@
+#include "pch.h"
+#include "Benchmark.h"
+
+#include <random>
+
+#include "OidMap.h"
+
+#define OID_MAP_BENCH_COUNT 1000000
+
+namespace QuickGit::Benchmark
+{
+	// The string hash commits and branch heads were keyed on before OidMap
+	static uint64_t HashOidString(const git_oid& oid)
+	{
+		char str[GIT_OID_SHA1_HEXSIZE + 1];
+		git_oid_tostr(str, sizeof(str), &oid);
+
+		uint64_t hash = 0;
+		for (const char* c = str; *c; ++c)
+			hash = (hash << 5) + *c;
+		return hash;
+	}
+
+	void RunOidMap()
+	{
+		std::mt19937_64 random(42);
+		eastl::vector<git_oid> oids(OID_MAP_BENCH_COUNT);
+		for (git_oid& oid : oids)
+		{
+			for (size_t i = 0; i < sizeof(oid.id); ++i)
+				oid.id[i] = static_cast<unsigned char>(random());
+		}
+
+		OidMap<int64_t> oidMap;
+		eastl::hash_map<uint64_t, int64_t> stringHashMap;
+		for (size_t i = 0; i < oids.size(); ++i)
+		{
+			oidMap[oids[i]] = static_cast<int64_t>(i);
+			stringHashMap[HashOidString(oids[i])] = static_cast<int64_t>(i);
+		}
+
+		// Looked up in another order than inserted, like rows drawn while scrolling
+		eastl::vector<git_oid> lookups = oids;
+		eastl::random_shuffle(lookups.begin(), lookups.end(), [&random](size_t n) { return static_cast<size_t>(random() % n); });
+
+		const double oidMapMs = MeasureMs([&]()
+		{
+			uint64_t sum = 0;
+			for (const git_oid& oid : lookups)
+				sum += *oidMap.Find(oid);
+			Consume(sum);
+		});
+
+		const double stringHashMs = MeasureMs([&]()
+		{
+			uint64_t sum = 0;
+			for (const git_oid& oid : lookups)
+				sum += stringHashMap.find(HashOidString(oid))->second;
+			Consume(sum);
+		});
+
+		const size_t merged = oids.size() - stringHashMap.size();
+		printf("oidmap: %zu lookups\n", lookups.size());
+		printf("  OidMap             %8.2f ms  %6.1f M lookups/s\n", oidMapMs, lookups.size() / oidMapMs / 1000.0);
+		printf("  string hash map    %8.2f ms  %6.1f M lookups/s\n", stringHashMs, lookups.size() / stringHashMs / 1000.0);
+		printf("  speedup %.1fx, %zu ids merged by string hash collisions\n", stringHashMs / oidMapMs, merged);
+	}
+}
@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "Benchmark.h"
+
+#include "TextSearch.h"
+
+#define TEXT_SEARCH_BENCH_SIZE (50ull * 1024 * 1024)
+
+namespace QuickGit::Benchmark
+{
+	static char FoldCase(char c)
+	{
+		return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+	}
+
+	// Compares the pattern at every position, what the find bar would do without TextSearch
+	static void NaiveFindAll(const char* text, size_t size, const char* pattern, size_t patternSize, bool matchCase, eastl::vector<uint32_t>& outOffsets)
+	{
+		for (size_t at = 0; at + patternSize <= size;)
+		{
+			size_t i = 0;
+			while (i < patternSize && (matchCase ? text[at + i] == pattern[i] : FoldCase(text[at + i]) == FoldCase(pattern[i])))
+				++i;
+
+			if (i == patternSize)
+			{
+				outOffsets.push_back(static_cast<uint32_t>(at));
+				at += patternSize;
+			}
+			else
+			{
+				++at;
+			}
+		}
+	}
+
+	// Lines of a generated source file, the kind of diff the find bar has to stay fast on
+	static void GenerateText(eastl::vector<char>& out)
+	{
+		out.reserve(TEXT_SEARCH_BENCH_SIZE);
+		char line[128];
+		for (uint32_t i = 0; out.size() < TEXT_SEARCH_BENCH_SIZE; ++i)
+		{
+			const int length = i % 4 == 0
+				? snprintf(line, sizeof(line), "+\tstatic int Generated_%u(int value) { return value * %u + %u; }\n", i, i % 97, i % 13)
+				: snprintf(line, sizeof(line), "+\t\tm_Table[%u] = { \"field_%u\", Type::Int32, offsetof(Record, Field%u) };\n", i, i, i % 64);
+			out.insert(out.end(), line, line + length);
+		}
+
+		static constexpr const char s_Rare[] = "RareMarkerIdentifier";
+		for (size_t at = out.size() / 3; at + sizeof(s_Rare) < out.size(); at += out.size() / 3)
+			memcpy(out.data() + at, s_Rare, sizeof(s_Rare) - 1);
+	}
+
+	void RunTextSearch()
+	{
+		eastl::vector<char> text;
+		GenerateText(text);
+
+		struct Case
+		{
+			const char* Pattern;
+			bool MatchCase;
+		};
+
+		const Case cases[] = {
+			{ "RareMarkerIdentifier", true },
+			{ "raremarkeridentifier", false },
+			{ "offsetof(Record, Field63)", true },
+			{ "return", true },
+			{ "TYPE::INT32", false },
+		};
+
+		printf("textsearch: %.1f MB of generated code\n", text.size() / (1024.0 * 1024.0));
+		for (const Case& c : cases)
+		{
+			const size_t patternSize = strlen(c.Pattern);
+			eastl::vector<uint32_t> fast;
+			eastl::vector<uint32_t> naive;
+			const double fastMs = MeasureMs([&]()
+			{
+				fast.clear();
+				TextSearch::FindAll(text.data(), text.size(), c.Pattern, patternSize, c.MatchCase, fast);
+			});
+			const double naiveMs = MeasureMs([&]()
+			{
+				naive.clear();
+				NaiveFindAll(text.data(), text.size(), c.Pattern, patternSize, c.MatchCase, naive);
+			});
+
+			printf("  %-28s %-6s %8zu matches  TextSearch %8.2f ms  naive %8.2f ms  %5.1fx%s\n", c.Pattern, c.MatchCase ? "case" : "nocase",
+				fast.size(), fastMs, naiveMs, naiveMs / fastMs, fast == naive ? "" : "  MISMATCH");
+		}
+	}
+}
@@ -1,16 +1,29 @@
 #include "pch.h"
 #include "Client.h"
 
+#include <git2/sys/commit_graph.h>
+#include <git2/sys/errors.h>
+
+#include "CommitGraph.h"
+#include "CommitCache.h"
+#include "ThreadPool.h"
+#include "StatusScanner.h"
+
 namespace QuickGit
 {
 	static eastl::vector<eastl::unique_ptr<RepoData>> s_Repositories;
 
 	static git_checkout_options s_SafeCheckoutOptions;
 	static git_checkout_options s_ForceCheckoutOptions;
+	static DiffCache s_DiffCache;
+	static std::atomic<uint64_t> s_DiffFileLimit = DIFF_FILE_LIMIT;
+	static std::atomic<uint64_t> s_DiffTotalLimit = DIFF_TOTAL_LIMIT;
+	static constexpr uint32_t s_DiffFlags = GIT_DIFF_INDENT_HEURISTIC | GIT_DIFF_UPDATE_INDEX | GIT_DIFF_SHOW_UNTRACKED_CONTENT;
 
 	void Client::Init(const git_checkout_progress_cb checkoutProgress /*= nullptr*/)
 	{
 		git_libgit2_init();
+		ThreadPool::Init();
 		s_Repositories.reserve(10);
 
 		s_SafeCheckoutOptions = { GIT_CHECKOUT_OPTIONS_VERSION, GIT_CHECKOUT_SAFE | GIT_CHECKOUT_UPDATE_SUBMODULES };
@@ -26,6 +39,7 @@ namespace QuickGit
 	void Client::Shutdown()
 	{
 		s_Repositories.clear();
+		ThreadPool::Shutdown();
 		git_libgit2_shutdown();
 	}
 
@@ -40,7 +54,7 @@ namespace QuickGit
 			return false;
 
 		eastl::unique_ptr<RepoData> data = eastl::make_unique<RepoData>();
-		Fill(data.get(), repo);
+		Fill(data.get(), repo, true);
 		s_Repositories.emplace_back(eastl::move(data));
 		return true;
 	}
@@ -54,7 +68,7 @@ namespace QuickGit
 	{
 		git_reference* ref;
 		git_repository_head(&ref, repoData.Repository);
-		repoData.Head = Utils::GenUUID(ref);
+		repoData.Head = *git_reference_target(ref);
 		git_reference_free(ref);
 
 		repoData.HeadBranch = nullptr;
@@ -68,425 +82,2143 @@ namespace QuickGit
 		}
 	}
 
-	void FillCommit(git_commit* commit, CommitData* outCommitData)
+	static void PublishCommits(CommitLoader& loader, CommitBatch& batch, bool front)
 	{
-		const git_signature* author = git_commit_author(commit);
-		const char* commitSummary = git_commit_summary(commit);
-		const git_oid* oid = git_commit_id(commit);
-		const char* strId = git_oid_tostr_s(oid);
-		const UUID id = Utils::GenUUID(oid);
-
-		outCommitData->Commit = commit;
-		outCommitData->ID = id;
+		if (batch.Empty())
+			return;
 
-		strncpy_s(outCommitData->CommitID, strId, sizeof(outCommitData->CommitID) - 1);
+		// The trigram index of the loaded history is built here, rows added in front are few enough to index on the UI thread
+		if (!front)
+			batch.BuildSearch();
 
-		if (commitSummary)
+		const size_t count = batch.Size();
 		{
-			strncpy_s(outCommitData->Message, commitSummary, sizeof(outCommitData->Message) - 1);
-			outCommitData->MessageSize = strlen(outCommitData->Message);
+			std::scoped_lock lock(loader.Mutex);
+			CommitBatch& pending = front ? loader.PendingFront : loader.Pending;
+			if (pending.Empty())
+				eastl::swap(pending, batch);
+			else
+				pending.Append(batch);
 		}
-		else
+		batch.Clear();
+		loader.Walked.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	static void AddCommit(CommitLoader& loader, git_commit* commit, CommitBatch& batch, size_t& batchSize)
+	{
+		batch.Add(commit);
+		if (batch.Size() >= batchSize)
 		{
-			outCommitData->Message[0] = 0;
-			outCommitData->MessageSize = 0;
+			PublishCommits(loader, batch, false);
+			batchSize = eastl::min(batchSize * 2, static_cast<size_t>(COMMIT_LOAD_MAX_BATCH));
 		}
-
-		strncpy_s(outCommitData->AuthorName, author->name, sizeof(outCommitData->AuthorName) - 1);
-
-		git_time_t timestamp = author->when.time;
-		tm localTime;
-		localtime_s(&localTime, &timestamp);
-		strftime(outCommitData->AuthorDate, sizeof(outCommitData->AuthorDate), "%d %b %Y %H:%M:%S", &localTime);
 	}
 
-	void Client::Fill(RepoData* data, git_repository* repo)
+	static void CollectTips(git_repository* repo, const char* glob, eastl::vector<git_oid>& outTips)
 	{
-		if (!data || !repo)
+		git_reference_iterator* refIt = nullptr;
+		if (git_reference_iterator_glob_new(&refIt, repo, glob) != 0)
 			return;
 
-		for (auto& commitData : data->Commits)
-			git_commit_free(commitData.Commit);
-
-		for (auto& [branchRef, _] : data->Branches)
-			git_reference_free(branchRef);
+		git_reference* ref = nullptr;
+		while (git_reference_next(&ref, refIt) == 0)
+		{
+			git_oid oid;
+			if (git_reference_name_to_id(&oid, repo, git_reference_name(ref)) == 0)
+				outTips.push_back(oid);
+			git_reference_free(ref);
+		}
+		git_reference_iterator_free(refIt);
+	}
 
-		data->Commits.clear();
-		data->Branches.clear();
-		data->BranchHeads.clear();
-		data->CommitsIndexMap.clear();
+	struct GraphWalkEntry
+	{
+		uint64_t Generation;
+		git_time_t Time;
+		uint32_t Position;
+		git_oid Oid;
+	};
 
-		data->Repository = repo;
+	struct GraphWalkByGeneration
+	{
+		bool operator()(const GraphWalkEntry& a, const GraphWalkEntry& b) const { return a.Generation < b.Generation; }
+	};
 
-		// Trim the last slash
-		eastl::string filepath = git_repository_workdir(repo);
-		size_t len = filepath.length();
-		if (filepath[len - 1] == '/')
-			filepath[len - 1] = '\0';
+	struct GraphWalkByTime
+	{
+		bool operator()(const GraphWalkEntry& a, const GraphWalkEntry& b) const { return a.Time != b.Time ? a.Time < b.Time : a.Generation < b.Generation; }
+	};
+
+	// Indegree of an emitted commit, none of its children is left to count it
+	static constexpr uint32_t s_GraphWalkDone = UINT32_MAX;
+
+	// Streaming topological order in the spirit of git's incremental topo-order walk.
+	// Commits become ready once every child has been emitted and ready commits go out newest first.
+	// Children always have a higher generation than their parents, so child counts only have to be
+	// explored down to the generation of the commit about to be emitted instead of for the whole history.
+	// Commits newer than the commit-graph file have no generation and are treated as infinitely high.
+	static void WalkCommitGraph(CommitLoader& loader, const CommitGraph& graph, CommitBatch& batch, size_t& batchSize)
+	{
+		// Zero while unseen, s_GraphWalkDone once emitted, otherwise one more than the number of children not emitted yet
+		eastl::vector<uint32_t> indegrees(graph.Size(), 0);
+		OidMap<uint32_t> newIndegrees;
+		eastl::vector<GraphWalkEntry> exploreQueue;
+		eastl::vector<GraphWalkEntry> readyQueue;
 
-		data->Filepath = filepath;
+		auto makeEntry = [&](const git_oid& oid, GraphWalkEntry& out)
+		{
+			out.Oid = oid;
+			out.Position = graph.Find(oid);
+			if (out.Position != COMMIT_GRAPH_NO_POSITION)
+			{
+				out.Generation = graph.Generation(out.Position);
+				out.Time = graph.Time(out.Position);
+				return true;
+			}
 
-		const char* lastSlash = strrchr(filepath.c_str(), '/');
-		data->Name = lastSlash ? lastSlash + 1 : filepath;
+			git_commit* commit = nullptr;
+			if (git_commit_lookup(&commit, loader.Repository, &oid) != 0)
+				return false;
 
-		git_status_options statusOptions = GIT_STATUS_OPTIONS_INIT;
-		git_status_list* statusList = nullptr;
-		git_status_list_new(&statusList, repo, &statusOptions);
-		data->UncommittedFiles = git_status_list_entrycount(statusList);
-		git_status_list_free(statusList);
+			out.Generation = UINT64_MAX;
+			out.Time = git_commit_time(commit);
+			git_commit_free(commit);
+			return true;
+		};
 
-		git_reference_iterator* refIt = nullptr;
-		git_reference* ref = nullptr;
-		git_reference_iterator_new(&refIt, repo);
-		while (git_reference_next(&ref, refIt) == 0)
+		auto indegree = [&](const GraphWalkEntry& entry) -> uint32_t&
 		{
-			git_reference_t refType = git_reference_type(ref);
+			return entry.Position != COMMIT_GRAPH_NO_POSITION ? indegrees[entry.Position] : newIndegrees[entry.Oid];
+		};
 
-			if (refType == GIT_REF_OID)
+		auto forEachParent = [&](const GraphWalkEntry& entry, auto&& func)
+		{
+			GraphWalkEntry parent;
+			if (entry.Position != COMMIT_GRAPH_NO_POSITION)
 			{
-				const char* refName = git_reference_name(ref);
-				git_commit* targetCommit = nullptr;
-				git_commit_lookup(&targetCommit, repo, git_reference_target(ref));
-				if (data->Branches.find(ref) == data->Branches.end())
+				graph.ForEachParent(entry.Position, [&](uint32_t pos)
 				{
-					BranchData branchData;
-					branchData.Name = refName;
-					branchData.Type = git_reference_is_remote(ref) == 1 ? BranchType::Remote : BranchType::Local;
-					branchData.Color = Utils::GenerateColor(refName);
-					data->Branches[ref] = eastl::move(branchData);
-					data->BranchHeads[Utils::GenUUID(targetCommit)].push_back(ref);
-				}
-				git_commit_free(targetCommit);
-			}
-			else
-			{
-				git_reference_free(ref);
+					parent.Generation = graph.Generation(pos);
+					parent.Time = graph.Time(pos);
+					parent.Position = pos;
+					graph.Oid(pos, parent.Oid);
+					func(parent);
+				});
+				return;
 			}
-		}
-		git_reference_iterator_free(refIt);
-
-		git_revwalk* walker;
-		git_revwalk_new(&walker, repo);
-		git_revwalk_push_glob(walker, "refs/heads");
-		git_revwalk_push_glob(walker, "refs/remotes");
-		git_revwalk_sorting(walker, GIT_SORT_TIME | GIT_SORT_TOPOLOGICAL);
 
-		git_oid oid;
-		while (git_revwalk_next(&oid, walker) == 0)
-		{
 			git_commit* commit = nullptr;
-			if (git_commit_lookup(&commit, repo, &oid) == 0)
+			if (git_commit_lookup(&commit, loader.Repository, &entry.Oid) != 0)
+				return;
+
+			for (uint32_t i = 0, count = git_commit_parentcount(commit); i < count; ++i)
 			{
-				CommitData cd;
-				FillCommit(commit, &cd);
-				UUID id = cd.ID;
-				data->CommitsIndexMap.emplace(id, data->Commits.size());
-				data->Commits.emplace_back(eastl::move(cd));
+				if (makeEntry(*git_commit_parent_id(commit, i), parent))
+					func(parent);
 			}
-		}
-		git_revwalk_free(walker);
-
-		UpdateHead(*data);
-	}
+			git_commit_free(commit);
+		};
 
-	git_reference* Client::BranchCreate(RepoData* repo, const char* branchName, git_commit* commit, bool& outValidName)
-	{
-		int valid = 0;
-		int err = git_branch_name_is_valid(&valid, branchName);
-		outValidName = valid;
-
-		if (err == 0 && outValidName)
+		auto explore = [&](uint64_t generation)
 		{
-			git_reference* outBranch = nullptr;
-			err = git_branch_create(&outBranch, repo->Repository, branchName, commit, 0);
-
-			if (outBranch)
+			while (!exploreQueue.empty() && exploreQueue.front().Generation >= generation)
 			{
-				UUID id = Utils::GenUUID(commit);
-				BranchData branchData;
-				branchData.Type = BranchType::Local;
-				branchData.Name = LOCAL_BRANCH_PREFIX + eastl::string(branchName);
-				branchData.Color = Utils::GenerateColor(branchData.Name.c_str());
-				repo->Branches[outBranch] = eastl::move(branchData);
-				repo->BranchHeads[id].push_back(outBranch);
+				eastl::pop_heap(exploreQueue.begin(), exploreQueue.end(), GraphWalkByGeneration());
+				const GraphWalkEntry entry = exploreQueue.back();
+				exploreQueue.pop_back();
+
+				forEachParent(entry, [&](const GraphWalkEntry& parent)
+				{
+					if (indegree(parent)++ == 0)
+					{
+						indegree(parent) = 2;
+						exploreQueue.push_back(parent);
+						eastl::push_heap(exploreQueue.begin(), exploreQueue.end(), GraphWalkByGeneration());
+					}
+				});
 			}
+		};
 
-			return outBranch;
+		auto pushReady = [&](const GraphWalkEntry& entry)
+		{
+			readyQueue.push_back(entry);
+			eastl::push_heap(readyQueue.begin(), readyQueue.end(), GraphWalkByTime());
+		};
+
+		eastl::vector<git_oid> tips;
+		CollectTips(loader.Repository, "refs/heads/*", tips);
+		CollectTips(loader.Repository, "refs/remotes/*", tips);
+		eastl::vector<GraphWalkEntry> tipEntries;
+		uint64_t lowestTip = UINT64_MAX;
+		for (const git_oid& tip : tips)
+		{
+			GraphWalkEntry entry;
+			if (!makeEntry(tip, entry) || indegree(entry) != 0)
+				continue;
+
+			indegree(entry) = 1;
+			exploreQueue.push_back(entry);
+			eastl::push_heap(exploreQueue.begin(), exploreQueue.end(), GraphWalkByGeneration());
+			tipEntries.push_back(entry);
+			lowestTip = eastl::min(lowestTip, entry.Generation);
 		}
 
-		return nullptr;
-	}
-
-	bool Client::BranchRename(RepoData* repo, git_reference* branch, const char* name, bool& outValidName)
-	{
-		int valid = 0;
-		int err = git_branch_name_is_valid(&valid, name);
-
-		outValidName = valid;
-		git_reference* newRef = nullptr;
-		eastl::string newName = eastl::string(LOCAL_BRANCH_PREFIX) + name;
-		UUID oldId = Utils::GenUUID(branch);
-		if (err == 0 && outValidName)
+		// A tip can be the ancestor of another tip, like a remote branch behind the local one. Exploring down to the lowest tip
+		// counts its children first, it is then only queued once its last child is emitted.
+		explore(lowestTip);
+		for (const GraphWalkEntry& entry : tipEntries)
 		{
-			err = git_reference_rename(&newRef, branch, newName.c_str(), 0, nullptr);
+			if (indegree(entry) == 1)
+				pushReady(entry);
 		}
 
-		if (err == 0 && outValidName && newRef)
+		while (!readyQueue.empty() && !loader.Cancel.load(std::memory_order_relaxed))
 		{
-			if (repo->HeadBranch == branch)
-			{
-				repo->HeadBranch = newRef;
-			}
+			eastl::pop_heap(readyQueue.begin(), readyQueue.end(), GraphWalkByTime());
+			const GraphWalkEntry entry = readyQueue.back();
+			readyQueue.pop_back();
 
-			repo->Branches[newRef] = repo->Branches.at(branch);
-			BranchData& data = repo->Branches.at(newRef);
-			data.Name = newName;
-			data.Color = Utils::GenerateColor(data.Name.c_str());
-			repo->Branches.erase(branch);
+			// Emitted commits are marked done so nothing can emit them twice
+			if (indegree(entry) != 1)
+				continue;
+			indegree(entry) = s_GraphWalkDone;
 
-			auto& branchHeads = repo->BranchHeads.at(oldId);
-			for (auto it = branchHeads.begin(); it != branchHeads.end(); ++it)
+			git_commit* commit = nullptr;
+			if (git_commit_lookup(&commit, loader.Repository, &entry.Oid) == 0)
 			{
-				if (*it == branch)
-				{
-					branchHeads.erase(it);
-					break;
-				}
+				// Only the columns are kept, the commit object is released right away
+				AddCommit(loader, commit, batch, batchSize);
+				git_commit_free(commit);
 			}
-			branchHeads.push_back(newRef);
 
-			git_reference_free(branch);
+			forEachParent(entry, [&](const GraphWalkEntry& parent)
+			{
+				explore(parent.Generation);
+				if (--indegree(parent) == 1)
+					pushReady(parent);
+			});
 		}
-
-		return err == 0 && outValidName;
 	}
 
-	bool Client::BranchDelete(RepoData* repo, git_reference* branch)
+	static void WalkRevisions(CommitLoader& loader, bool incremental, CommitBatch& batch, size_t& batchSize)
 	{
-		int err = git_reference_delete(branch);
+		git_revwalk* walker = nullptr;
+		git_revwalk_new(&walker, loader.Repository);
+		git_revwalk_sorting(walker, GIT_SORT_TIME | GIT_SORT_TOPOLOGICAL);
 
-		if (err == 0)
+		if (incremental)
 		{
-			UUID id = Utils::GenUUID(branch);
-			repo->Branches.erase(branch);
+			for (const git_oid& tip : loader.Push)
+				git_revwalk_push(walker, &tip);
+			for (const git_oid& tip : loader.Hide)
+				git_revwalk_hide(walker, &tip);
+		}
+		else
+		{
+			git_revwalk_push_glob(walker, "refs/heads");
+			git_revwalk_push_glob(walker, "refs/remotes");
+		}
 
-			auto& branchHeads = repo->BranchHeads.at(id);
-			for (auto it = branchHeads.begin(); it != branchHeads.end(); ++it)
+		git_oid oid;
+		while (!loader.Cancel.load(std::memory_order_relaxed) && git_revwalk_next(&oid, walker) == 0)
+		{
+			// Only the columns are kept, the commit object is released right away
+			git_commit* commit = nullptr;
+			if (git_commit_lookup(&commit, loader.Repository, &oid) == 0)
 			{
-				if (*it == branch)
-				{
-					branchHeads.erase(it);
-					break;
-				}
+				AddCommit(loader, commit, batch, batchSize);
+				git_commit_free(commit);
 			}
-			git_reference_free(branch);
 		}
 
-		return err == 0;
+		git_revwalk_free(walker);
 	}
 
-	bool Client::BranchCheckout(git_reference* branch, bool force /*= false*/)
+	static void LoadCommits(CommitLoader* loader)
 	{
-		git_repository* repo = git_reference_owner(branch);
-		git_commit* commit;
-		int err = git_commit_lookup(&commit, repo, git_reference_target(branch));
+		// Start with a small batch so the first screen of rows shows up right away,
+		// then grow it to keep the number of lock/publish round trips low.
+		// New commits of an incremental walk go in front of the loaded history and
+		// are published at once so they keep their order.
+		const bool incremental = !loader->Push.empty();
+		size_t batchSize = incremental ? SIZE_MAX : COMMIT_LOAD_FIRST_BATCH;
+		CommitBatch batch;
+
+		// A full load streams from the commit-graph when there is one, libgit2's topological
+		// sort has to walk the entire history before it returns the first commit
+		CommitGraph graph;
+		if (!incremental && graph.Open(loader->Repository))
+			WalkCommitGraph(*loader, graph, batch, batchSize);
+		else
+			WalkRevisions(*loader, incremental, batch, batchSize);
 
-		if (err == 0)
-		{
-			err = git_checkout_tree(repo, reinterpret_cast<git_object*>(commit), force ? &s_ForceCheckoutOptions : &s_SafeCheckoutOptions);
-			if (err == 0)
-			{
-				const char* branchName;
-				err = git_branch_name(&branchName, branch);
-				if (err == 0)
-				{
-					eastl::string branchNameFull = eastl::string(LOCAL_BRANCH_PREFIX) + branchName;
-					err = git_repository_set_head(repo, branchNameFull.c_str());
-				}
-			}
-		}
+		if (loader->Cancel.load(std::memory_order_relaxed) && incremental)
+			batch.Clear();
 
-		git_commit_free(commit);
+		PublishCommits(*loader, batch, incremental);
 
-		return err == 0;
+		loader->Running.store(false, std::memory_order_release);
 	}
 
-	bool Client::BranchReset(RepoData* repo, git_commit* commit, git_reset_t resetType)
+	static void StartLoading(RepoData& repoData, eastl::vector<git_oid>&& push, eastl::vector<git_oid>&& hide)
 	{
-		const int err = git_reset(repo->Repository, reinterpret_cast<const git_object*>(commit), resetType, resetType == GIT_RESET_HARD ? &s_ForceCheckoutOptions : &s_SafeCheckoutOptions);
-		git_reference* newHead;
-		git_repository_head(&newHead, repo->Repository);
+		CommitLoader& loader = repoData.Loader;
+		if (!loader.Repository && git_repository_open(&loader.Repository, git_repository_path(repoData.Repository)) != 0)
+			return;
 
-		if (err == 0)
-		{
-			git_reference* oldHead = repo->HeadBranch;
-			repo->Branches[newHead] = repo->Branches.at(oldHead);
-			repo->Branches.erase(oldHead);
-			auto& branchHeads = repo->BranchHeads.at(repo->Head);
-			if (branchHeads.size() == 1)
-			{
-				repo->BranchHeads.erase(repo->Head);
-			}
-			else
-			{
-				for (auto it = branchHeads.begin(); it != branchHeads.end(); ++it)
-				{
-					if (*it == oldHead)
-					{
-						branchHeads.erase(it);
-						break;
-					}
-				}
-			}
+		loader.Push = eastl::move(push);
+		loader.Hide = eastl::move(hide);
+		loader.Running.store(true, std::memory_order_relaxed);
+		loader.Thread = std::thread(LoadCommits, &loader);
+	}
 
-			repo->HeadBranch = newHead;
-			repo->Head = Utils::GenUUID(newHead);
-			repo->BranchHeads[repo->Head].push_back(newHead);
+	static void PublishLoaded(RepoData& repoData)
+	{
+		CommitBatch batch;
+		CommitBatch batchFront;
+
+		CommitLoader& loader = repoData.Loader;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			eastl::swap(batch, loader.Pending);
+			eastl::swap(batchFront, loader.PendingFront);
 		}
-		return err == 0;
+
+		// A commit made from QuickGit is already at the front and gets skipped by Prepend
+		repoData.Commits.Append(batch);
+		repoData.Commits.Prepend(batchFront);
 	}
 
-	bool Client::CommitCheckout(git_commit* commit, bool force)
+	static bool IsCancelled(const std::atomic<bool>* cancel)
 	{
-		git_repository* repo = git_commit_owner(commit);
-		int err = git_checkout_tree(repo, reinterpret_cast<git_object*>(commit), force ? &s_ForceCheckoutOptions : &s_SafeCheckoutOptions);
-		if (err == 0)
-			err = git_repository_set_head_detached(repo, git_commit_id(commit));
-		return err == 0;
+		return cancel && cancel->load(std::memory_order_relaxed);
 	}
 
-	void Client::FillDiff(git_diff* diff, Diff& out)
+	struct DiffBuilder
 	{
-		size_t diffDeltas = git_diff_num_deltas(diff);
-		for (size_t i = 0; i < diffDeltas; ++i)
-		{
-			const git_diff_delta* delta = git_diff_get_delta(diff, i);
+		Diff& Out;
+		const std::atomic<bool>* Cancel;
+		// Text a patch may hold, and size of the diff's text after which later patches only get counted
+		uint64_t FileLimit = UINT64_MAX;
+		uint64_t DiffLimit = UINT64_MAX;
+		// Set once the builder started a patch of its own, the diff may already hold patches
+		bool PatchOpen = false;
+	};
+
+	// Every line is stored with its own newline, text without one at the end of the file gets it here
+	static void AppendDiffLine(Diff& out, char origin, int32_t oldLine, int32_t newLine, bool prefix, const char* content, size_t length)
+	{
+		if (length && content[length - 1] == '\n')
+			--length;
+
+		DiffLine& line = out.Lines.push_back();
+		line.Origin = origin;
+		line.OldLine = oldLine;
+		line.NewLine = newLine;
+		line.Offset = static_cast<uint32_t>(out.Text.size());
+		line.Length = static_cast<uint32_t>(length + (prefix ? 1 : 0));
+
+		if (prefix)
+			out.Text.push_back(origin);
+		out.Text.insert(out.Text.end(), content, content + length);
+		out.Text.push_back('\n');
+
+		Patch& patch = out.Patches.back();
+		patch.Columns = eastl::max(patch.Columns, (prefix ? 1u : 0u) + DiffTextColumns(content, content + length));
+	}
 
-			#if 0
-			if (delta->flags == GIT_DIFF_FLAG_BINARY)
-			{
-				out.emplace_back(delta->status, delta->old_file.size, delta->new_file.size, delta->new_file.path, "@@BinaryData");
-			}
-			else
-			#endif
-			{
-				git_patch* patch = nullptr;
-				if (git_patch_from_diff(&patch, diff, i) == 0)
-				{
-					git_buf patchStr = GIT_BUF_INIT;
-					if (git_patch_to_buf(&patchStr, patch) == 0 && patchStr.ptr)
-					{
-						eastl::string_view patchString = patchStr.ptr;
-						const size_t start = patchString.find_first_of('@');
-						const size_t offset = start != eastl::string::npos ? start : 0;
-						out.Patches.emplace_back(delta->status, delta->old_file.size, delta->new_file.size, delta->new_file.path, patchStr.ptr + offset);
-					}
-					git_buf_free(&patchStr);
-				}
-				git_patch_free(patch);
-			}
-		}
+	// Checked before each hunk and line, past either limit the rest of the patch is only counted
+	static bool IsOverLimit(const DiffBuilder& builder)
+	{
+		const Diff& out = builder.Out;
+		return out.Text.size() - out.Patches.back().TextOffset >= builder.FileLimit || out.Text.size() >= builder.DiffLimit;
 	}
 
-	bool Client::GenerateDiff(git_commit* commit, Diff& out, uint32_t contextLines)
+	static void FinishDiffHunk(Diff& out)
 	{
-		git_commit* parent = nullptr;
-		int err = git_commit_parent(&parent, commit, 0);
+		const Patch& patch = out.Patches.back();
+		if (out.Hunks.size() > patch.FirstHunk)
+			out.Hunks.back().LineCount = static_cast<uint32_t>(out.Lines.size()) - out.Hunks.back().FirstLine;
+	}
 
-		bool success = err == 0;
-		if (success)
-			success = GenerateDiff(parent, commit, out, contextLines);
+	static void FinishPatch(DiffBuilder& builder)
+	{
+		if (!builder.PatchOpen)
+			return;
 
-		git_commit_free(parent);
+		Diff& out = builder.Out;
+		FinishDiffHunk(out);
+		Patch& patch = out.Patches.back();
+		patch.HunkCount = static_cast<uint32_t>(out.Hunks.size()) - patch.FirstHunk;
+		patch.LineCount = static_cast<uint32_t>(out.Lines.size()) - patch.FirstLine;
+		patch.TextSize = static_cast<uint32_t>(out.Text.size()) - patch.TextOffset;
+		patch.Loaded = true;
+		patch.Counted = true;
+		out.Text.push_back('\0');
+	}
 
-		return success;
+	static void InitPatch(Patch& patch, const git_diff_delta* delta)
+	{
+		patch.Status = delta->status;
+		patch.OldFileSize = delta->old_file.size;
+		patch.NewFileSize = delta->new_file.size;
+		patch.File = delta->new_file.path;
+		patch.Binary = (delta->flags & GIT_DIFF_FLAG_BINARY) != 0;
 	}
 
-	bool Client::GenerateDiff(git_commit* oldCommit, git_commit* newCommit, Diff& out, uint32_t contextLines)
+	static int DiffFileCallback(const git_diff_delta* delta, float /*progress*/, void* payload)
 	{
-		git_diff* diff = nullptr;
-		git_tree* oldCommitTree = nullptr;
-		git_tree* newCommitTree = nullptr;
+		DiffBuilder& builder = *static_cast<DiffBuilder*>(payload);
+		if (IsCancelled(builder.Cancel))
+			return -1;
+
+		FinishPatch(builder);
+		builder.PatchOpen = true;
+
+		Diff& out = builder.Out;
+		Patch& patch = out.Patches.push_back();
+		InitPatch(patch, delta);
+		patch.FirstHunk = static_cast<uint32_t>(out.Hunks.size());
+		patch.FirstLine = static_cast<uint32_t>(out.Lines.size());
+		patch.TextOffset = static_cast<uint32_t>(out.Text.size());
+		patch.Limit = builder.FileLimit;
+		return 0;
+	}
 
-		int err = git_commit_tree(&newCommitTree, newCommit);
-		if (err == 0)
-			err = git_commit_tree(&oldCommitTree, oldCommit);
+	static int DiffBinaryCallback(const git_diff_delta* /*delta*/, const git_diff_binary* /*binary*/, void* payload)
+	{
+		static_cast<DiffBuilder*>(payload)->Out.Patches.back().Binary = true;
+		return 0;
+	}
 
-		if (err == 0)
+	static int DiffHunkCallback(const git_diff_delta* /*delta*/, const git_diff_hunk* hunk, void* payload)
+	{
+		DiffBuilder& builder = *static_cast<DiffBuilder*>(payload);
+		if (IsCancelled(builder.Cancel))
+			return -1;
+
+		Diff& out = builder.Out;
+		Patch& patch = out.Patches.back();
+		++patch.TotalHunks;
+		if (patch.Truncated || IsOverLimit(builder))
 		{
-			git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
-			diffOp.flags = GIT_DIFF_MINIMAL | GIT_DIFF_INDENT_HEURISTIC | GIT_DIFF_UPDATE_INDEX | GIT_DIFF_SHOW_UNTRACKED_CONTENT;
-			diffOp.context_lines = contextLines;
-			err = git_diff_tree_to_tree(&diff, git_commit_owner(newCommit), oldCommitTree, newCommitTree, &diffOp);
+			patch.Truncated = true;
+			return 0;
 		}
 
-		if (diff)
+		FinishDiffHunk(out);
+		out.Hunks.push_back({ hunk->old_start, hunk->old_lines, hunk->new_start, hunk->new_lines, static_cast<uint32_t>(out.Lines.size()), 0 });
+		AppendDiffLine(out, GIT_DIFF_LINE_HUNK_HDR, -1, -1, false, hunk->header, hunk->header_len);
+		return 0;
+	}
+
+	static int DiffLineCallback(const git_diff_delta* /*delta*/, const git_diff_hunk* /*hunk*/, const git_diff_line* line, void* payload)
+	{
+		static constexpr const char s_NoNewline[] = "\\ No newline at end of file";
+
+		DiffBuilder& builder = *static_cast<DiffBuilder*>(payload);
+		Diff& out = builder.Out;
+		Patch& patch = out.Patches.back();
+		patch.Additions += line->origin == GIT_DIFF_LINE_ADDITION;
+		patch.Deletions += line->origin == GIT_DIFF_LINE_DELETION;
+		if (patch.Truncated || IsOverLimit(builder))
 		{
-			FillDiff(diff, out);
+			patch.Truncated = true;
+			return 0;
 		}
 
-		git_diff_free(diff);
-		git_tree_free(oldCommitTree);
-		git_tree_free(newCommitTree);
+		switch (line->origin)
+		{
+			case GIT_DIFF_LINE_CONTEXT:
+			case GIT_DIFF_LINE_ADDITION:
+			case GIT_DIFF_LINE_DELETION:
+				AppendDiffLine(out, line->origin, line->old_lineno, line->new_lineno, true, line->content, line->content_len);
+				break;
+			case GIT_DIFF_LINE_CONTEXT_EOFNL:
+			case GIT_DIFF_LINE_ADD_EOFNL:
+			case GIT_DIFF_LINE_DEL_EOFNL:
+				AppendDiffLine(out, line->origin, -1, -1, false, s_NoNewline, sizeof(s_NoNewline) - 1);
+				break;
+			default:
+				break;
+		}
 
-		return err == 0;
+		return 0;
 	}
 
-	bool Client::GenerateDiffWithWorkDir(git_repository* repo, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines)
+	static uint32_t GetDiffFlags(DiffAlgorithm algorithm)
 	{
-		git_reference* head = nullptr;
-		int err = git_repository_head(&head, repo);
-
-		const git_oid* oid = git_reference_target(head);
-
-		git_commit* commit = nullptr;
-		if (err == 0)
+		switch (algorithm)
 		{
-			err = git_commit_lookup(&commit, repo, oid);
-			err = GenerateDiffWithWorkDir(commit, outUnstaged, outStaged, contextLines) ? 0 : -1;
+			case DiffAlgorithm::Myers: return s_DiffFlags;
+			case DiffAlgorithm::Patience: return s_DiffFlags | GIT_DIFF_PATIENCE;
+			case DiffAlgorithm::Auto:
+			case DiffAlgorithm::Minimal: return s_DiffFlags | GIT_DIFF_MINIMAL;
 		}
 
-		git_commit_free(commit);
-		git_reference_free(head);
-
-		return err == 0;
+		return s_DiffFlags;
 	}
 
-	bool Client::GenerateDiffWithWorkDir(git_commit* commit, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines)
+	// Fills a single patch through the same callbacks as a whole diff, a binary or unchanged file comes without a patch.
+	// The patch's own delta is the one that knows whether the file is binary, a tree diff doesn't load the blobs.
+	// Returns false when cancelled between hunks, the patch is then left unfinished in out.
+	static bool FillPatch(const git_diff_delta* delta, git_patch* patch, DiffAlgorithm algorithm, Diff& out, uint64_t limit, const std::atomic<bool>* cancel = nullptr, uint64_t diffLimit = UINT64_MAX)
 	{
-		git_diff* unstagedDiff = nullptr;
-		git_diff* stagedDiff = nullptr;
-		git_tree* commitTree = nullptr;
+		if (patch)
+			delta = git_patch_get_delta(patch);
 
-		int err = git_commit_tree(&commitTree, commit);
+		DiffBuilder builder{ out, cancel, limit, diffLimit };
+		if (DiffFileCallback(delta, 0.0f, &builder) != 0)
+			return false;
 
-		if (err == 0)
+		out.Patches.back().Algorithm = algorithm;
+		for (size_t h = 0, hunkCount = patch ? git_patch_num_hunks(patch) : 0; h < hunkCount; ++h)
 		{
-			git_repository* repo = git_commit_owner(commit);
+			const git_diff_hunk* hunk = nullptr;
+			size_t lineCount = 0;
+			if (git_patch_get_hunk(&hunk, &lineCount, patch, h) != 0)
+				break;
 
-			git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
-			diffOp.flags = GIT_DIFF_MINIMAL | GIT_DIFF_INDENT_HEURISTIC | GIT_DIFF_UPDATE_INDEX | GIT_DIFF_SHOW_UNTRACKED_CONTENT;
-			diffOp.context_lines = contextLines;
+			if (DiffHunkCallback(delta, hunk, &builder) != 0)
+				return false;
 
-			err = git_diff_index_to_workdir(&unstagedDiff, repo, nullptr, &diffOp);
-			
-			if (err == 0)
-				err = git_diff_tree_to_index(&stagedDiff, repo, commitTree, nullptr, &diffOp);
+			for (size_t l = 0; l < lineCount; ++l)
+			{
+				const git_diff_line* line = nullptr;
+				if (git_patch_get_line_in_hunk(&line, patch, h, l) == 0)
+					DiffLineCallback(delta, hunk, line, &builder);
+			}
 		}
 
-		if (err == 0 && unstagedDiff && stagedDiff)
+		FinishPatch(builder);
+		return true;
+	}
+
+	// Bigger side of a delta, trees don't store sizes so those are read from the object headers
+	static uint64_t GetDeltaSize(git_repository* repo, const git_diff_delta* delta)
+	{
+		uint64_t size = 0;
+		git_odb* odb = nullptr;
+		for (const git_diff_file* file : { &delta->old_file, &delta->new_file })
+		{
+			size_t objectSize = 0;
+			git_object_t type;
+			if (file->size)
+				size = eastl::max<uint64_t>(size, file->size);
+			else if (!git_oid_is_zero(&file->id) && (odb || git_repository_odb(&odb, repo) == 0) && git_odb_read_header(&objectSize, &type, odb, &file->id) == 0)
+				size = eastl::max<uint64_t>(size, objectSize);
+		}
+
+		git_odb_free(odb);
+		return size;
+	}
+
+	// Diff a patch is generated from. Auto takes it from the minimal source diff unless the file is big or the deadline passed,
+	// those come from a Myers diff of the same inputs that getFallback creates the first time it is needed.
+	// Called before each file's patch is generated, that's the only point the deadline can move a file to Myers.
+	template<typename GetFallback>
+	static git_diff* ChoosePatchSource(git_repository* repo, git_diff* source, size_t index, DiffAlgorithm& algorithm, std::chrono::steady_clock::time_point deadline, GetFallback&& getFallback)
+	{
+		if (algorithm != DiffAlgorithm::Auto)
+			return source;
+
+		algorithm = DiffAlgorithm::Minimal;
+		const git_diff_delta* delta = git_diff_get_delta(source, index);
+		if (std::chrono::steady_clock::now() < deadline && GetDeltaSize(repo, delta) <= DIFF_AUTO_MINIMAL_SIZE)
+			return source;
+
+		// A work tree that changed between the two diffs may have moved its files around
+		git_diff* fallback = getFallback();
+		const git_diff_delta* fallbackDelta = fallback && index < git_diff_num_deltas(fallback) ? git_diff_get_delta(fallback, index) : nullptr;
+		if (!fallbackDelta || strcmp(fallbackDelta->new_file.path, delta->new_file.path) != 0)
+			return source;
+
+		algorithm = DiffAlgorithm::Myers;
+		return fallback;
+	}
+
+	// Hunks and lines are printed straight into the diff's buffers, no patch is formatted as a whole
+	template<typename GetFallback>
+	static bool FillDiff(git_repository* repo, git_diff* diff, DiffAlgorithm algorithm, Diff& out, GetFallback&& getFallback)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DIFF_AUTO_TIME_BUDGET_MS);
+		const uint64_t fileLimit = s_DiffFileLimit.load(std::memory_order_relaxed);
+		const uint64_t diffLimit = out.Text.size() + s_DiffTotalLimit.load(std::memory_order_relaxed);
+		for (size_t i = 0, count = git_diff_num_deltas(diff); i < count; ++i)
+		{
+			DiffAlgorithm used = algorithm;
+			git_diff* source = ChoosePatchSource(repo, diff, i, used, deadline, getFallback);
+			git_patch* patch = nullptr;
+			if (git_patch_from_diff(&patch, source, i) != 0)
+				return false;
+
+			FillPatch(git_diff_get_delta(source, i), patch, used, out, fileLimit, nullptr, diffLimit);
+			git_patch_free(patch);
+		}
+
+		return true;
+	}
+
+	// Only the deltas are read, no blob is loaded until a patch is generated
+	static void ListPatches(git_diff* source, Diff& out)
+	{
+		const size_t count = git_diff_num_deltas(source);
+		out.Patches.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+			InitPatch(out.Patches.push_back(), git_diff_get_delta(source, i));
+	}
+
+	// Copies the ranges of the filled in patches into buffers of their own, dropping the ones patches filled in again left behind
+	static void CompactDiff(Diff& diff)
+	{
+		size_t hunkCount = 0;
+		size_t lineCount = 0;
+		size_t textSize = 0;
+		for (const Patch& patch : diff.Patches)
+		{
+			hunkCount += patch.HunkCount;
+			lineCount += patch.LineCount;
+			textSize += patch.Loaded ? patch.TextSize + 1 : 0;
+		}
+
+		eastl::vector<DiffHunk> hunks;
+		eastl::vector<DiffLine> lines;
+		eastl::vector<char> text;
+		hunks.reserve(hunkCount);
+		lines.reserve(lineCount);
+		text.reserve(textSize);
+		for (Patch& patch : diff.Patches)
+		{
+			if (!patch.Loaded)
+				continue;
+
+			const uint32_t firstHunk = static_cast<uint32_t>(hunks.size());
+			const uint32_t firstLine = static_cast<uint32_t>(lines.size());
+			const uint32_t textOffset = static_cast<uint32_t>(text.size());
+			for (uint32_t i = 0; i < patch.HunkCount; ++i)
+			{
+				DiffHunk hunk = diff.Hunks[patch.FirstHunk + i];
+				hunk.FirstLine = hunk.FirstLine - patch.FirstLine + firstLine;
+				hunks.push_back(hunk);
+			}
+			for (uint32_t i = 0; i < patch.LineCount; ++i)
+			{
+				DiffLine line = diff.Lines[patch.FirstLine + i];
+				line.Offset = line.Offset - patch.TextOffset + textOffset;
+				lines.push_back(line);
+			}
+
+			// A patch that couldn't be generated has no text of its own, it gets a terminator all the same
+			const char* patchText = diff.Text.data() + patch.TextOffset;
+			text.insert(text.end(), patchText, patchText + patch.TextSize);
+			text.push_back('\0');
+
+			patch.FirstHunk = firstHunk;
+			patch.FirstLine = firstLine;
+			patch.TextOffset = textOffset;
+		}
+
+		diff.Hunks.swap(hunks);
+		diff.Lines.swap(lines);
+		diff.Text.swap(text);
+		diff.StaleText = 0;
+	}
+
+	// Copies a patch filled into another diff into its slot of a shared diff, the caller holds the diff's mutex.
+	// A patch filled in again leaves its old ranges behind, the buffers are compacted once those are half the text.
+	static void PublishPatch(Diff& diff, uint32_t index, const Diff& filled, uint32_t filledIndex)
+	{
+		const Patch& source = filled.Patches[filledIndex];
+		const uint32_t firstHunk = static_cast<uint32_t>(diff.Hunks.size());
+		const uint32_t firstLine = static_cast<uint32_t>(diff.Lines.size());
+		const uint32_t textOffset = static_cast<uint32_t>(diff.Text.size());
+
+		for (uint32_t i = 0; i < source.HunkCount; ++i)
+		{
+			DiffHunk hunk = filled.Hunks[source.FirstHunk + i];
+			hunk.FirstLine = hunk.FirstLine - source.FirstLine + firstLine;
+			diff.Hunks.push_back(hunk);
+		}
+		for (uint32_t i = 0; i < source.LineCount; ++i)
+		{
+			DiffLine line = filled.Lines[source.FirstLine + i];
+			line.Offset = line.Offset - source.TextOffset + textOffset;
+			diff.Lines.push_back(line);
+		}
+
+		// The terminator comes along
+		const char* text = filled.Text.data() + source.TextOffset;
+		diff.Text.insert(diff.Text.end(), text, text + source.TextSize + 1);
+
+		Patch& patch = diff.Patches[index];
+		if (patch.Loaded)
+			diff.StaleText += patch.TextSize + 1;
+		patch.Binary = source.Binary;
+		patch.FirstHunk = firstHunk;
+		patch.HunkCount = source.HunkCount;
+		patch.FirstLine = firstLine;
+		patch.LineCount = source.LineCount;
+		patch.TextOffset = textOffset;
+		patch.TextSize = source.TextSize;
+		patch.Columns = source.Columns;
+		patch.Additions = source.Additions;
+		patch.Deletions = source.Deletions;
+		patch.Truncated = source.Truncated;
+		patch.TotalHunks = source.TotalHunks;
+		patch.Limit = source.Limit;
+		patch.Algorithm = source.Algorithm;
+		patch.Counted = true;
+		patch.Loaded = true;
+		++diff.Revision;
+
+		if (diff.StaleText * 2 > diff.Text.size())
+			CompactDiff(diff);
+	}
+
+	static bool GetDiffKey(git_commit* commit, DiffAlgorithm algorithm, DiffKey& out)
+	{
+		out.NewTree = *git_commit_tree_id(commit);
+		out.ContextLines = DIFF_CONTEXT_LINES;
+		out.Flags = GetDiffFlags(algorithm);
+		out.Algorithm = algorithm;
+
+		// Root commits have no diff, their key compares against the zero tree
+		git_commit* parent = nullptr;
+		if (git_commit_parentcount(commit) == 0)
+		{
+			out.OldTree = {};
+			return true;
+		}
+
+		if (git_commit_parent(&parent, commit, 0) != 0)
+			return false;
+
+		out.OldTree = *git_commit_tree_id(parent);
+		git_commit_free(parent);
+		return true;
+	}
+
+	// Tree to tree diff of a cache key, only the trees are compared and no blob is loaded
+	static git_diff* DiffTrees(git_repository* repo, const DiffKey& key)
+	{
+		git_diff* diff = nullptr;
+		git_tree* oldTree = nullptr;
+		git_tree* newTree = nullptr;
+
+		int err = git_tree_lookup(&newTree, repo, &key.NewTree);
+		if (err == 0 && !git_oid_is_zero(&key.OldTree))
+			err = git_tree_lookup(&oldTree, repo, &key.OldTree);
+
+		if (err == 0)
+		{
+			git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+			diffOp.flags = key.Flags;
+			diffOp.context_lines = key.ContextLines;
+			diffOp.max_size = DIFF_MAX_FILE_SIZE;
+			err = git_diff_tree_to_tree(&diff, repo, oldTree, newTree, &diffOp);
+		}
+
+		git_tree_free(oldTree);
+		git_tree_free(newTree);
+
+		if (err != 0)
+		{
+			git_diff_free(diff);
+			return nullptr;
+		}
+
+		return diff;
+	}
+
+	static git_diff* GetSourceDiff(git_repository* repo, git_diff*& source, DiffKey& sourceKey, const DiffKey& key)
+	{
+		if (source && sourceKey == key)
+			return source;
+
+		git_diff_free(source);
+		source = DiffTrees(repo, key);
+		sourceKey = key;
+		return source;
+	}
+
+	static DiffKey GetFallbackKey(DiffKey key)
+	{
+		key.Flags = GetDiffFlags(DiffAlgorithm::Myers);
+		key.Algorithm = DiffAlgorithm::Myers;
+		return key;
+	}
+
+	static bool HasPatchWork(const DiffLoader& loader)
+	{
+		return loader.Current && (!loader.OpenedPatches.empty() || loader.NextPatch < loader.Current->Patches.size());
+	}
+
+	static void SetCurrentDiff(DiffLoader& loader, const eastl::shared_ptr<Diff>& diff, const DiffKey& key)
+	{
+		if (loader.Current == diff)
+			return;
+
+		// The shown diff stays cached while the panel looks it up by key, neighbours filled in after it can't evict it
+		if (loader.Current)
+			s_DiffCache.Unpin(loader.CurrentKey);
+		if (diff)
+			s_DiffCache.Pin(key);
+
+		loader.Current = diff;
+		loader.CurrentKey = key;
+		loader.OpenedPatches.clear();
+		loader.NextPatch = 0;
+		loader.LoadAll = false;
+		loader.Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DIFF_AUTO_TIME_BUDGET_MS);
+	}
+
+	// The patch is generated without holding the diff's mutex, the panel only waits for it to be copied in.
+	// Asking for more of a truncated patch fills it again up to one more file limit and replaces it, with the algorithm it had.
+	// Nothing is published once the loader is cancelled.
+	static void LoadPatch(DiffLoader& loader, Diff& diff, const DiffKey& key, uint32_t index, bool text, bool more, std::chrono::steady_clock::time_point deadline, Diff& scratch)
+	{
+		uint64_t limit = s_DiffFileLimit.load(std::memory_order_relaxed);
+		{
+			std::scoped_lock lock(diff.Mutex);
+			const Patch& patch = diff.Patches[index];
+			if (more && !(patch.Loaded && patch.Truncated))
+				return;
+			if (!more && (patch.Loaded || (!text && patch.Counted)))
+				return;
+
+			if (more)
+			{
+				limit += patch.Limit;
+				deadline = patch.Algorithm == DiffAlgorithm::Myers ? std::chrono::steady_clock::time_point::min() : std::chrono::steady_clock::time_point::max();
+			}
+		}
+
+		if (loader.Cancel.load(std::memory_order_relaxed))
+			return;
+
+		git_diff* source = GetSourceDiff(loader.Repository, loader.Source, loader.SourceKey, key);
+		const bool found = source && index < git_diff_num_deltas(source);
+		DiffAlgorithm algorithm = key.Algorithm;
+		git_patch* patch = nullptr;
+		if (found)
+		{
+			source = ChoosePatchSource(loader.Repository, source, index, algorithm, deadline, [&]() { return GetSourceDiff(loader.Repository, loader.Fallback, loader.FallbackKey, GetFallbackKey(key)); });
+			git_patch_from_diff(&patch, source, index);
+		}
+
+		scratch.Clear();
+		size_t additions = 0;
+		size_t deletions = 0;
+		bool binary = false;
+		if (text && found)
+		{
+			FillPatch(git_diff_get_delta(source, index), patch, algorithm, scratch, limit, &loader.Cancel);
+		}
+		else if (patch)
+		{
+			git_patch_line_stats(nullptr, &additions, &deletions, patch);
+			binary = (git_patch_get_delta(patch)->flags & GIT_DIFF_FLAG_BINARY) != 0;
+		}
+		git_patch_free(patch);
+		if (loader.Cancel.load(std::memory_order_relaxed))
+			return;
+
+		int64_t grown = 0;
+		{
+			std::scoped_lock lock(diff.Mutex);
+			Patch& target = diff.Patches[index];
+			if (!scratch.Patches.empty())
+			{
+				const size_t bytes = DiffCache::BufferBytes(diff);
+				PublishPatch(diff, index, scratch, 0);
+				grown = static_cast<int64_t>(DiffCache::BufferBytes(diff)) - static_cast<int64_t>(bytes);
+			}
+			else
+			{
+				// A patch that can't be generated is left empty so the panel stops waiting for it
+				target.Binary |= binary;
+				target.Additions = static_cast<uint32_t>(additions);
+				target.Deletions = static_cast<uint32_t>(deletions);
+				target.Counted = true;
+				target.Loaded |= text;
+			}
+		}
+
+		if (grown)
+			s_DiffCache.Charge(key, &diff, grown);
+	}
+
+	// Fills in a run of patches on the thread pool. Each pool thread diffs the trees again on its own repository handle,
+	// fills chunks of patches into its slot and the chunks are published in delta order once the run is done.
+	// Returns false once the diff's text reached the total limit, the rest of the patches are filled in only when opened.
+	// A cancelled run publishes nothing.
+	static bool LoadPatchesParallel(DiffLoader& loader, Diff& diff, const DiffKey& key, uint32_t first, uint32_t count, std::chrono::steady_clock::time_point deadline)
+	{
+		eastl::vector<uint32_t> indices;
+		{
+			std::scoped_lock lock(diff.Mutex);
+			if (diff.Text.size() >= s_DiffTotalLimit.load(std::memory_order_relaxed))
+				return false;
+
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				if (!diff.Patches[i].Loaded)
+					indices.push_back(i);
+			}
+		}
+
+		if (indices.empty())
+			return true;
+
+		const uint32_t slotCount = ThreadPool::Size();
+		if (!loader.Slots)
+			loader.Slots = eastl::make_unique<DiffSlot[]>(slotCount);
+
+		// Where each chunk landed, a chunk whose slot couldn't diff the trees is left for the single patch path
+		struct Chunk
+		{
+			DiffSlot* Slot = nullptr;
+			uint32_t FirstPatch = 0;
+		};
+
+		const uint32_t indexCount = static_cast<uint32_t>(indices.size());
+		const uint32_t chunkCount = (indexCount + DIFF_PATCH_CHUNK - 1) / DIFF_PATCH_CHUNK;
+		eastl::vector<Chunk> chunks(chunkCount);
+		const char* path = git_repository_path(loader.Repository);
+		const uint64_t limit = s_DiffFileLimit.load(std::memory_order_relaxed);
+		ThreadPool::ParallelFor(chunkCount, [&](uint32_t c, uint32_t worker)
+		{
+			if (loader.Cancel.load(std::memory_order_relaxed))
+				return;
+
+			DiffSlot& slot = loader.Slots[worker];
+			if (!slot.Repository && git_repository_open(&slot.Repository, path) != 0)
+				return;
+
+			git_diff* source = GetSourceDiff(slot.Repository, slot.Source, slot.SourceKey, key);
+			if (!source)
+				return;
+
+			const uint32_t end = eastl::min((c + 1) * DIFF_PATCH_CHUNK, indexCount);
+			const size_t deltaCount = git_diff_num_deltas(source);
+			for (uint32_t i = c * DIFF_PATCH_CHUNK; i < end; ++i)
+			{
+				if (indices[i] >= deltaCount)
+					return;
+			}
+
+			chunks[c] = { &slot, static_cast<uint32_t>(slot.Filled.Patches.size()) };
+			for (uint32_t i = c * DIFF_PATCH_CHUNK; i < end; ++i)
+			{
+				DiffAlgorithm algorithm = key.Algorithm;
+				git_diff* patchSource = ChoosePatchSource(slot.Repository, source, indices[i], algorithm, deadline, [&]() { return GetSourceDiff(slot.Repository, slot.Fallback, slot.FallbackKey, GetFallbackKey(key)); });
+				git_patch* patch = nullptr;
+				git_patch_from_diff(&patch, patchSource, indices[i]);
+				const bool filled = FillPatch(git_diff_get_delta(patchSource, indices[i]), patch, algorithm, slot.Filled, limit, &loader.Cancel);
+				git_patch_free(patch);
+				if (!filled)
+					return;
+			}
+		});
+
+		int64_t grown = 0;
+		if (!loader.Cancel.load(std::memory_order_relaxed))
+		{
+			std::scoped_lock lock(diff.Mutex);
+			const size_t bytes = DiffCache::BufferBytes(diff);
+			for (uint32_t c = 0; c < chunkCount; ++c)
+			{
+				if (!chunks[c].Slot)
+					continue;
+
+				for (uint32_t i = c * DIFF_PATCH_CHUNK, end = eastl::min((c + 1) * DIFF_PATCH_CHUNK, indexCount); i < end; ++i)
+				{
+					// The panel may have had the patch opened on its own meanwhile
+					if (!diff.Patches[indices[i]].Loaded)
+						PublishPatch(diff, indices[i], chunks[c].Slot->Filled, chunks[c].FirstPatch + i - c * DIFF_PATCH_CHUNK);
+				}
+			}
+			grown = static_cast<int64_t>(DiffCache::BufferBytes(diff)) - static_cast<int64_t>(bytes);
+		}
+
+		for (uint32_t i = 0; i < slotCount; ++i)
+			loader.Slots[i].Filled.Clear();
+
+		if (grown)
+			s_DiffCache.Charge(key, &diff, grown);
+
+		return true;
+	}
+
+	static void GenerateDiffs(DiffLoader* loader)
+	{
+		Diff scratch;
+		std::unique_lock lock(loader->Mutex);
+		while (true)
+		{
+			loader->Wake.wait(lock, [loader]() { return loader->Stop || !loader->Queue.empty() || HasPatchWork(*loader); });
+			if (loader->Stop)
+				return;
+
+			// Only work picked after the last request runs, that request already dropped whatever it cancelled
+			loader->Cancel.store(false, std::memory_order_relaxed);
+
+			// Patches opened in the panel come first, then the file lists of queued commits, then the rest of the shown diff
+			if (!loader->OpenedPatches.empty() || loader->Queue.empty())
+			{
+				eastl::shared_ptr<Diff> diff = loader->Current;
+				const DiffKey key = loader->CurrentKey;
+				const auto deadline = loader->Deadline;
+				const bool opened = !loader->OpenedPatches.empty();
+
+				// Filling in the whole diff goes wide, a round at a time so opened patches and new requests still come first
+				if (!opened && loader->LoadAll)
+				{
+					const uint32_t first = loader->NextPatch;
+					const uint32_t count = eastl::min(ThreadPool::Size() * DIFF_CHUNKS_PER_ROUND * DIFF_PATCH_CHUNK, static_cast<uint32_t>(diff->Patches.size()) - first);
+					loader->NextPatch += count;
+					lock.unlock();
+
+					const bool underLimit = LoadPatchesParallel(*loader, *diff, key, first, count, deadline);
+
+					lock.lock();
+					if (!underLimit && loader->Current == diff)
+						loader->NextPatch = static_cast<uint32_t>(diff->Patches.size());
+					// Picked up again if the diff is shown again, patches already filled in are skipped
+					else if (loader->Cancel.load(std::memory_order_relaxed) && loader->Current == diff)
+						loader->NextPatch = eastl::min(loader->NextPatch, first);
+					continue;
+				}
+
+				const DiffLoader::PatchRequest request = opened ? loader->OpenedPatches.front() : DiffLoader::PatchRequest{ loader->NextPatch++, false };
+				if (opened)
+					loader->OpenedPatches.erase(loader->OpenedPatches.begin());
+				lock.unlock();
+
+				// A file opened on its own only falls back for its size
+				LoadPatch(*loader, *diff, key, request.Index, opened, request.More, opened ? std::chrono::steady_clock::time_point::max() : deadline, scratch);
+
+				// The panel asks for an opened patch again every frame it stays open
+				lock.lock();
+				if (!opened && loader->Cancel.load(std::memory_order_relaxed) && loader->Current == diff)
+					loader->NextPatch = eastl::min(loader->NextPatch, request.Index);
+				continue;
+			}
+
+			const git_oid oid = loader->Queue.front();
+			const DiffAlgorithm algorithm = loader->Algorithm;
+			loader->Queue.erase(loader->Queue.begin());
+			loader->Running = oid;
+			lock.unlock();
+
+			// Listing the files only compares trees, a failed diff is cached empty so the panel stops waiting for it
+			git_commit* commit = nullptr;
+			DiffKey key;
+			eastl::shared_ptr<Diff> diff;
+			const bool found = git_commit_lookup(&commit, loader->Repository, &oid) == 0 && GetDiffKey(commit, algorithm, key);
+			git_commit_free(commit);
+			if (found && !s_DiffCache.Contains(key))
+			{
+				diff = eastl::make_shared<Diff>();
+				if (git_diff* source = GetSourceDiff(loader->Repository, loader->Source, loader->SourceKey, key))
+					ListPatches(source, *diff);
+
+				s_DiffCache.Insert(key, diff);
+			}
+
+			lock.lock();
+			loader->Running = {};
+			// The algorithm may have changed meanwhile, the diff stays cached but isn't the one asked for anymore
+			if (found && algorithm == loader->Algorithm)
+			{
+				// Only a shortcut, a commit whose key was dropped is looked up again by the worker.
+				// The selected commit's key is kept, the panel may still be waiting to find its diff by it.
+				if (loader->Keys.Size() >= DIFF_LOADER_MAX_KEYS)
+				{
+					const DiffKey* selected = loader->Keys.Find(loader->Selected);
+					const DiffKey selectedKey = selected ? *selected : DiffKey{};
+					const bool keepSelected = selected != nullptr;
+					loader->Keys.Clear();
+					if (keepSelected)
+						loader->Keys[loader->Selected] = selectedKey;
+				}
+				loader->Keys[oid] = key;
+				if (git_oid_equal(&oid, &loader->Selected))
+				{
+					if (!diff)
+						diff = s_DiffCache.Find(key);
+					if (diff)
+						SetCurrentDiff(*loader, diff, key);
+				}
+			}
+		}
+	}
+
+	// The key of a commit the worker has seen, only valid while the diff is still cached
+	static bool FindCachedKey(DiffLoader& loader, const git_oid& oid, DiffKey& outKey)
+	{
+		const DiffKey* key = loader.Keys.Find(oid);
+		if (!key || !s_DiffCache.Contains(*key))
+			return false;
+
+		outKey = *key;
+		return true;
+	}
+
+	eastl::shared_ptr<Diff> Client::RequestDiff(RepoData* repoData, size_t row)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		if (!loader.Repository && git_repository_open(&loader.Repository, git_repository_path(repoData->Repository)) != 0)
+			return nullptr;
+
+		// The selected commit first, then the ones the selection is likely to move to
+		const CommitStore& commits = repoData->Commits;
+		eastl::vector<git_oid> wanted;
+		wanted.push_back(commits.Oid(row));
+		if (row + 1 < commits.Size())
+			wanted.push_back(commits.Oid(row + 1));
+		if (row > 0)
+			wanted.push_back(commits.Oid(row - 1));
+
+		eastl::shared_ptr<Diff> diff;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			DiffKey key;
+			if (FindCachedKey(loader, wanted[0], key))
+				diff = s_DiffCache.Find(key);
+			s_DiffCache.CountLookup(diff != nullptr);
+
+			// Patches of the previous selection are of no use anymore, the panel asks for the new one's once it shows them
+			if (!git_oid_equal(&wanted[0], &loader.Selected))
+			{
+				loader.Cancel.store(true, std::memory_order_relaxed);
+				loader.OpenedPatches.clear();
+			}
+
+			loader.Selected = wanted[0];
+			if (diff)
+				SetCurrentDiff(loader, diff, key);
+
+			const bool running = !git_oid_is_zero(&loader.Running);
+			loader.Queue.clear();
+			for (size_t i = diff ? 1 : 0; i < wanted.size(); ++i)
+			{
+				if (!FindCachedKey(loader, wanted[i], key) && !(running && git_oid_equal(&wanted[i], &loader.Running)))
+					loader.Queue.push_back(wanted[i]);
+			}
+
+			if (!loader.Thread.joinable())
+				loader.Thread = std::thread(GenerateDiffs, &loader);
+		}
+
+		loader.Wake.notify_one();
+		return diff;
+	}
+
+	eastl::shared_ptr<Diff> Client::FindDiff(RepoData* repoData, const git_oid& commit)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			DiffKey key;
+			if (FindCachedKey(loader, commit, key))
+				return s_DiffCache.Find(key);
+
+			// Evicted before the panel got to it, the selected commit goes to the front of the queue again
+			const bool generated = loader.Keys.Find(commit) != nullptr;
+			const bool queued = git_oid_equal(&commit, &loader.Running) || eastl::any_of(loader.Queue.begin(), loader.Queue.end(), [&](const git_oid& oid) { return git_oid_equal(&oid, &commit); });
+			if (!generated || queued || !git_oid_equal(&commit, &loader.Selected))
+				return nullptr;
+
+			loader.Queue.insert(loader.Queue.begin(), commit);
+		}
+
+		loader.Wake.notify_one();
+		return nullptr;
+	}
+
+	static void QueuePatch(RepoData* repoData, const eastl::shared_ptr<Diff>& diff, const DiffLoader::PatchRequest& request)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			if (loader.Current != diff || eastl::find(loader.OpenedPatches.begin(), loader.OpenedPatches.end(), request) != loader.OpenedPatches.end())
+				return;
+
+			loader.OpenedPatches.push_back(request);
+		}
+
+		loader.Wake.notify_one();
+	}
+
+	void Client::RequestPatch(RepoData* repoData, const eastl::shared_ptr<Diff>& diff, uint32_t patch)
+	{
+		QueuePatch(repoData, diff, { patch, false });
+	}
+
+	void Client::RequestMorePatch(RepoData* repoData, const eastl::shared_ptr<Diff>& diff, uint32_t patch)
+	{
+		QueuePatch(repoData, diff, { patch, true });
+	}
+
+	// The file is diffed again on its own, with the same options as the whole local diff and the algorithm the patch had
+	bool Client::ExtendWorkDirPatch(git_repository* repo, bool staged, uint32_t contextLines, Diff& diff, uint32_t patch)
+	{
+		Patch& target = diff.Patches[patch];
+		char* path = target.File.data();
+
+		git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+		diffOp.flags = GetDiffFlags(target.Algorithm) | GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+		diffOp.context_lines = contextLines;
+		diffOp.max_size = DIFF_MAX_FILE_SIZE;
+		diffOp.pathspec = { &path, 1 };
+
+		git_diff* fileDiff = nullptr;
+		git_object* headTree = nullptr;
+		int err = 0;
+		if (staged)
+		{
+			err = git_revparse_single(&headTree, repo, "HEAD^{tree}");
+			if (err == 0)
+				err = git_diff_tree_to_index(&fileDiff, repo, reinterpret_cast<git_tree*>(headTree), nullptr, &diffOp);
+		}
+		else
+		{
+			err = git_diff_index_to_workdir(&fileDiff, repo, nullptr, &diffOp);
+		}
+
+		Diff filled;
+		if (err == 0)
+		{
+			DiffBuilder builder{ filled, nullptr, target.Limit + s_DiffFileLimit.load(std::memory_order_relaxed) };
+			err = git_diff_foreach(fileDiff, DiffFileCallback, DiffBinaryCallback, DiffHunkCallback, DiffLineCallback, &builder);
+			FinishPatch(builder);
+		}
+
+		const bool found = err == 0 && filled.Patches.size() == 1 && filled.Patches[0].File == target.File;
+		if (found)
+		{
+			filled.Patches[0].Algorithm = target.Algorithm;
+			PublishPatch(diff, patch, filled, 0);
+		}
+
+		git_diff_free(fileDiff);
+		git_object_free(headTree);
+		return found;
+	}
+
+	void Client::SetDiffLimits(uint64_t fileBytes, uint64_t diffBytes)
+	{
+		s_DiffFileLimit.store(fileBytes, std::memory_order_relaxed);
+		s_DiffTotalLimit.store(diffBytes, std::memory_order_relaxed);
+	}
+
+	uint64_t Client::GetDiffFileLimit()
+	{
+		return s_DiffFileLimit.load(std::memory_order_relaxed);
+	}
+
+	uint64_t Client::GetDiffTotalLimit()
+	{
+		return s_DiffTotalLimit.load(std::memory_order_relaxed);
+	}
+
+	void Client::SetDiffAlgorithm(RepoData* repoData, DiffAlgorithm algorithm)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		std::scoped_lock lock(loader.Mutex);
+		if (loader.Algorithm == algorithm)
+			return;
+
+		loader.Algorithm = algorithm;
+		loader.Cancel.store(true, std::memory_order_relaxed);
+		loader.Keys.Clear();
+		loader.Queue.clear();
+		SetCurrentDiff(loader, nullptr, {});
+	}
+
+	DiffAlgorithm Client::GetDiffAlgorithm(RepoData* repoData)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		std::scoped_lock lock(loader.Mutex);
+		return loader.Algorithm;
+	}
+
+	void Client::RequestAllPatches(RepoData* repoData, const eastl::shared_ptr<Diff>& diff)
+	{
+		DiffLoader& loader = repoData->Diffs;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			if (loader.Current != diff || loader.LoadAll)
+				return;
+
+			// The background pass starts over, patches it only counted get their text this time
+			loader.LoadAll = true;
+			loader.NextPatch = 0;
+			loader.Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DIFF_AUTO_TIME_BUDGET_MS);
+		}
+
+		loader.Wake.notify_one();
+	}
+
+	DiffCache& Client::GetDiffCache()
+	{
+		return s_DiffCache;
+	}
+
+	void Client::StopDiffs(RepoData& repoData)
+	{
+		DiffLoader& loader = repoData.Diffs;
+		{
+			std::scoped_lock lock(loader.Mutex);
+			loader.Stop = true;
+			loader.Cancel.store(true, std::memory_order_relaxed);
+		}
+
+		loader.Wake.notify_one();
+		if (loader.Thread.joinable())
+			loader.Thread.join();
+
+		loader.Queue.clear();
+		loader.Keys.Clear();
+		loader.Running = {};
+		loader.Selected = {};
+		SetCurrentDiff(loader, nullptr, {});
+		git_diff_free(loader.Source);
+		git_diff_free(loader.Fallback);
+		loader.Source = nullptr;
+		loader.Fallback = nullptr;
+		for (uint32_t i = 0; loader.Slots && i < ThreadPool::Size(); ++i)
+		{
+			git_diff_free(loader.Slots[i].Source);
+			git_diff_free(loader.Slots[i].Fallback);
+			git_repository_free(loader.Slots[i].Repository);
+		}
+		loader.Slots.reset();
+		loader.Stop = false;
+		loader.Cancel.store(false, std::memory_order_relaxed);
+	}
+
+	void Client::StopLoading(RepoData& repoData)
+	{
+		CommitLoader& loader = repoData.Loader;
+		loader.Cancel.store(true, std::memory_order_relaxed);
+		if (loader.Thread.joinable())
+			loader.Thread.join();
+
+		loader.Pending.Clear();
+		loader.PendingFront.Clear();
+		loader.Push.clear();
+		loader.Hide.clear();
+		loader.Cancel.store(false, std::memory_order_relaxed);
+		loader.Running.store(false, std::memory_order_relaxed);
+		loader.Walked.store(0, std::memory_order_relaxed);
+	}
+
+	static void StopStatus(StatusLoader& loader)
+	{
+		{
+			std::scoped_lock lock(loader.Mutex);
+			loader.Stop = true;
+		}
+
+		loader.Wake.notify_one();
+		if (loader.Thread.joinable())
+			loader.Thread.join();
+	}
+
+	RepoData::~RepoData()
+	{
+		Watcher.Stop();
+		Client::StopOperations(*this);
+		Client::StopLoading(*this);
+		Client::StopDiffs(*this);
+		if (CacheWriter.Thread.joinable())
+			CacheWriter.Thread.join();
+		StopStatus(StatusWorker);
+
+		Commits.Clear();
+		CommitHandles.Clear();
+
+		for (auto& [branchRef, _] : Branches)
+			git_reference_free(branchRef);
+
+		git_repository_free(Loader.Repository);
+		git_repository_free(Diffs.Repository);
+		git_repository_free(Operations.Repository);
+		git_repository_free(StatusWorker.Repository);
+		git_repository_free(Repository);
+	}
+
+	static bool IsChangedPath(const eastl::hash_set<eastl::string>& changed, const eastl::string& path)
+	{
+		if (changed.find(path) != changed.end())
+			return true;
+
+		// A changed directory stands for everything under it
+		for (size_t slash = path.find('/'); slash != eastl::string::npos; slash = path.find('/', slash + 1))
+		{
+			if (changed.find(path.substr(0, slash)) != changed.end())
+				return true;
+		}
+
+		return false;
+	}
+
+	// Status of the given paths and what is under them replaces theirs in out, without paths out is replaced as a whole
+	static bool ReadStatus(git_repository* repo, const eastl::vector<eastl::string>* paths, eastl::hash_map<eastl::string, uint32_t>& out)
+	{
+		eastl::vector<char*> pathspec;
+		git_status_options statusOptions = GIT_STATUS_OPTIONS_INIT;
+		if (paths)
+		{
+			for (const eastl::string& path : *paths)
+				pathspec.push_back(const_cast<char*>(path.c_str()));
+			statusOptions.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+			statusOptions.pathspec = { pathspec.data(), pathspec.size() };
+		}
+
+		git_status_list* statusList = nullptr;
+		if (git_status_list_new(&statusList, repo, &statusOptions) != 0)
+			return false;
+
+		if (paths)
+		{
+			const eastl::hash_set<eastl::string> changed(paths->begin(), paths->end());
+			eastl::erase_if(out, [&](const auto& entry) { return IsChangedPath(changed, entry.first); });
+		}
+		else
+		{
+			out.clear();
+		}
+
+		for (size_t i = 0, count = git_status_list_entrycount(statusList); i < count; ++i)
+		{
+			const git_status_entry* entry = git_status_byindex(statusList, i);
+			const git_diff_delta* delta = entry->index_to_workdir ? entry->index_to_workdir : entry->head_to_index;
+			if (delta)
+				out[delta->new_file.path] = entry->status;
+		}
+
+		git_status_list_free(statusList);
+		return true;
+	}
+
+	// Adds the paths whose work tree status a changed index or HEAD may have moved, those are staged now or were listed before.
+	// HEAD against the index only reads trees.
+	static bool AddIndexPaths(git_repository* repo, const eastl::hash_map<eastl::string, uint32_t>& status, eastl::vector<eastl::string>& paths)
+	{
+		git_index* index = nullptr;
+		git_object* headTree = nullptr;
+		git_diff* staged = nullptr;
+		int err = git_repository_index(&index, repo);
+		// Picks up what another process wrote to the index since it was last read
+		if (err == 0)
+			err = git_index_read(index, false);
+		// Without a first commit everything in the index is staged
+		if (err == 0 && git_repository_head_unborn(repo) != 1)
+			err = git_revparse_single(&headTree, repo, "HEAD^{tree}");
+		git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+		diffOp.flags = GIT_DIFF_INCLUDE_TYPECHANGE;
+		if (err == 0)
+			err = git_diff_tree_to_index(&staged, repo, reinterpret_cast<git_tree*>(headTree), index, &diffOp);
+
+		for (size_t i = 0, count = err == 0 ? git_diff_num_deltas(staged) : 0; i < count; ++i)
+		{
+			const char* path = git_diff_get_delta(staged, i)->new_file.path;
+			if (status.find_as(path) == status.end())
+				paths.push_back(path);
+		}
+
+		for (const auto& [path, _] : status)
+			paths.push_back(path);
+
+		git_diff_free(staged);
+		git_object_free(headTree);
+		git_index_free(index);
+		return err == 0;
+	}
+
+	// Only lost events scan the whole tree, otherwise just the changed paths and the ones a changed index may have moved are read
+	static void ReadChanges(git_repository* repo, const WorkTreeChanges& changes, eastl::hash_map<eastl::string, uint32_t>& status)
+	{
+		if (!changes.Rescan && !changes.IndexChanged)
+		{
+			ReadStatus(repo, &changes.Paths, status);
+			return;
+		}
+
+		if (!changes.Rescan)
+		{
+			eastl::vector<eastl::string> paths(changes.Paths);
+			if (AddIndexPaths(repo, status, paths) && paths.size() <= FILE_WATCHER_MAX_PATHS)
+			{
+				ReadStatus(repo, &paths, status);
+				return;
+			}
+		}
+
+		// Conflicts and submodules the scanner leaves out are looked at by libgit2
+		eastl::vector<eastl::string> deferred;
+		if (!StatusScanner::Scan(repo, status, deferred))
+			ReadStatus(repo, nullptr, status);
+		else if (!deferred.empty())
+			ReadStatus(repo, &deferred, status);
+	}
+
+	static void UpdateStatus(StatusLoader* loader)
+	{
+		eastl::hash_map<eastl::string, uint32_t> status;
+		WorkTreeChanges changes;
+		std::unique_lock lock(loader->Mutex);
+		while (true)
+		{
+			loader->Wake.wait(lock, [loader]() { return loader->Stop || !loader->Pending.Empty(); });
+			if (loader->Stop)
+				return;
+
+			changes.Clear();
+			eastl::swap(changes, loader->Pending);
+			lock.unlock();
+
+			ReadChanges(loader->Repository, changes, status);
+			eastl::hash_map<eastl::string, uint32_t> published(status);
+
+			lock.lock();
+			eastl::swap(loader->Published, published);
+			loader->Ready = true;
+		}
+	}
+
+	// Hands changes to the repository's status worker, the first request starts it
+	static void RequestStatus(RepoData& data, const WorkTreeChanges& changes)
+	{
+		StatusLoader& loader = data.StatusWorker;
+		if (!loader.Repository && git_repository_open(&loader.Repository, git_repository_path(data.Repository)) != 0)
+		{
+			ReadStatus(data.Repository, nullptr, data.Status);
+			data.UncommittedFiles = data.Status.size();
+			return;
+		}
+
+		{
+			std::scoped_lock lock(loader.Mutex);
+			loader.Pending.Merge(changes);
+			if (!loader.Thread.joinable())
+				loader.Thread = std::thread(UpdateStatus, &loader);
+		}
+
+		loader.Wake.notify_one();
+	}
+
+	static void RequestRescan(RepoData& data)
+	{
+		WorkTreeChanges changes;
+		changes.Rescan = true;
+		RequestStatus(data, changes);
+	}
+
+	static void PublishStatus(RepoData& data)
+	{
+		StatusLoader& loader = data.StatusWorker;
+		std::scoped_lock lock(loader.Mutex);
+		if (!loader.Ready)
+			return;
+
+		eastl::swap(data.Status, loader.Published);
+		data.UncommittedFiles = data.Status.size();
+		loader.Ready = false;
+	}
+
+	static void FillBranches(RepoData* data, eastl::hash_map<eastl::string, git_oid>& outTips)
+	{
+		for (auto& [branchRef, _] : data->Branches)
+			git_reference_free(branchRef);
+
+		data->Branches.clear();
+		data->BranchHeads.Clear();
+
+		git_reference_iterator* refIt = nullptr;
+		git_reference* ref = nullptr;
+		git_reference_iterator_new(&refIt, data->Repository);
+		while (git_reference_next(&ref, refIt) == 0)
+		{
+			git_reference_t refType = git_reference_type(ref);
+
+			if (refType == GIT_REF_OID)
+			{
+				const char* refName = git_reference_name(ref);
+				if (data->Branches.find(ref) == data->Branches.end())
+				{
+					BranchData branchData;
+					branchData.Name = refName;
+					branchData.Type = git_reference_is_remote(ref) == 1 ? BranchType::Remote : BranchType::Local;
+					branchData.Color = Utils::GenerateColor(refName);
+					data->Branches[ref] = eastl::move(branchData);
+					data->BranchHeads[*git_reference_target(ref)].push_back(ref);
+				}
+
+				if (git_reference_is_branch(ref) == 1 || git_reference_is_remote(ref) == 1)
+					outTips[refName] = *git_reference_target(ref);
+			}
+			else
+			{
+				git_reference_free(ref);
+			}
+		}
+		git_reference_iterator_free(refIt);
+
+		Client::UpdateHead(*data);
+	}
+
+	// Walks only the commits reachable from tips that moved since RefTips was recorded
+	static void LoadChangedTips(RepoData* data, eastl::hash_map<eastl::string, git_oid>&& tips)
+	{
+		bool changed = tips.size() != data->RefTips.size();
+		eastl::vector<git_oid> newTips;
+		for (const auto& [name, oid] : tips)
+		{
+			auto it = data->RefTips.find(name);
+			if (it == data->RefTips.end() || !git_oid_equal(&it->second, &oid))
+			{
+				changed = true;
+				if (data->Commits.Find(oid) < 0)
+					newTips.push_back(oid);
+			}
+		}
+
+		// A tip that went away or was rewound can leave loaded commits unreachable,
+		// only a full walk can drop those
+		eastl::vector<git_oid> allTips;
+		allTips.reserve(tips.size());
+		for (const auto& [_, oid] : tips)
+			allTips.push_back(oid);
+
+		bool rewound = false;
+		for (const auto& [name, oid] : data->RefTips)
+		{
+			auto it = tips.find(name);
+			if (it != tips.end() && git_oid_equal(&it->second, &oid))
+				continue;
+
+			if (it != tips.end() && git_graph_descendant_of(data->Repository, &it->second, &oid) == 1)
+				continue;
+
+			if (git_graph_reachable_from_any(data->Repository, &oid, allTips.data(), allTips.size()) != 1)
+			{
+				rewound = true;
+				break;
+			}
+		}
+
+		if (rewound)
+		{
+			Client::Fill(data, data->Repository);
+			return;
+		}
+
+		eastl::vector<git_oid> hide;
+		hide.reserve(data->RefTips.size());
+		for (const auto& [_, oid] : data->RefTips)
+			hide.push_back(oid);
+
+		data->RefTips = eastl::move(tips);
+
+		if (!newTips.empty())
+			StartLoading(*data, eastl::move(newTips), eastl::move(hide));
+
+		if (changed)
+			data->CacheDirty = true;
+	}
+
+	void Client::Fill(RepoData* data, git_repository* repo, bool useCache)
+	{
+		if (!data || !repo)
+			return;
+
+		StopLoading(*data);
+
+		data->Commits.Clear();
+		data->CommitHandles.Clear();
+		data->PrefetchBegin = 0;
+		data->PrefetchEnd = 0;
+
+		data->Repository = repo;
+
+		// Trim the last slash
+		eastl::string filepath = git_repository_workdir(repo);
+		size_t len = filepath.length();
+		if (filepath[len - 1] == '/')
+			filepath[len - 1] = '\0';
+
+		data->Filepath = filepath;
+
+		const char* lastSlash = strrchr(filepath.c_str(), '/');
+		data->Name = lastSlash ? lastSlash + 1 : filepath;
+
+		RequestRescan(*data);
+		// Keeps the status and the Local Changes diff current from here on, only the paths that changed are looked at again
+		if (!data->Watcher.IsRunning() && !data->Watcher.Start(git_repository_workdir(repo), git_repository_path(repo)))
+			data->WatchFailed = true;
+
+		eastl::hash_map<eastl::string, git_oid> tips;
+		FillBranches(data, tips);
+
+		// The list saved by an earlier session stands in for the full walk,
+		// only what changed since then is walked
+		if (useCache && CommitCache::Load(repo, data->Commits, data->RefTips))
+		{
+			LoadChangedTips(data, eastl::move(tips));
+			return;
+		}
+
+		data->RefTips = eastl::move(tips);
+		StartLoading(*data, {}, {});
+		data->CacheDirty = true;
+	}
+
+	void Client::Refresh(RepoData* data)
+	{
+		if (!data || !data->Repository)
+			return;
+
+		// Anything still streaming in would be lost by walking against the recorded tips
+		if (data->Loader.Running.load(std::memory_order_acquire) || data->Commits.Empty())
+		{
+			Fill(data, data->Repository);
+			return;
+		}
+
+		PublishLoaded(*data);
+		StopLoading(*data);
+
+		eastl::hash_map<eastl::string, git_oid> tips;
+		FillBranches(data, tips);
+		RequestRescan(*data);
+
+		LoadChangedTips(data, eastl::move(tips));
+	}
+
+	git_commit* Client::LookupCommit(RepoData* repoData, size_t row)
+	{
+		if (row >= repoData->Commits.Size())
+			return nullptr;
+
+		return repoData->CommitHandles.Get(repoData->Repository, repoData->Commits.Oid(row));
+	}
+
+	void Client::PrefetchCommits(RepoData* repoData, size_t begin, size_t end)
+	{
+		// Only rows that came into view since the last call are looked up,
+		// capped to half the cache so the selected commit is never pushed out
+		end = eastl::min(end, eastl::min(repoData->Commits.Size(), begin + COMMIT_HANDLE_CACHE_SIZE / 2));
+		for (size_t row = begin; row < end; ++row)
+		{
+			if (row < repoData->PrefetchBegin || row >= repoData->PrefetchEnd)
+				repoData->CommitHandles.Get(repoData->Repository, repoData->Commits.Oid(row));
+		}
+
+		repoData->PrefetchBegin = begin;
+		repoData->PrefetchEnd = end;
+	}
+
+	// Runs on the UI thread once the worker is done, the worker's handle already shows the change on disk
+	static void ApplyOperation(RepoData& repoData, const OperationResult& result)
+	{
+		if (!result.Success)
+			return;
+
+		switch (result.Op.Type)
+		{
+			case OperationType::BranchCheckout:
+			case OperationType::CommitCheckout:
+			{
+				Client::UpdateHead(repoData);
+				break;
+			}
+			case OperationType::Reset:
+			{
+				// The branch reference moved, its handle is replaced by one pointing at the new commit
+				git_reference* newHead = nullptr;
+				git_reference* oldHead = repoData.HeadBranch;
+				if (!oldHead || git_repository_head(&newHead, repoData.Repository) != 0)
+				{
+					Client::UpdateHead(repoData);
+					break;
+				}
+
+				repoData.Branches[newHead] = repoData.Branches.at(oldHead);
+				repoData.Branches.erase(oldHead);
+				if (eastl::vector<git_reference*>* branchHeads = repoData.BranchHeads.Find(repoData.Head))
+				{
+					branchHeads->erase(eastl::remove(branchHeads->begin(), branchHeads->end(), oldHead), branchHeads->end());
+					if (branchHeads->empty())
+						repoData.BranchHeads.Erase(repoData.Head);
+				}
+				git_reference_free(oldHead);
+
+				repoData.HeadBranch = newHead;
+				repoData.Head = *git_reference_target(newHead);
+				repoData.BranchHeads[repoData.Head].push_back(newHead);
+				break;
+			}
+			case OperationType::Commit:
+			{
+				git_commit* commit = nullptr;
+				if (git_commit_lookup(&commit, repoData.Repository, &result.Op.Target) != 0)
+					break;
+
+				CommitBatch batch;
+				batch.Add(commit);
+				repoData.Commits.Prepend(batch);
+				git_commit_free(commit);
+
+				Client::UpdateHead(repoData);
+				if (repoData.HeadBranch)
+					repoData.RefTips[git_reference_name(repoData.HeadBranch)] = result.Op.Target;
+				repoData.CacheDirty = true;
+				break;
+			}
+		}
+	}
+
+	static bool IsOperationPending(OperationQueue& queue)
+	{
+		std::scoped_lock lock(queue.Mutex);
+		return queue.Running || !queue.Pending.empty();
+	}
+
+	static void ApplyOperations(RepoData& repoData)
+	{
+		OperationQueue& queue = repoData.Operations;
+		eastl::vector<OperationResult> finished;
+		{
+			std::scoped_lock lock(queue.Mutex);
+			eastl::swap(finished, queue.Finished);
+		}
+
+		for (OperationResult& result : finished)
+		{
+			ApplyOperation(repoData, result);
+			queue.Results.push_back(eastl::move(result));
+		}
+	}
+
+	// Only the snapshot is taken on the UI thread, the file is written on the writer's thread
+	static void SaveCommitCache(RepoData& repoData)
+	{
+		CommitCacheWriter& writer = repoData.CacheWriter;
+		if (writer.Thread.joinable())
+			writer.Thread.join();
+
+		CommitCacheSnapshot snapshot;
+		if (!CommitCache::Snapshot(repoData.Repository, repoData.Commits, repoData.RefTips, snapshot))
+			return;
+
+		writer.Running.store(true, std::memory_order_relaxed);
+		writer.Thread = std::thread([&writer, snapshot = eastl::move(snapshot)]()
+		{
+			CommitCache::Write(snapshot);
+			writer.Running.store(false, std::memory_order_release);
+		});
+	}
+
+	void Client::Update()
+	{
+		for (auto& repoData : s_Repositories)
+		{
+			if (repoData->Watcher.Failed())
+			{
+				repoData->Watcher.Stop();
+				repoData->WatchFailed = true;
+			}
+
+			// The work tree is in flux while an operation runs, the watcher holds on to its changes until the queue is empty
+			WorkTreeChanges changes;
+			if (!IsOperationPending(repoData->Operations) && repoData->Watcher.Poll(changes))
+			{
+				RequestStatus(*repoData, changes);
+
+				// Held for the Local Changes panel, which may be showing another repository
+				repoData->PendingChanges.Merge(changes);
+			}
+
+			PublishStatus(*repoData);
+			ApplyOperations(*repoData);
+
+			// Checked before publishing so nothing the loader produces is missed by the save
+			const bool loaded = !repoData->Loader.Running.load(std::memory_order_acquire);
+			PublishLoaded(*repoData);
+
+			if (loaded && repoData->CacheDirty && !repoData->CacheWriter.Running.load(std::memory_order_acquire))
+			{
+				SaveCommitCache(*repoData);
+				repoData->CacheDirty = false;
+			}
+		}
+	}
+
+	git_reference* Client::BranchCreate(RepoData* repo, const char* branchName, git_commit* commit, bool& outValidName)
+	{
+		int valid = 0;
+		int err = git_branch_name_is_valid(&valid, branchName);
+		outValidName = valid;
+
+		if (err == 0 && outValidName)
+		{
+			git_reference* outBranch = nullptr;
+			err = git_branch_create(&outBranch, repo->Repository, branchName, commit, 0);
+
+			if (outBranch)
+			{
+				BranchData branchData;
+				branchData.Type = BranchType::Local;
+				branchData.Name = LOCAL_BRANCH_PREFIX + eastl::string(branchName);
+				branchData.Color = Utils::GenerateColor(branchData.Name.c_str());
+				repo->Branches[outBranch] = eastl::move(branchData);
+				repo->BranchHeads[*git_commit_id(commit)].push_back(outBranch);
+			}
+
+			return outBranch;
+		}
+
+		return nullptr;
+	}
+
+	bool Client::BranchRename(RepoData* repo, git_reference* branch, const char* name, bool& outValidName)
+	{
+		int valid = 0;
+		int err = git_branch_name_is_valid(&valid, name);
+
+		outValidName = valid;
+		git_reference* newRef = nullptr;
+		eastl::string newName = eastl::string(LOCAL_BRANCH_PREFIX) + name;
+		const git_oid oldId = *git_reference_target(branch);
+		if (err == 0 && outValidName)
+		{
+			err = git_reference_rename(&newRef, branch, newName.c_str(), 0, nullptr);
+		}
+
+		if (err == 0 && outValidName && newRef)
+		{
+			if (repo->HeadBranch == branch)
+			{
+				repo->HeadBranch = newRef;
+			}
+
+			repo->Branches[newRef] = repo->Branches.at(branch);
+			BranchData& data = repo->Branches.at(newRef);
+			data.Name = newName;
+			data.Color = Utils::GenerateColor(data.Name.c_str());
+			repo->Branches.erase(branch);
+
+			auto& branchHeads = repo->BranchHeads[oldId];
+			for (auto it = branchHeads.begin(); it != branchHeads.end(); ++it)
+			{
+				if (*it == branch)
+				{
+					branchHeads.erase(it);
+					break;
+				}
+			}
+			branchHeads.push_back(newRef);
+
+			git_reference_free(branch);
+		}
+
+		return err == 0 && outValidName;
+	}
+
+	bool Client::BranchDelete(RepoData* repo, git_reference* branch)
+	{
+		int err = git_reference_delete(branch);
+
+		if (err == 0)
+		{
+			const git_oid id = *git_reference_target(branch);
+			repo->Branches.erase(branch);
+
+			auto& branchHeads = repo->BranchHeads[id];
+			for (auto it = branchHeads.begin(); it != branchHeads.end(); ++it)
+			{
+				if (*it == branch)
+				{
+					branchHeads.erase(it);
+					break;
+				}
+			}
+			git_reference_free(branch);
+		}
+
+		return err == 0;
+	}
+
+	bool Client::GenerateDiffWithWorkDir(git_repository* repo, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines, DiffAlgorithm algorithm)
+	{
+		git_reference* head = nullptr;
+		int err = git_repository_head(&head, repo);
+
+		const git_oid* oid = git_reference_target(head);
+
+		git_commit* commit = nullptr;
+		if (err == 0)
+		{
+			err = git_commit_lookup(&commit, repo, oid);
+			err = GenerateDiffWithWorkDir(commit, outUnstaged, outStaged, contextLines, algorithm) ? 0 : -1;
+		}
+
+		git_commit_free(commit);
+		git_reference_free(head);
+
+		return err == 0;
+	}
+
+	bool Client::GenerateDiffWithWorkDir(git_commit* commit, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines, DiffAlgorithm algorithm)
+	{
+		git_repository* repo = git_commit_owner(commit);
+		git_diff* unstagedDiff = nullptr;
+		git_diff* stagedDiff = nullptr;
+		git_diff* unstagedFallback = nullptr;
+		git_diff* stagedFallback = nullptr;
+		git_tree* commitTree = nullptr;
+
+		int err = git_commit_tree(&commitTree, commit);
+
+		git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+		if (err == 0)
+		{
+			diffOp.flags = GetDiffFlags(algorithm);
+			diffOp.context_lines = contextLines;
+			diffOp.max_size = DIFF_MAX_FILE_SIZE;
+
+			err = git_diff_index_to_workdir(&unstagedDiff, repo, nullptr, &diffOp);
+			
+			if (err == 0)
+				err = git_diff_tree_to_index(&stagedDiff, repo, commitTree, nullptr, &diffOp);
+		}
+
+		if (err == 0 && unstagedDiff && stagedDiff)
 		{
-			FillDiff(unstagedDiff, outUnstaged);
-			FillDiff(stagedDiff, outStaged);
+			diffOp.flags = GetDiffFlags(DiffAlgorithm::Myers);
+			FillDiff(repo, unstagedDiff, algorithm, outUnstaged, [&]()
+			{
+				if (!unstagedFallback)
+					git_diff_index_to_workdir(&unstagedFallback, repo, nullptr, &diffOp);
+				return unstagedFallback;
+			});
+			FillDiff(repo, stagedDiff, algorithm, outStaged, [&]()
+			{
+				if (!stagedFallback)
+					git_diff_tree_to_index(&stagedFallback, repo, commitTree, nullptr, &diffOp);
+				return stagedFallback;
+			});
 		}
 
 		git_tree_free(commitTree);
 		git_diff_free(unstagedDiff);
 		git_diff_free(stagedDiff);
+		git_diff_free(unstagedFallback);
+		git_diff_free(stagedFallback);
 		
 		return err == 0;
 	}
 
+	bool Client::TakeWorkTreeChanges(RepoData* repoData, WorkTreeChanges& out)
+	{
+		out.Clear();
+		eastl::swap(out.Paths, repoData->PendingChanges.Paths);
+		eastl::swap(out.IndexChanged, repoData->PendingChanges.IndexChanged);
+		eastl::swap(out.Rescan, repoData->PendingChanges.Rescan);
+		return !out.Empty();
+	}
+
+	bool Client::TakeWatchFailure(RepoData* repoData)
+	{
+		return eastl::exchange(repoData->WatchFailed, false);
+	}
+
+	// Orders paths the way libgit2 sorts deltas
+	static bool PathLess(const eastl::string& a, const eastl::string& b, bool ignoreCase)
+	{
+		if (!ignoreCase)
+			return a < b;
+
+		return eastl::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) { return tolower(static_cast<uint8_t>(x)) < tolower(static_cast<uint8_t>(y)); });
+	}
+
+	bool Client::UpdateWorkDirDiff(git_repository* repo, const eastl::vector<eastl::string>& paths, Diff& unstaged, uint32_t contextLines, DiffAlgorithm algorithm)
+	{
+		eastl::vector<char*> pathspec;
+		for (const eastl::string& path : paths)
+			pathspec.push_back(const_cast<char*>(path.c_str()));
+
+		git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+		diffOp.flags = GetDiffFlags(algorithm) | GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+		diffOp.context_lines = contextLines;
+		diffOp.max_size = DIFF_MAX_FILE_SIZE;
+		diffOp.pathspec = { pathspec.data(), pathspec.size() };
+
+		git_diff* diff = nullptr;
+		git_diff* fallback = nullptr;
+		Diff changed;
+		int err = git_diff_index_to_workdir(&diff, repo, nullptr, &diffOp);
+		if (err == 0)
+		{
+			diffOp.flags = GetDiffFlags(DiffAlgorithm::Myers) | GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+			if (!FillDiff(repo, diff, algorithm, changed, [&]()
+			{
+				if (!fallback)
+					git_diff_index_to_workdir(&fallback, repo, nullptr, &diffOp);
+				return fallback;
+			}))
+				err = -1;
+		}
+
+		if (err == 0)
+		{
+			// Patches of paths that didn't change are kept, the new ones go in their place in path order
+			struct Source
+			{
+				const Diff* From;
+				uint32_t Index;
+			};
+
+			const eastl::hash_set<eastl::string> changedPaths(paths.begin(), paths.end());
+			eastl::vector<Source> sources;
+			for (uint32_t i = 0, count = static_cast<uint32_t>(unstaged.Patches.size()); i < count; ++i)
+			{
+				if (!IsChangedPath(changedPaths, unstaged.Patches[i].File))
+					sources.push_back({ &unstaged, i });
+			}
+			for (uint32_t i = 0, count = static_cast<uint32_t>(changed.Patches.size()); i < count; ++i)
+				sources.push_back({ &changed, i });
+
+			const bool ignoreCase = git_diff_is_sorted_icase(diff) != 0;
+			eastl::stable_sort(sources.begin(), sources.end(), [ignoreCase](const Source& a, const Source& b)
+			{
+				return PathLess(a.From->Patches[a.Index].File, b.From->Patches[b.Index].File, ignoreCase);
+			});
+
+			Diff merged;
+			merged.Patches.reserve(sources.size());
+			for (const Source& source : sources)
+			{
+				merged.Patches.push_back(source.From->Patches[source.Index]);
+				PublishPatch(merged, static_cast<uint32_t>(merged.Patches.size()) - 1, *source.From, source.Index);
+			}
+
+			unstaged.Patches.swap(merged.Patches);
+			unstaged.Hunks.swap(merged.Hunks);
+			unstaged.Lines.swap(merged.Lines);
+			unstaged.Text.swap(merged.Text);
+			++unstaged.Revision;
+		}
+
+		git_diff_free(diff);
+		git_diff_free(fallback);
+		return err == 0;
+	}
+
 	bool Client::CreatePatch(git_commit* commit, eastl::string& out)
 	{
 		git_buf buf = GIT_BUF_INIT;
@@ -510,69 +2242,243 @@ namespace QuickGit
 		return err == 0;
 	}
 
-	// Uses commandline to do add/restore as git_apply() is not consistent
-	// issue: https://github.com/libgit2/libgit2/issues/6643
-	bool Client::AddToIndex(git_repository* repo, const char* filepath)
+	bool Client::WriteCommitGraph(RepoData* repo)
 	{
-		std::filesystem::path repoPath = git_repository_workdir(repo);
+		const eastl::string infoDir = eastl::string(git_repository_commondir(repo->Repository)) + "objects/info";
 
-		git_index* index = nullptr;
-		int err = git_repository_index(&index, repo);
+		git_commit_graph_writer* writer = nullptr;
+		int err = git_commit_graph_writer_new(&writer, infoDir.c_str());
+
+		git_revwalk* walker = nullptr;
+		if (err == 0)
+			err = git_revwalk_new(&walker, repo->Repository);
+		if (err == 0)
+			err = git_revwalk_push_glob(walker, "refs/heads");
+		if (err == 0)
+			err = git_revwalk_push_glob(walker, "refs/remotes");
+		if (err == 0)
+			err = git_commit_graph_writer_add_revwalk(writer, walker);
 
 		if (err == 0)
 		{
-			std::filesystem::path currentWorkDir = std::filesystem::current_path();
-			std::filesystem::current_path(repoPath);
+			git_commit_graph_writer_options options = GIT_COMMIT_GRAPH_WRITER_OPTIONS_INIT;
+			err = git_commit_graph_writer_commit(writer, &options);
+		}
+
+		git_revwalk_free(walker);
+		git_commit_graph_writer_free(writer);
+
+		return err == 0;
+	}
 
-			eastl::string command = "git add ";
-			command += "\"";
-			command += filepath;
-			command += "\"";
-			err = std::system(command.c_str());
+	bool Client::AddToIndex(git_repository* repo, const eastl::vector<eastl::string>& paths)
+	{
+		git_index* index = nullptr;
+		int err = git_repository_index(&index, repo);
+		// Picks up what another process wrote to the index since it was last read
+		if (err == 0)
+			err = git_index_read(index, false);
 
-			std::filesystem::current_path(currentWorkDir);
+		for (size_t i = 0; err == 0 && i < paths.size(); ++i)
+		{
+			err = git_index_add_bypath(index, paths[i].c_str());
+			// A file gone from the work tree is staged as deleted
+			if (err == GIT_ENOTFOUND)
+				err = git_index_remove_bypath(index, paths[i].c_str());
 		}
 
+		if (err == 0)
+			err = git_index_write(index);
+		else if (index)
+			git_index_read(index, true);
+
 		git_index_free(index);
 
 		return err == 0;
 	}
 
-	bool Client::RemoveFromIndex(git_repository* repo, const char* filepath)
+	bool Client::RemoveFromIndex(git_repository* repo, const eastl::vector<eastl::string>& paths)
 	{
-		std::filesystem::path repoPath = git_repository_workdir(repo);
-
 		git_index* index = nullptr;
+		git_object* headTree = nullptr;
 		int err = git_repository_index(&index, repo);
-
 		if (err == 0)
-		{
-			std::filesystem::path currentWorkDir = std::filesystem::current_path();
-			std::filesystem::current_path(repoPath);
+			err = git_index_read(index, false);
+		// Without a first commit every path leaves the index
+		if (err == 0 && git_repository_head_unborn(repo) != 1)
+			err = git_revparse_single(&headTree, repo, "HEAD^{tree}");
 
-			eastl::string command = "git restore --staged ";
-			command += "\"";
-			command += filepath;
-			command += "\"";
-			err = std::system(command.c_str());
+		for (size_t i = 0; err == 0 && i < paths.size(); ++i)
+		{
+			const char* path = paths[i].c_str();
+			git_tree_entry* treeEntry = nullptr;
+			err = headTree ? git_tree_entry_bypath(&treeEntry, reinterpret_cast<git_tree*>(headTree), path) : GIT_ENOTFOUND;
+			if (err == 0)
+			{
+				// No stat data, so the work tree file is compared by content until the index is refreshed
+				git_index_entry entry{};
+				entry.mode = git_tree_entry_filemode(treeEntry);
+				entry.id = *git_tree_entry_id(treeEntry);
+				entry.path = path;
+				err = git_index_conflict_remove(index, path);
+				if (err == GIT_ENOTFOUND)
+					err = 0;
+				if (err == 0)
+					err = git_index_add(index, &entry);
+			}
+			else if (err == GIT_ENOTFOUND)
+			{
+				err = git_index_remove_bypath(index, path);
+			}
 
-			std::filesystem::current_path(currentWorkDir);
+			git_tree_entry_free(treeEntry);
 		}
 
+		if (err == 0)
+			err = git_index_write(index);
+		else if (index)
+			git_index_read(index, true);
+
+		git_object_free(headTree);
 		git_index_free(index);
 
 		return err == 0;
 	}
 
-	bool Client::Commit(RepoData* repo, const char* summary, const char* description)
+	// Spreads the progress of one checkout batch over the paths of the whole checkout
+	struct CheckoutBatchProgress
+	{
+		git_checkout_progress_cb Callback = nullptr;
+		size_t Offset = 0;
+		size_t Size = 0;
+		size_t Total = 0;
+	};
+
+	static void ReportBatchProgress(const char* path, size_t completedSteps, size_t totalSteps, void* payload)
+	{
+		const CheckoutBatchProgress& progress = *static_cast<const CheckoutBatchProgress*>(payload);
+		const size_t completed = totalSteps ? completedSteps * progress.Size / totalSteps : progress.Size;
+		progress.Callback(path, progress.Offset + completed, progress.Total, nullptr);
+	}
+
+	// True when a path is also the directory of another one, checking those out apart could leave a file in the way of a directory
+	static bool HasDirectoryConflict(const eastl::vector<eastl::string>& paths)
+	{
+		const eastl::hash_set<eastl::string> pathSet(paths.begin(), paths.end());
+		for (const eastl::string& path : paths)
+		{
+			for (size_t slash = path.find('/'); slash != eastl::string::npos; slash = path.find('/', slash + 1))
+			{
+				if (pathSet.find(path.substr(0, slash)) != pathSet.end())
+					return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Checks out the paths that differ between HEAD and the commit a batch at a time, so a cancel is seen between batches.
+	// A safe checkout only writes files without local changes, so when it stops the files written so far are put back as
+	// they are in HEAD and nothing is lost. Forced checkouts, an unborn HEAD and files turning into directories go in one piece.
+	static int CheckoutCommit(git_repository* repo, git_commit* commit, const std::atomic<bool>& cancel)
+	{
+		git_object* headTree = nullptr;
+		git_tree* tree = nullptr;
+		git_diff* diff = nullptr;
+		int err = git_commit_tree(&tree, commit);
+		if (err == 0 && git_repository_head_unborn(repo) != 1)
+			err = git_revparse_single(&headTree, repo, "HEAD^{tree}");
+		if (err == 0 && headTree)
+			err = git_diff_tree_to_tree(&diff, repo, reinterpret_cast<git_tree*>(headTree), tree, nullptr);
+
+		eastl::vector<eastl::string> paths;
+		for (size_t i = 0, count = diff ? git_diff_num_deltas(diff) : 0; i < count; ++i)
+		{
+			const git_diff_delta* delta = git_diff_get_delta(diff, i);
+			paths.push_back(delta->old_file.path);
+			if (strcmp(delta->old_file.path, delta->new_file.path) != 0)
+				paths.push_back(delta->new_file.path);
+		}
+
+		if (err == 0 && (!headTree || HasDirectoryConflict(paths)))
+		{
+			err = cancel.load(std::memory_order_relaxed) ? GIT_EUSER : git_checkout_tree(repo, reinterpret_cast<git_object*>(commit), &s_SafeCheckoutOptions);
+			paths.clear();
+		}
+
+		CheckoutBatchProgress progress;
+		progress.Callback = s_SafeCheckoutOptions.progress_cb;
+		progress.Total = paths.size();
+		git_checkout_options options = s_SafeCheckoutOptions;
+		options.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+		options.progress_cb = progress.Callback ? ReportBatchProgress : nullptr;
+		options.progress_payload = &progress;
+
+		eastl::vector<char*> pathspec;
+		size_t done = 0;
+		while (err == 0 && done < paths.size())
+		{
+			if (cancel.load(std::memory_order_relaxed))
+			{
+				err = GIT_EUSER;
+				break;
+			}
+
+			const size_t end = eastl::min(done + OPERATION_CHECKOUT_BATCH, paths.size());
+			pathspec.clear();
+			for (size_t i = done; i < end; ++i)
+				pathspec.push_back(const_cast<char*>(paths[i].c_str()));
+			options.paths = { pathspec.data(), pathspec.size() };
+			progress.Offset = done;
+			progress.Size = end - done;
+
+			err = git_checkout_tree(repo, reinterpret_cast<git_object*>(commit), &options);
+			if (err == 0)
+				done = end;
+		}
+
+		if (err != 0 && done > 0)
+		{
+			pathspec.clear();
+			for (size_t i = 0; i < done; ++i)
+				pathspec.push_back(const_cast<char*>(paths[i].c_str()));
+
+			git_checkout_options rollback = s_ForceCheckoutOptions;
+			rollback.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+			rollback.progress_cb = nullptr;
+			rollback.paths = { pathspec.data(), pathspec.size() };
+			// Keeps the error of the checkout that stopped
+			const git_error* error = git_error_last();
+			const eastl::string message = error && err != GIT_EUSER ? error->message : "";
+			const int errorClass = error ? error->klass : GIT_ERROR_NONE;
+			git_checkout_tree(repo, headTree, &rollback);
+			if (!message.empty())
+				git_error_set_str(errorClass, message.c_str());
+		}
+
+		git_diff_free(diff);
+		git_tree_free(tree);
+		git_object_free(headTree);
+
+		return err;
+	}
+
+	static int CreateCommit(git_repository* repo, const Operation& operation, git_oid& outId)
 	{
 		git_reference* ref = nullptr;
 		git_object* parent = nullptr;
-		int err = git_revparse_ext(&parent, &ref, repo->Repository, "HEAD");
+		int err = git_revparse_ext(&parent, &ref, repo, "HEAD");
+		// Nothing to commit on top of yet
+		if (err == GIT_ENOTFOUND && git_repository_head_unborn(repo) == 1)
+			err = 0;
 
 		git_index* index = nullptr;
 		if (err == 0)
-			err = git_repository_index(&index, repo->Repository);
+			err = git_repository_index(&index, repo);
+
+		// Picks up what the UI thread staged since this handle last read the index
+		if (err == 0)
+			err = git_index_read(index, false);
 
 		git_oid treeId;
 		if (err == 0)
@@ -583,46 +2489,207 @@ namespace QuickGit
 
 		git_tree* tree = nullptr;
 		if (err == 0)
-			err = git_tree_lookup(&tree, repo->Repository, &treeId);
+			err = git_tree_lookup(&tree, repo, &treeId);
 
 		git_signature* signature = nullptr;
 		if (err == 0)
-			err = git_signature_default(&signature, repo->Repository);
+			err = git_signature_default(&signature, repo);
 
-		git_oid commitId;
 		if (err == 0)
 		{
-			eastl::string message = summary;
+			eastl::string message = operation.Summary;
 			message += "\n\n";
-			message += description;
-			err = git_commit_create_v(&commitId, repo->Repository,  "HEAD", signature, signature, nullptr, message.c_str(), tree, parent ? 1 : 0, parent);
+			message += operation.Description;
+			err = git_commit_create_v(&outId, repo, "HEAD", signature, signature, nullptr, message.c_str(), tree, parent ? 1 : 0, parent);
 		}
 
-		if (err == 0)
+		git_index_free(index);
+		git_signature_free(signature);
+		git_tree_free(tree);
+		git_object_free(parent);
+		git_reference_free(ref);
+
+		return err;
+	}
+
+	static int RunOperation(git_repository* repo, Operation& operation, const std::atomic<bool>& cancel)
+	{
+		git_object* target = nullptr;
+		int err = 0;
+		switch (operation.Type)
 		{
-			git_commit* commit = nullptr;
-			if (git_commit_lookup(&commit, repo->Repository, &commitId) == 0)
+			case OperationType::BranchCheckout:
+			{
+				git_reference* branch = nullptr;
+				err = git_reference_lookup(&branch, repo, operation.Branch.c_str());
+				if (err == 0)
+					err = git_reference_peel(&target, branch, GIT_OBJECT_COMMIT);
+				if (err == 0)
+					err = CheckoutCommit(repo, reinterpret_cast<git_commit*>(target), cancel);
+				if (err == 0)
+					err = git_repository_set_head(repo, operation.Branch.c_str());
+				git_reference_free(branch);
+				break;
+			}
+			case OperationType::CommitCheckout:
+			{
+				err = git_object_lookup(&target, repo, &operation.Target, GIT_OBJECT_COMMIT);
+				if (err == 0)
+					err = CheckoutCommit(repo, reinterpret_cast<git_commit*>(target), cancel);
+				if (err == 0)
+					err = git_repository_set_head_detached(repo, &operation.Target);
+				break;
+			}
+			case OperationType::Reset:
+			{
+				err = git_object_lookup(&target, repo, &operation.Target, GIT_OBJECT_COMMIT);
+				if (err == 0)
+					err = git_reset(repo, target, operation.ResetType, operation.ResetType == GIT_RESET_HARD ? &s_ForceCheckoutOptions : &s_SafeCheckoutOptions);
+				break;
+			}
+			case OperationType::Commit:
 			{
-				CommitData cd;
-				FillCommit(commit, &cd);
-				UUID cdId = cd.ID;
-				repo->Commits.emplace(repo->Commits.begin(), eastl::move(cd));
+				err = CreateCommit(repo, operation, operation.Target);
+				break;
+			}
+		}
 
-				for (auto& [id, idx] : repo->CommitsIndexMap)
-					++idx;
+		git_object_free(target);
 
-				repo->CommitsIndexMap[cdId] = 0;
+		return err;
+	}
 
-				UpdateHead(*repo);
+	static void RunOperations(OperationQueue* queue)
+	{
+		std::unique_lock lock(queue->Mutex);
+		while (true)
+		{
+			queue->Wake.wait(lock, [queue]() { return queue->Stop || !queue->Pending.empty(); });
+			if (queue->Stop)
+				return;
+
+			queue->Current = eastl::move(queue->Pending.front());
+			queue->Pending.pop_front();
+			queue->Running = true;
+			queue->Cancel.store(false, std::memory_order_relaxed);
+			OperationResult result;
+			result.Op = queue->Current;
+			lock.unlock();
+
+			const int err = RunOperation(queue->Repository, result.Op, queue->Cancel);
+			result.Success = err == 0;
+			result.Cancelled = err == GIT_EUSER;
+			if (err != 0 && !result.Cancelled)
+			{
+				const git_error* error = git_error_last();
+				result.Error = error ? error->message : "Unknown error";
 			}
+
+			lock.lock();
+			queue->Running = false;
+			queue->Finished.push_back(eastl::move(result));
 		}
+	}
 
-		git_index_free(index);
-		git_signature_free(signature);
-		git_tree_free(tree);
-		git_object_free(parent);
-		git_reference_free(ref);
+	void Client::QueueOperation(RepoData* repoData, Operation&& operation)
+	{
+		OperationQueue& queue = repoData->Operations;
+		if (!queue.Repository && git_repository_open(&queue.Repository, git_repository_path(repoData->Repository)) != 0)
+		{
+			OperationResult result;
+			result.Op = eastl::move(operation);
+			const git_error* error = git_error_last();
+			result.Error = error ? error->message : "Unknown error";
+			queue.Results.push_back(eastl::move(result));
+			return;
+		}
 
-		return err == 0;
+		{
+			std::scoped_lock lock(queue.Mutex);
+			// Only the last of several checkouts in a row decides what the work tree ends up as
+			const auto superseded = [&](const Operation& pending) { return pending == operation || (operation.IsCheckout() && pending.IsCheckout()); };
+			while (!queue.Pending.empty() && superseded(queue.Pending.back()))
+			{
+				OperationResult result;
+				result.Op = eastl::move(queue.Pending.back());
+				result.Cancelled = true;
+				queue.Finished.push_back(eastl::move(result));
+				queue.Pending.pop_back();
+			}
+
+			queue.Pending.push_back(eastl::move(operation));
+			if (!queue.Thread.joinable())
+				queue.Thread = std::thread(RunOperations, &queue);
+		}
+
+		queue.Wake.notify_one();
+	}
+
+	void Client::CancelCheckouts(RepoData* repoData)
+	{
+		OperationQueue& queue = repoData->Operations;
+		std::scoped_lock lock(queue.Mutex);
+		for (auto it = queue.Pending.begin(); it != queue.Pending.end();)
+		{
+			if (!it->IsCheckout())
+			{
+				++it;
+				continue;
+			}
+
+			OperationResult result;
+			result.Op = eastl::move(*it);
+			result.Cancelled = true;
+			queue.Finished.push_back(eastl::move(result));
+			it = queue.Pending.erase(it);
+		}
+
+		if (queue.Running && queue.Current.IsCheckout())
+			queue.Cancel.store(true, std::memory_order_relaxed);
+	}
+
+	bool Client::GetRunningOperation(RepoData* repoData, Operation& out, size_t& outQueued)
+	{
+		OperationQueue& queue = repoData->Operations;
+		std::scoped_lock lock(queue.Mutex);
+		outQueued = queue.Pending.size();
+		if (!queue.Running)
+			return false;
+
+		out = queue.Current;
+		return true;
+	}
+
+	bool Client::TakeOperationResults(RepoData* repoData, eastl::vector<OperationResult>& out)
+	{
+		OperationQueue& queue = repoData->Operations;
+		if (queue.Results.empty())
+			return false;
+
+		eastl::swap(out, queue.Results);
+		queue.Results.clear();
+		return true;
+	}
+
+	void Client::StopOperations(RepoData& repoData)
+	{
+		OperationQueue& queue = repoData.Operations;
+		{
+			std::scoped_lock lock(queue.Mutex);
+			queue.Stop = true;
+			queue.Pending.clear();
+			// A running checkout is stopped and undone, a running reset or commit is finished
+			queue.Cancel.store(true, std::memory_order_relaxed);
+		}
+
+		queue.Wake.notify_one();
+		if (queue.Thread.joinable())
+			queue.Thread.join();
+
+		queue.Finished.clear();
+		queue.Results.clear();
+		queue.Running = false;
+		queue.Stop = false;
+		queue.Cancel.store(false, std::memory_order_relaxed);
 	}
 }
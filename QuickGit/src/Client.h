@@ -3,30 +3,43 @@
 #include <git2.h>
 
 #include "Utils.h"
+#include "CommitStore.h"
+#include "LaneLayout.h"
+#include "Diff.h"
+#include "DiffCache.h"
+#include "FileWatcher.h"
 
 #define COMMIT_SHORT_ID_LEN 7
 #define COMMIT_ID_LEN 41
-#define COMMIT_MSG_LEN 128
-#define COMMIT_NAME_LEN 40
-#define COMMIT_DATE_LEN 24
+
+#define COMMIT_LOAD_FIRST_BATCH 128
+#define COMMIT_LOAD_MAX_BATCH 8192
+
+#define DIFF_CONTEXT_LINES 3
+// Text filled in per file before the rest waits for "load more", and per diff when all of a diff is filled in
+#define DIFF_FILE_LIMIT (1ull * 1024 * 1024)
+#define DIFF_TOTAL_LIMIT (64ull * 1024 * 1024)
+// Files above this size are shown as binary, libgit2 doesn't read them at all
+#define DIFF_MAX_FILE_SIZE (64ll * 1024 * 1024)
+// Auto diffs files up to this size minimally, bigger ones with Myers, as it does every file once a diff took longer than the budget.
+// The budget is checked before each file, libgit2 can't stop a file's diff part way, so a file started in time finishes minimally
+// and the size limit is what bounds how far past the budget that runs.
+#define DIFF_AUTO_MINIMAL_SIZE (256ull * 1024)
+#define DIFF_AUTO_TIME_BUDGET_MS 250
+// Patches a pool thread fills per task when a whole diff is filled in, and tasks per pool thread between publishes
+#define DIFF_PATCH_CHUNK 16
+#define DIFF_CHUNKS_PER_ROUND 4
+// Commits whose cache key the diff worker remembers, past this the keys are dropped and looked up again
+#define DIFF_LOADER_MAX_KEYS 4096
+
+// Paths a checkout writes between looks at its cancel flag
+#define OPERATION_CHECKOUT_BATCH 512
 
 #define LOCAL_BRANCH_PREFIX "refs/heads/"
 #define REMOTE_BRANCH_PREFIX "refs/remotes/"
 
 namespace QuickGit
 {
-	struct CommitData
-	{
-		char Message[COMMIT_MSG_LEN];
-		char AuthorName[COMMIT_NAME_LEN];
-		char AuthorDate[COMMIT_DATE_LEN];
-		char CommitID[COMMIT_ID_LEN];
-
-		size_t MessageSize = 0;
-		git_commit* Commit = nullptr;
-		UUID ID = 0;
-	};
-
 	enum class BranchType { Remote, Local };
 
 	struct BranchData
@@ -42,46 +55,216 @@ namespace QuickGit
 		}
 	};
 
-	struct RepoData
+	struct CommitLoader
 	{
+		std::thread Thread;
+		std::mutex Mutex;
+		CommitBatch Pending;
+		CommitBatch PendingFront;
+
+		// Tips to walk from and tips to stop at, an empty push list walks all branches
+		eastl::vector<git_oid> Push;
+		eastl::vector<git_oid> Hide;
+
+		// Separate handle so the walk never touches the repository used by the UI thread
 		git_repository* Repository = nullptr;
-		UUID SelectedCommit = 0;
 
-		eastl::string Name{};
-		eastl::string Filepath{};
-		size_t UncommittedFiles = 0;
+		std::atomic<bool> Cancel = false;
+		std::atomic<bool> Running = false;
+		std::atomic<uint64_t> Walked = 0;
+	};
 
-		UUID Head = 0;
-		git_reference* HeadBranch = nullptr;
-		eastl::hash_map<git_reference*, BranchData> Branches;
-		eastl::vector<CommitData> Commits;
-		eastl::hash_map<UUID, eastl::vector<git_reference*>> BranchHeads;
-		eastl::hash_map<UUID, uint64_t> CommitsIndexMap;
+	// Writes a snapshot of the commit list to the commit cache, the next save waits until the last write is done
+	struct CommitCacheWriter
+	{
+		std::thread Thread;
+		std::atomic<bool> Running = false;
+	};
 
-		~RepoData()
+	// Keeps a repository's status current on a thread of its own, the UI thread only swaps in what it published.
+	// Changes that come in while a pass runs are merged and looked at by the next one.
+	struct StatusLoader
+	{
+		std::thread Thread;
+		std::mutex Mutex;
+		std::condition_variable Wake;
+
+		WorkTreeChanges Pending;
+		// Copy of the worker's status after its last pass
+		eastl::hash_map<eastl::string, uint32_t> Published;
+		bool Ready = false;
+
+		// Separate handle so reading the status never touches the repository used by the UI thread
+		git_repository* Repository = nullptr;
+
+		bool Stop = false;
+	};
+
+	// Repository handle and tree diff of one pool thread filling patches in parallel, patches land in Filled until they are published
+	struct DiffSlot
+	{
+		git_repository* Repository = nullptr;
+		git_diff* Source = nullptr;
+		DiffKey SourceKey;
+		git_diff* Fallback = nullptr;
+		DiffKey FallbackKey;
+		Diff Filled;
+	};
+
+	// Worker generating commit diffs for the Commit panel into the shared DiffCache.
+	// The queue holds the selected commit followed by its neighbours and is replaced by each request.
+	// A queued commit only gets its file list, the text of a file is generated when the panel opens it and the diffstat
+	// of the shown diff is counted while nothing else is queued.
+	struct DiffLoader
+	{
+		std::thread Thread;
+		std::mutex Mutex;
+		std::condition_variable Wake;
+
+		eastl::vector<git_oid> Queue;
+		git_oid Running{};
+		git_oid Selected{};
+		// Cache keys of the commits the worker has looked at, so finding a commit's diff again needs no object lookup
+		OidMap<DiffKey> Keys;
+
+		// Diff of the selected commit, patches opened in the panel are loaded first, then the rest are counted in order
+		// or loaded in full while the diff is searched
+		eastl::shared_ptr<Diff> Current;
+		DiffKey CurrentKey;
+		struct PatchRequest
 		{
-			for (auto& commitData : Commits)
-				git_commit_free(commitData.Commit);
+			uint32_t Index;
+			bool More;
+
+			bool operator==(const PatchRequest& other) const { return Index == other.Index && More == other.More; }
+		};
+
+		eastl::vector<PatchRequest> OpenedPatches;
+		uint32_t NextPatch = 0;
+		bool LoadAll = false;
+		// Set when another commit is selected, patch work already running stops between hunks and publishes nothing
+		std::atomic<bool> Cancel = false;
+		// Auto diffs the rest of the shown diff with Myers once this passed, set when the diff is shown and when all of it is filled in
+		std::chrono::steady_clock::time_point Deadline;
 
-			for (auto& [branchRef, _] : Branches)
-				git_reference_free(branchRef);
+		// Algorithm of the diffs requested from now on
+		DiffAlgorithm Algorithm = DiffAlgorithm::Auto;
 
-			git_repository_free(Repository);
+		// Tree diff the patches are generated from, kept for the last key the worker used, and its Myers twin Auto falls back to
+		git_diff* Source = nullptr;
+		DiffKey SourceKey;
+		git_diff* Fallback = nullptr;
+		DiffKey FallbackKey;
+		// One per ThreadPool thread, libgit2 objects are never shared between threads
+		eastl::unique_ptr<DiffSlot[]> Slots;
+
+		// Separate handle so diffs never touch the repository used by the UI thread
+		git_repository* Repository = nullptr;
+
+		bool Stop = false;
+	};
+
+	enum class OperationType : uint8_t { BranchCheckout, CommitCheckout, Reset, Commit };
+
+	// Mutating git operation run on a repository's operation worker
+	struct Operation
+	{
+		OperationType Type = OperationType::BranchCheckout;
+		// Full name of the branch checked out
+		eastl::string Branch;
+		// Commit checked out or reset to, and the commit made once a Commit is done
+		git_oid Target{};
+		git_reset_t ResetType = GIT_RESET_SOFT;
+		eastl::string Summary;
+		eastl::string Description;
+
+		bool IsCheckout() const { return Type == OperationType::BranchCheckout || Type == OperationType::CommitCheckout; }
+
+		bool operator==(const Operation& other) const
+		{
+			return Type == other.Type && Branch == other.Branch && git_oid_equal(&Target, &other.Target) && ResetType == other.ResetType && Summary == other.Summary && Description == other.Description;
 		}
 	};
 
-	struct Patch
+	struct OperationResult
+	{
+		Operation Op;
+		bool Success = false;
+		// Cancelled, or replaced by a later request before it ran
+		bool Cancelled = false;
+		eastl::string Error;
+	};
+
+	// Worker running a repository's checkouts, resets and commits one at a time in the order they were queued.
+	// A checkout queued behind another checkout replaces it and a request equal to the last one queued is dropped.
+	struct OperationQueue
 	{
-		git_delta_t Status;
-		uint64_t OldFileSize;
-		uint64_t NewFileSize;
-		eastl::string File;
-		eastl::string Patch;
+		std::thread Thread;
+		std::mutex Mutex;
+		std::condition_variable Wake;
+
+		eastl::deque<Operation> Pending;
+		Operation Current;
+		bool Running = false;
+		// Done by the worker, the repository data is brought up to date with them before they move to Results for the UI
+		eastl::vector<OperationResult> Finished;
+		eastl::vector<OperationResult> Results;
+		// Stops the running checkout, what it already wrote is put back
+		std::atomic<bool> Cancel = false;
+
+		// Separate handle so operations never touch the repository used by the UI thread
+		git_repository* Repository = nullptr;
+
+		bool Stop = false;
 	};
 
-	struct Diff
+	struct RepoData
 	{
-		eastl::vector<Patch> Patches;
+		git_repository* Repository = nullptr;
+		git_oid SelectedCommit{};
+
+		eastl::string Name{};
+		eastl::string Filepath{};
+		size_t UncommittedFiles = 0;
+		// git_status_t of each path that differs from HEAD or the index, only changed paths are looked at again
+		eastl::hash_map<eastl::string, uint32_t> Status;
+		StatusLoader StatusWorker;
+		FileWatcher Watcher;
+		// Set when the work tree couldn't be watched, changes only show up on a refresh then
+		bool WatchFailed = false;
+		// Work tree changes the Local Changes panel hasn't taken yet
+		WorkTreeChanges PendingChanges;
+
+		git_oid Head{};
+		git_reference* HeadBranch = nullptr;
+		eastl::hash_map<git_reference*, BranchData> Branches;
+		OidMap<eastl::vector<git_reference*>> BranchHeads;
+		CommitStore Commits;
+		CommitHandleCache CommitHandles;
+		// Graph lanes of Commits, laid out as rows are appended
+		LaneLayout Lanes;
+
+		// Rows matching the commit filter, extended as rows are appended and rebuilt when rows move
+		eastl::vector<uint32_t> FilteredRows;
+		eastl::string FilteredText;
+		size_t FilteredSize = 0;
+		uint64_t FilteredRevision = 0;
+
+		// Rows read ahead into CommitHandles on the last PrefetchCommits call
+		size_t PrefetchBegin = 0;
+		size_t PrefetchEnd = 0;
+
+		// Branch tips the loaded history was walked from
+		eastl::hash_map<eastl::string, git_oid> RefTips;
+		// Set when the history differs from the saved commit cache, it is saved once loading is done
+		bool CacheDirty = false;
+
+		CommitLoader Loader;
+		CommitCacheWriter CacheWriter;
+		DiffLoader Diffs;
+		OperationQueue Operations;
+
+		~RepoData();
 	};
 
 	class Client
@@ -94,23 +277,58 @@ namespace QuickGit
 		static eastl::vector<eastl::unique_ptr<RepoData>>& GetRepositories();
 
 		static void UpdateHead(RepoData& repoData);
-		static void Fill(RepoData* data, git_repository* repo);
-		static void FillDiff(git_diff* diff, Diff& out);
-		static bool GenerateDiff(git_commit* commit, Diff& out, uint32_t contextLines = 3);
-		static bool GenerateDiff(git_commit* oldCommit, git_commit* newCommit, Diff& out, uint32_t contextLines = 3);
-		static bool GenerateDiffWithWorkDir(git_commit* commit, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines = 3);
-		static bool GenerateDiffWithWorkDir(git_repository* repo, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines = 3);
+		static void Fill(RepoData* data, git_repository* repo, bool useCache = false);
+		static void Refresh(RepoData* data);
+		static void Update();
+		static void StopLoading(RepoData& repoData);
+		static git_commit* LookupCommit(RepoData* repoData, size_t row);
+		static void PrefetchCommits(RepoData* repoData, size_t begin, size_t end);
+		// Returns the cached diff of the row's commit, otherwise queues it on the repository's worker and FindDiff returns it once generated.
+		// Neighbouring rows are queued behind it either way.
+		static eastl::shared_ptr<Diff> RequestDiff(RepoData* repoData, size_t row);
+		static eastl::shared_ptr<Diff> FindDiff(RepoData* repoData, const git_oid& commit);
+		// Queues the text of a patch of the selected commit's diff, Patch::Loaded is set once it is filled in
+		static void RequestPatch(RepoData* repoData, const eastl::shared_ptr<Diff>& diff, uint32_t patch);
+		// Fills in every patch of the selected commit's diff in the background, so the whole diff can be searched
+		static void RequestAllPatches(RepoData* repoData, const eastl::shared_ptr<Diff>& diff);
+		// Fills in another file limit's worth of a truncated patch
+		static void RequestMorePatch(RepoData* repoData, const eastl::shared_ptr<Diff>& diff, uint32_t patch);
+		static bool ExtendWorkDirPatch(git_repository* repo, bool staged, uint32_t contextLines, Diff& diff, uint32_t patch);
+		static void SetDiffLimits(uint64_t fileBytes, uint64_t diffBytes);
+		static uint64_t GetDiffFileLimit();
+		static uint64_t GetDiffTotalLimit();
+		// Diffs already cached for the old algorithm are left alone, the panel asks for its diff again
+		static void SetDiffAlgorithm(RepoData* repoData, DiffAlgorithm algorithm);
+		static DiffAlgorithm GetDiffAlgorithm(RepoData* repoData);
+		static void StopDiffs(RepoData& repoData);
+		static DiffCache& GetDiffCache();
+		static bool GenerateDiffWithWorkDir(git_commit* commit, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines = 3, DiffAlgorithm algorithm = DiffAlgorithm::Auto);
+		static bool GenerateDiffWithWorkDir(git_repository* repo, Diff& outUnstaged, Diff& outStaged, uint32_t contextLines = 3, DiffAlgorithm algorithm = DiffAlgorithm::Auto);
+		// Returns false when no work tree changes were seen since the last call
+		static bool TakeWorkTreeChanges(RepoData* repoData, WorkTreeChanges& out);
+		// Returns true once after the work tree's watcher couldn't be started or stopped on a failure, a refresh starts it again
+		static bool TakeWatchFailure(RepoData* repoData);
+		// Diffs the changed paths of the work tree again and replaces their patches, the rest of the diff is kept
+		static bool UpdateWorkDirDiff(git_repository* repo, const eastl::vector<eastl::string>& paths, Diff& unstaged, uint32_t contextLines = 3, DiffAlgorithm algorithm = DiffAlgorithm::Auto);
 
 		static git_reference* BranchCreate(RepoData* repo, const char* branchName, git_commit* commit, bool& outValidName);
 		static bool BranchRename(RepoData* repo, git_reference* branch, const char* name, bool& outValidName);
 		static bool BranchDelete(RepoData* repo, git_reference* branch);
-		static bool BranchCheckout(git_reference* branch, bool force = false);
-		static bool BranchReset(RepoData* repo, git_commit* commit, git_reset_t resetType);
-		static bool CommitCheckout(git_commit* commit, bool force = false);
 		static bool CreatePatch(git_commit* commit, eastl::string& out);
+		static bool WriteCommitGraph(RepoData* repo);
+
+		// Stage paths with a single index write, a path gone from the work tree is staged as deleted
+		static bool AddToIndex(git_repository* repo, const eastl::vector<eastl::string>& paths);
+		// Reset paths in the index to HEAD with a single index write, like git restore --staged
+		static bool RemoveFromIndex(git_repository* repo, const eastl::vector<eastl::string>& paths);
 
-		static bool AddToIndex(git_repository* repo, const char* filepath);
-		static bool RemoveFromIndex(git_repository* repo, const char* filepath);
-		static bool Commit(RepoData* repo, const char* summary, const char* description);
+		// Queues a checkout, reset or commit on the repository's operation worker, its result comes back through TakeOperationResults
+		static void QueueOperation(RepoData* repoData, Operation&& operation);
+		// Stops the running checkout and drops the queued ones, files the stopped checkout already wrote are put back
+		static void CancelCheckouts(RepoData* repoData);
+		// Returns false while nothing runs, outQueued counts the operations waiting behind it
+		static bool GetRunningOperation(RepoData* repoData, Operation& out, size_t& outQueued);
+		static bool TakeOperationResults(RepoData* repoData, eastl::vector<OperationResult>& out);
+		static void StopOperations(RepoData& repoData);
 	};
 }
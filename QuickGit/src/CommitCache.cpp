@@ -0,0 +1,249 @@
+#include "pch.h"
+#include "CommitCache.h"
+
+#include <fstream>
+
+#include "MappedFile.h"
+
+namespace QuickGit
+{
+	static_assert(sizeof(git_oid) == GIT_OID_SHA1_SIZE, "Commit cache stores raw SHA-1 object ids");
+
+	struct CommitCacheHeader
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint64_t RowCount;
+		uint64_t FrontCount;
+		uint64_t AuthorCount;
+		uint64_t SummaryBytes;
+		uint64_t ParentCount;
+		uint64_t AuthorBytes;
+		uint64_t TipCount;
+		uint64_t TipBytes;
+		uint64_t FrontIndexBytes;
+		uint64_t BackIndexBytes;
+	};
+
+	static constexpr char s_CacheMagic[4] = { 'Q', 'G', 'C', 'C' };
+	static constexpr size_t s_RowSize = sizeof(git_time_t) + sizeof(git_oid) + sizeof(uint32_t) * 3;
+
+	static std::filesystem::path GetCachePath(git_repository* repo)
+	{
+		return std::filesystem::path(git_repository_commondir(repo)) / "quickgit" / "commits.cache";
+	}
+
+	bool CommitCache::Load(git_repository* repo, CommitStore& outStore, eastl::hash_map<eastl::string, git_oid>& outTips)
+	{
+		MappedFile file;
+		if (!file.Open(GetCachePath(repo).string().c_str()) || file.Size() < sizeof(CommitCacheHeader))
+			return false;
+
+		CommitCacheHeader header;
+		memcpy(&header, file.Data(), sizeof(header));
+		if (memcmp(header.Magic, s_CacheMagic, sizeof(s_CacheMagic)) != 0 || header.Version != COMMIT_CACHE_VERSION || header.RowCount == 0)
+			return false;
+
+		const uint64_t fileSize = file.Size();
+		if (header.RowCount > fileSize / s_RowSize || header.FrontCount > header.RowCount || header.SummaryBytes > fileSize || header.AuthorBytes > fileSize ||
+			header.ParentCount > fileSize / sizeof(uint64_t) || header.TipBytes > fileSize || header.FrontIndexBytes > fileSize || header.BackIndexBytes > fileSize)
+			return false;
+
+		const uint64_t expectedSize = sizeof(header) + header.RowCount * s_RowSize + header.ParentCount * sizeof(uint64_t) + header.SummaryBytes + header.AuthorBytes + header.TipBytes +
+			header.FrontIndexBytes + header.BackIndexBytes;
+		if (expectedSize != fileSize)
+			return false;
+
+		const size_t rows = static_cast<size_t>(header.RowCount);
+		const size_t frontRows = static_cast<size_t>(header.FrontCount);
+		const uint8_t* times = file.Data() + sizeof(header);
+		const uint8_t* oids = times + rows * sizeof(git_time_t);
+		const uint8_t* authors = oids + rows * sizeof(git_oid);
+		const uint8_t* summaries = authors + rows * sizeof(uint32_t);
+		const uint8_t* parents = summaries + rows * sizeof(uint32_t);
+		const uint8_t* parentArena = parents + rows * sizeof(uint32_t);
+		const char* summaryArena = reinterpret_cast<const char*>(parentArena + header.ParentCount * sizeof(uint64_t));
+		const char* authorNames = summaryArena + header.SummaryBytes;
+		const char* tips = authorNames + header.AuthorBytes;
+		const char* end = tips + header.TipBytes;
+		const uint8_t* frontIndex = reinterpret_cast<const uint8_t*>(end);
+		const uint8_t* backIndex = frontIndex + header.FrontIndexBytes;
+
+		// Every string section has to end in a terminator so no read runs past the mapping
+		if ((header.SummaryBytes && summaryArena[header.SummaryBytes - 1] != '\0') ||
+			(header.AuthorBytes && authorNames[header.AuthorBytes - 1] != '\0') ||
+			(header.TipBytes && tips[header.TipBytes - 1] != '\0'))
+			return false;
+
+		outStore.Clear();
+
+		// The front segment comes first in the order the store keeps it, so row sequence numbers survive a reload
+		auto readSegment = [&](CommitStore::Segment& segment, size_t first, size_t count)
+		{
+			segment.Times.resize(count);
+			segment.Oids.resize(count);
+			segment.Authors.resize(count);
+			segment.Summaries.resize(count);
+			segment.Parents.resize(count);
+			memcpy(segment.Times.data(), times + first * sizeof(git_time_t), count * sizeof(git_time_t));
+			memcpy(segment.Oids.data(), oids + first * sizeof(git_oid), count * sizeof(git_oid));
+			memcpy(segment.Authors.data(), authors + first * sizeof(uint32_t), count * sizeof(uint32_t));
+			memcpy(segment.Summaries.data(), summaries + first * sizeof(uint32_t), count * sizeof(uint32_t));
+			memcpy(segment.Parents.data(), parents + first * sizeof(uint32_t), count * sizeof(uint32_t));
+		};
+
+		CommitStore::Segment& front = outStore.m_Front;
+		CommitStore::Segment& back = outStore.m_Back;
+		readSegment(front, 0, frontRows);
+		readSegment(back, frontRows, rows - frontRows);
+		outStore.m_SummaryArena.assign(summaryArena, summaryArena + header.SummaryBytes);
+		outStore.m_ParentArena.resize(static_cast<size_t>(header.ParentCount));
+		memcpy(outStore.m_ParentArena.data(), parentArena, static_cast<size_t>(header.ParentCount) * sizeof(uint64_t));
+
+		for (const char* name = authorNames; name < tips; name += strlen(name) + 1)
+			outStore.InternAuthor(name);
+
+		// A row's parent count and parents have to fit in the arena
+		bool valid = outStore.AuthorCount() == header.AuthorCount;
+		for (const CommitStore::Segment* segment : { &front, &back })
+		{
+			for (size_t i = 0, count = segment->Oids.size(); valid && i < count; ++i)
+			{
+				const uint32_t parent = segment->Parents[i];
+				valid = segment->Authors[i] < header.AuthorCount && segment->Summaries[i] < header.SummaryBytes &&
+					parent < header.ParentCount && outStore.m_ParentArena[parent] < header.ParentCount - parent;
+			}
+		}
+
+		outTips.clear();
+		for (const char* tip = tips; valid && tip < end;)
+		{
+			const char* name = tip + sizeof(git_oid);
+			valid = name < end;
+			if (valid)
+			{
+				git_oid oid;
+				memcpy(&oid, tip, sizeof(git_oid));
+				outTips[name] = oid;
+				tip = name + strlen(name) + 1;
+			}
+		}
+
+		valid = valid && outStore.m_FrontIndex.Deserialize(frontIndex, static_cast<size_t>(header.FrontIndexBytes));
+		valid = valid && outStore.m_BackIndex.Deserialize(backIndex, static_cast<size_t>(header.BackIndexBytes));
+
+		if (!valid || outTips.size() != header.TipCount)
+		{
+			outStore.Clear();
+			outTips.clear();
+			return false;
+		}
+
+		outStore.m_IndexMap.Reserve(rows);
+		for (size_t i = 0; i < front.Oids.size(); ++i)
+			outStore.m_IndexMap[front.Oids[i]] = -static_cast<int64_t>(i) - 1;
+		for (size_t i = 0; i < back.Oids.size(); ++i)
+			outStore.m_IndexMap[back.Oids[i]] = static_cast<int64_t>(i);
+
+		return true;
+	}
+
+	static void AppendBytes(eastl::vector<uint8_t>& out, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	bool CommitCache::Snapshot(git_repository* repo, const CommitStore& store, const eastl::hash_map<eastl::string, git_oid>& tips, CommitCacheSnapshot& out)
+	{
+		if (store.Empty())
+			return false;
+
+		eastl::vector<char> authorNames;
+		for (size_t i = 0, count = store.AuthorCount(); i < count; ++i)
+		{
+			const char* name = store.m_AuthorNames[i];
+			authorNames.insert(authorNames.end(), name, name + strlen(name) + 1);
+		}
+
+		eastl::vector<char> tipData;
+		for (const auto& [name, oid] : tips)
+		{
+			const char* raw = reinterpret_cast<const char*>(&oid);
+			tipData.insert(tipData.end(), raw, raw + sizeof(git_oid));
+			tipData.insert(tipData.end(), name.c_str(), name.c_str() + name.size() + 1);
+		}
+
+		CommitCacheHeader header;
+		memcpy(header.Magic, s_CacheMagic, sizeof(s_CacheMagic));
+		header.Version = COMMIT_CACHE_VERSION;
+		header.RowCount = store.Size();
+		header.FrontCount = store.m_Front.Oids.size();
+		header.AuthorCount = store.AuthorCount();
+		header.SummaryBytes = store.m_SummaryArena.size();
+		header.ParentCount = store.m_ParentArena.size();
+		header.AuthorBytes = authorNames.size();
+		header.TipCount = tips.size();
+		header.TipBytes = tipData.size();
+		header.FrontIndexBytes = 0;
+		header.BackIndexBytes = 0;
+
+		// Each column holds the front segment as stored, reversed, followed by the back segment
+		const CommitStore::Segment& front = store.m_Front;
+		const CommitStore::Segment& back = store.m_Back;
+		auto appendColumn = [&](const auto& frontColumn, const auto& backColumn)
+		{
+			using Value = typename eastl::remove_reference_t<decltype(frontColumn)>::value_type;
+			AppendBytes(out.Data, frontColumn.data(), frontColumn.size() * sizeof(Value));
+			AppendBytes(out.Data, backColumn.data(), backColumn.size() * sizeof(Value));
+		};
+
+		out.Path = GetCachePath(repo);
+		out.Data.clear();
+		out.Data.reserve(sizeof(header) + header.RowCount * s_RowSize + header.ParentCount * sizeof(uint64_t) + header.SummaryBytes + header.AuthorBytes + header.TipBytes);
+		AppendBytes(out.Data, &header, sizeof(header));
+		appendColumn(front.Times, back.Times);
+		appendColumn(front.Oids, back.Oids);
+		appendColumn(front.Authors, back.Authors);
+		appendColumn(front.Summaries, back.Summaries);
+		appendColumn(front.Parents, back.Parents);
+		AppendBytes(out.Data, store.m_ParentArena.data(), store.m_ParentArena.size() * sizeof(uint64_t));
+		AppendBytes(out.Data, store.m_SummaryArena.data(), store.m_SummaryArena.size());
+		AppendBytes(out.Data, authorNames.data(), authorNames.size());
+		AppendBytes(out.Data, tipData.data(), tipData.size());
+
+		// The indexes are serialized in place and their sizes patched into the header
+		size_t indexStart = out.Data.size();
+		store.m_FrontIndex.Serialize(out.Data);
+		header.FrontIndexBytes = out.Data.size() - indexStart;
+		indexStart = out.Data.size();
+		store.m_BackIndex.Serialize(out.Data);
+		header.BackIndexBytes = out.Data.size() - indexStart;
+		memcpy(out.Data.data(), &header, sizeof(header));
+		return true;
+	}
+
+	bool CommitCache::Write(const CommitCacheSnapshot& snapshot)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(snapshot.Path.parent_path(), error);
+		if (error)
+			return false;
+
+		// Written next to the old file and swapped in so a reader never maps a half written cache
+		std::filesystem::path tempPath = snapshot.Path;
+		tempPath += ".tmp";
+		{
+			std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+			if (!stream)
+				return false;
+
+			stream.write(reinterpret_cast<const char*>(snapshot.Data.data()), snapshot.Data.size());
+			if (!stream)
+				return false;
+		}
+
+		std::filesystem::rename(tempPath, snapshot.Path, error);
+		return !error;
+	}
+}
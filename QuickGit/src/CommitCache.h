@@ -0,0 +1,29 @@
+#pragma once
+
+#include <git2.h>
+
+#include "CommitStore.h"
+
+#define COMMIT_CACHE_VERSION 4
+
+namespace QuickGit
+{
+	// Contents of a cache file laid out in memory, so the file can be written on another thread
+	struct CommitCacheSnapshot
+	{
+		std::filesystem::path Path;
+		eastl::vector<uint8_t> Data;
+	};
+
+	// On-disk copy of a repository's commit list in .git/quickgit/commits.cache.
+	// The file is keyed by the branch tips the list was walked from, columns and search index are stored
+	// exactly as the store keeps them so loading is a bulk copy out of the mapped file.
+	class CommitCache
+	{
+	public:
+		static bool Load(git_repository* repo, CommitStore& outStore, eastl::hash_map<eastl::string, git_oid>& outTips);
+		// Only copies the store's columns, the slow part is left to Write
+		static bool Snapshot(git_repository* repo, const CommitStore& store, const eastl::hash_map<eastl::string, git_oid>& tips, CommitCacheSnapshot& out);
+		static bool Write(const CommitCacheSnapshot& snapshot);
+	};
+}
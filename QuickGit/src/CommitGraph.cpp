@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "CommitGraph.h"
+
+namespace QuickGit
+{
+	// File layout: https://git-scm.com/docs/gitformat-commit-graph
+	static constexpr uint32_t s_GraphSignature = 0x43475048;		// CGPH
+	static constexpr uint32_t s_ChunkOidFanout = 0x4f494446;		// OIDF
+	static constexpr uint32_t s_ChunkOidLookup = 0x4f49444c;		// OIDL
+	static constexpr uint32_t s_ChunkCommitData = 0x43444154;		// CDAT
+	static constexpr uint32_t s_ChunkExtraEdges = 0x45444745;		// EDGE
+	static constexpr uint32_t s_ChunkGenerationData = 0x47444132;	// GDA2
+	static constexpr uint32_t s_ChunkGenerationOverflow = 0x47444f32;	// GDO2
+
+	static constexpr size_t s_HeaderSize = 8;
+	static constexpr size_t s_ChunkEntrySize = 12;
+	static constexpr size_t s_OidSize = GIT_OID_SHA1_SIZE;
+	static constexpr size_t s_CommitDataSize = GIT_OID_SHA1_SIZE + 16;
+
+	static constexpr uint32_t s_GenerationOverflowFlag = 0x80000000;
+	static constexpr uint32_t s_GenerationOverflowMask = 0x7fffffff;
+
+	bool CommitGraph::Open(git_repository* repo)
+	{
+		Close();
+
+		const eastl::string filepath = eastl::string(git_repository_commondir(repo)) + "objects/info/commit-graph";
+		if (!m_File.Open(filepath.c_str()))
+			return false;
+
+		const uint8_t* data = m_File.Data();
+		const size_t size = m_File.Size();
+
+		// Only a standalone SHA-1 graph is read, split chains fall back to the regular walk
+		if (size < s_HeaderSize || ReadBE32(data) != s_GraphSignature || data[4] != 1 || data[5] != 1 || data[7] != 0)
+		{
+			Close();
+			return false;
+		}
+
+		const size_t chunkCount = data[6];
+		if (s_HeaderSize + (chunkCount + 1) * s_ChunkEntrySize > size)
+		{
+			Close();
+			return false;
+		}
+
+		size_t oidLookupSize = 0;
+		size_t commitDataSize = 0;
+		size_t extraEdgesSize = 0;
+		size_t generationDataSize = 0;
+		size_t generationOverflowSize = 0;
+		for (size_t i = 0; i < chunkCount; ++i)
+		{
+			const uint8_t* entry = data + s_HeaderSize + i * s_ChunkEntrySize;
+			const uint32_t id = ReadBE32(entry);
+			const uint64_t offset = ReadBE64(entry + 4);
+			const uint64_t end = ReadBE64(entry + s_ChunkEntrySize + 4);
+			if (offset > end || end > size)
+			{
+				Close();
+				return false;
+			}
+
+			const uint8_t* chunk = data + offset;
+			const size_t chunkSize = static_cast<size_t>(end - offset);
+			switch (id)
+			{
+				case s_ChunkOidFanout:
+					m_Fanout = chunkSize == 256 * 4 ? chunk : nullptr;
+					break;
+				case s_ChunkOidLookup:
+					m_Oids = chunk;
+					oidLookupSize = chunkSize;
+					break;
+				case s_ChunkCommitData:
+					m_CommitData = chunk;
+					commitDataSize = chunkSize;
+					break;
+				case s_ChunkExtraEdges:
+					m_ExtraEdges = chunk;
+					extraEdgesSize = chunkSize;
+					break;
+				case s_ChunkGenerationData:
+					m_GenerationData = chunk;
+					generationDataSize = chunkSize;
+					break;
+				case s_ChunkGenerationOverflow:
+					m_GenerationOverflow = chunk;
+					generationOverflowSize = chunkSize;
+					break;
+				default:
+					break;
+			}
+		}
+
+		const uint32_t count = m_Fanout ? ReadBE32(m_Fanout + 255 * 4) : 0;
+		if (!m_Fanout || !m_Oids || !m_CommitData || oidLookupSize < count * s_OidSize || commitDataSize < count * s_CommitDataSize)
+		{
+			Close();
+			return false;
+		}
+
+		if (generationDataSize < count * 4)
+			m_GenerationData = nullptr;
+
+		m_Count = count;
+		m_ExtraEdgeCount = static_cast<uint32_t>(extraEdgesSize / 4);
+		m_GenerationOverflowCount = static_cast<uint32_t>(generationOverflowSize / 8);
+		return true;
+	}
+
+	void CommitGraph::Close()
+	{
+		m_File.Close();
+		m_Fanout = nullptr;
+		m_Oids = nullptr;
+		m_CommitData = nullptr;
+		m_ExtraEdges = nullptr;
+		m_GenerationData = nullptr;
+		m_GenerationOverflow = nullptr;
+		m_Count = 0;
+		m_ExtraEdgeCount = 0;
+		m_GenerationOverflowCount = 0;
+	}
+
+	uint32_t CommitGraph::Find(const git_oid& oid) const
+	{
+		if (!m_Count)
+			return COMMIT_GRAPH_NO_POSITION;
+
+		const uint8_t firstByte = oid.id[0];
+		uint32_t low = firstByte ? ReadBE32(m_Fanout + (firstByte - 1) * 4) : 0;
+		uint32_t high = ReadBE32(m_Fanout + firstByte * 4);
+		while (low < high)
+		{
+			const uint32_t mid = low + (high - low) / 2;
+			const int cmp = memcmp(m_Oids + mid * s_OidSize, oid.id, s_OidSize);
+			if (cmp == 0)
+				return mid;
+
+			if (cmp < 0)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		return COMMIT_GRAPH_NO_POSITION;
+	}
+
+	void CommitGraph::Oid(uint32_t pos, git_oid& out) const
+	{
+		git_oid_fromraw(&out, m_Oids + pos * s_OidSize);
+	}
+
+	git_time_t CommitGraph::Time(uint32_t pos) const
+	{
+		// Upper 30 bits of the first word hold the topological level, the remaining 34 bits the commit time
+		const uint8_t* commit = m_CommitData + pos * s_CommitDataSize + s_OidSize + 8;
+		return static_cast<git_time_t>((static_cast<uint64_t>(ReadBE32(commit) & 0x3) << 32) | ReadBE32(commit + 4));
+	}
+
+	uint64_t CommitGraph::Generation(uint32_t pos) const
+	{
+		if (!m_GenerationData)
+			return ReadBE32(m_CommitData + pos * s_CommitDataSize + s_OidSize + 8) >> 2;
+
+		uint64_t offset = ReadBE32(m_GenerationData + pos * 4);
+		if (offset & s_GenerationOverflowFlag)
+		{
+			const uint32_t index = static_cast<uint32_t>(offset & s_GenerationOverflowMask);
+			offset = index < m_GenerationOverflowCount ? ReadBE64(m_GenerationOverflow + index * 8) : 0;
+		}
+
+		return static_cast<uint64_t>(Time(pos)) + offset;
+	}
+
+	uint32_t CommitGraph::ParentAt(uint32_t pos, uint32_t index) const
+	{
+		return ReadBE32(m_CommitData + pos * s_CommitDataSize + s_OidSize + index * 4);
+	}
+}
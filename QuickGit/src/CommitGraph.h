@@ -0,0 +1,99 @@
+#pragma once
+
+#include <git2.h>
+
+#include "MappedFile.h"
+
+#define COMMIT_GRAPH_NO_POSITION UINT32_MAX
+
+namespace QuickGit
+{
+	// Reader for the objects/info/commit-graph file written by git or by Client::WriteCommitGraph.
+	// Parents, commit times and generation numbers come straight from the mapped file,
+	// no commit object has to be inflated to walk the history.
+	class CommitGraph
+	{
+	public:
+		bool Open(git_repository* repo);
+		void Close();
+
+		bool IsOpen() const { return m_Count != 0; }
+		uint32_t Size() const { return m_Count; }
+
+		// Position of the commit in the graph or COMMIT_GRAPH_NO_POSITION
+		uint32_t Find(const git_oid& oid) const;
+
+		void Oid(uint32_t pos, git_oid& out) const;
+		git_time_t Time(uint32_t pos) const;
+
+		// Corrected commit date when the file has generation data, topological level otherwise.
+		// Either way a commit's generation is greater than the generation of each of its parents.
+		uint64_t Generation(uint32_t pos) const;
+
+		template<typename Func>
+		void ForEachParent(uint32_t pos, Func&& func) const
+		{
+			const uint32_t first = ParentAt(pos, 0);
+			if (first == s_ParentNone)
+				return;
+
+			if (first < m_Count)
+				func(first);
+
+			const uint32_t second = ParentAt(pos, 1);
+			if (second == s_ParentNone)
+				return;
+
+			if ((second & s_ExtraEdges) == 0)
+			{
+				if (second < m_Count)
+					func(second);
+
+				return;
+			}
+
+			// Octopus merges keep the second parent onwards in the extra edge list
+			for (uint32_t i = second & s_EdgeMask; i < m_ExtraEdgeCount; ++i)
+			{
+				const uint32_t edge = ReadBE32(m_ExtraEdges + i * 4);
+				if ((edge & s_EdgeMask) < m_Count)
+					func(edge & s_EdgeMask);
+
+				if (edge & s_LastEdge)
+					break;
+			}
+		}
+
+	private:
+		static constexpr uint32_t s_ParentNone = 0x70000000;
+		static constexpr uint32_t s_ExtraEdges = 0x80000000;
+		static constexpr uint32_t s_LastEdge = 0x80000000;
+		static constexpr uint32_t s_EdgeMask = 0x7fffffff;
+
+		static uint32_t ReadBE32(const uint8_t* data)
+		{
+			return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+		}
+
+		static uint64_t ReadBE64(const uint8_t* data)
+		{
+			return (static_cast<uint64_t>(ReadBE32(data)) << 32) | ReadBE32(data + 4);
+		}
+
+		uint32_t ParentAt(uint32_t pos, uint32_t index) const;
+
+	private:
+		MappedFile m_File;
+
+		const uint8_t* m_Fanout = nullptr;
+		const uint8_t* m_Oids = nullptr;
+		const uint8_t* m_CommitData = nullptr;
+		const uint8_t* m_ExtraEdges = nullptr;
+		const uint8_t* m_GenerationData = nullptr;
+		const uint8_t* m_GenerationOverflow = nullptr;
+
+		uint32_t m_Count = 0;
+		uint32_t m_ExtraEdgeCount = 0;
+		uint32_t m_GenerationOverflowCount = 0;
+	};
+}
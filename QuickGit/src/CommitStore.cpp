@@ -0,0 +1,248 @@
+#include "pch.h"
+#include "CommitStore.h"
+
+namespace QuickGit
+{
+	static uint32_t PushString(eastl::vector<char>& buffer, const char* str, size_t maxLength)
+	{
+		const uint32_t offset = static_cast<uint32_t>(buffer.size());
+		const size_t length = str ? strnlen(str, maxLength) : 0;
+		buffer.insert(buffer.end(), str, str + length);
+		buffer.push_back('\0');
+		return offset;
+	}
+
+	// Batches arrive one after another, reserving exactly what each needs would copy the columns every time
+	template<typename T>
+	static void ReserveGrowth(eastl::vector<T>& vector, size_t size)
+	{
+		if (size > vector.capacity())
+			vector.reserve(eastl::max(size, vector.capacity() * 2));
+	}
+
+	void CommitBatch::Add(git_commit* commit)
+	{
+		const git_signature* author = git_commit_author(commit);
+
+		Oids.push_back(*git_commit_id(commit));
+		Times.push_back(author->when.time);
+		AuthorOffsets.push_back(PushString(Strings, author->name, SIZE_MAX));
+		SummaryOffsets.push_back(PushString(Strings, git_commit_summary(commit), COMMIT_MSG_LEN - 1));
+
+		ParentOffsets.push_back(static_cast<uint32_t>(Parents.size()));
+		for (unsigned int k = 0, count = git_commit_parentcount(commit); k < count; ++k)
+			Parents.push_back(OidPrefix(*git_commit_parent_id(commit, k)));
+	}
+
+	void CommitBatch::BuildSearch()
+	{
+		Search.Clear();
+		char id[GIT_OID_SHA1_HEXSIZE + 1];
+		for (uint32_t i = 0, count = static_cast<uint32_t>(Size()); i < count; ++i)
+		{
+			Search.Add(i, Strings.data() + SummaryOffsets[i]);
+			Search.Add(i, Strings.data() + AuthorOffsets[i]);
+			git_oid_tostr(id, sizeof(id), &Oids[i]);
+			Search.Add(i, id);
+		}
+		Search.Finish();
+	}
+
+	void CommitBatch::Append(const CommitBatch& other)
+	{
+		const uint32_t base = static_cast<uint32_t>(Strings.size());
+		Search.Append(other.Search, static_cast<uint32_t>(Size()));
+
+		Oids.insert(Oids.end(), other.Oids.begin(), other.Oids.end());
+		Times.insert(Times.end(), other.Times.begin(), other.Times.end());
+		Strings.insert(Strings.end(), other.Strings.begin(), other.Strings.end());
+
+		for (uint32_t offset : other.AuthorOffsets)
+			AuthorOffsets.push_back(base + offset);
+		for (uint32_t offset : other.SummaryOffsets)
+			SummaryOffsets.push_back(base + offset);
+
+		const uint32_t parentBase = static_cast<uint32_t>(Parents.size());
+		for (uint32_t offset : other.ParentOffsets)
+			ParentOffsets.push_back(parentBase + offset);
+		Parents.insert(Parents.end(), other.Parents.begin(), other.Parents.end());
+	}
+
+	void CommitBatch::Clear()
+	{
+		Oids.clear();
+		Times.clear();
+		AuthorOffsets.clear();
+		SummaryOffsets.clear();
+		Strings.clear();
+		ParentOffsets.clear();
+		Parents.clear();
+		Search.Clear();
+	}
+
+	void CommitStore::Segment::Reserve(size_t size)
+	{
+		ReserveGrowth(Oids, size);
+		ReserveGrowth(Times, size);
+		ReserveGrowth(Authors, size);
+		ReserveGrowth(Summaries, size);
+		ReserveGrowth(Parents, size);
+	}
+
+	void CommitStore::Segment::Clear()
+	{
+		Oids.clear();
+		Times.clear();
+		Authors.clear();
+		Summaries.clear();
+		Parents.clear();
+	}
+
+	uint32_t CommitStore::InternAuthor(const char* name)
+	{
+		auto it = m_AuthorIDs.find_as(name, eastl::hash<const char*>(), [](const eastl::string& a, const char* b) { return a == b; });
+		if (it != m_AuthorIDs.end())
+			return it->second;
+
+		const uint32_t id = static_cast<uint32_t>(m_AuthorNames.size());
+		it = m_AuthorIDs.emplace(eastl::string(name), id).first;
+		m_AuthorNames.push_back(it->first.c_str());
+		return id;
+	}
+
+	void CommitStore::Push(Segment& segment, const CommitBatch& batch, size_t index, int64_t seq)
+	{
+		const git_oid& oid = batch.Oids[index];
+		const char* summary = batch.Strings.data() + batch.SummaryOffsets[index];
+
+		segment.Oids.push_back(oid);
+		segment.Times.push_back(batch.Times[index]);
+		segment.Authors.push_back(InternAuthor(batch.Strings.data() + batch.AuthorOffsets[index]));
+		segment.Summaries.push_back(PushString(m_SummaryArena, summary, COMMIT_MSG_LEN - 1));
+
+		const uint32_t firstParent = batch.ParentOffsets[index];
+		const uint32_t endParent = index + 1 < batch.Size() ? batch.ParentOffsets[index + 1] : static_cast<uint32_t>(batch.Parents.size());
+		segment.Parents.push_back(static_cast<uint32_t>(m_ParentArena.size()));
+		m_ParentArena.push_back(endParent - firstParent);
+		m_ParentArena.insert(m_ParentArena.end(), batch.Parents.begin() + firstParent, batch.Parents.begin() + endParent);
+
+		m_IndexMap[oid] = seq;
+	}
+
+	void CommitStore::Append(CommitBatch& batch)
+	{
+		const size_t count = batch.Size();
+		const uint32_t base = static_cast<uint32_t>(m_Back.Oids.size());
+		m_Back.Reserve(m_Back.Oids.size() + count);
+		m_IndexMap.Reserve(Size() + count);
+		ReserveGrowth(m_SummaryArena, m_SummaryArena.size() + batch.Strings.size());
+		ReserveGrowth(m_ParentArena, m_ParentArena.size() + count + batch.Parents.size());
+
+		for (size_t i = 0; i < count; ++i)
+			Push(m_Back, batch, i, static_cast<int64_t>(m_Back.Oids.size()));
+
+		if (count && batch.Search.Empty())
+			batch.BuildSearch();
+		m_BackIndex.Merge(base, batch.Search);
+
+		batch.Clear();
+	}
+
+	void CommitStore::Prepend(CommitBatch& batch)
+	{
+		const size_t count = batch.Size();
+		const uint32_t base = static_cast<uint32_t>(m_Front.Oids.size());
+		m_Front.Reserve(m_Front.Oids.size() + count);
+		++m_Revision;
+
+		// The batch is newest first, the front segment is stored reversed
+		TrigramRuns runs;
+		char id[GIT_OID_SHA1_HEXSIZE + 1];
+		for (size_t i = count; i-- > 0;)
+		{
+			if (m_IndexMap.Contains(batch.Oids[i]))
+				continue;
+
+			const uint32_t row = static_cast<uint32_t>(m_Front.Oids.size()) - base;
+			Push(m_Front, batch, i, -static_cast<int64_t>(m_Front.Oids.size()) - 1);
+			runs.Add(row, m_SummaryArena.data() + m_Front.Summaries.back());
+			runs.Add(row, m_AuthorNames[m_Front.Authors.back()]);
+			git_oid_tostr(id, sizeof(id), &batch.Oids[i]);
+			runs.Add(row, id);
+		}
+
+		runs.Finish();
+		m_FrontIndex.Merge(base, runs);
+
+		batch.Clear();
+	}
+
+	void CommitStore::Clear()
+	{
+		m_Front.Clear();
+		m_Back.Clear();
+		m_SummaryArena.clear();
+		m_ParentArena.clear();
+		m_AuthorNames.clear();
+		m_AuthorIDs.clear();
+		m_IndexMap.Clear();
+		m_FrontIndex.Clear();
+		m_BackIndex.Clear();
+		++m_Revision;
+	}
+
+	bool CommitStore::Search(const char* begin, const char* end, eastl::vector<uint32_t>& outRows) const
+	{
+		const uint32_t frontSize = static_cast<uint32_t>(m_Front.Oids.size());
+		const size_t backFirst = outRows.size();
+		if (!m_BackIndex.Find(begin, end, outRows))
+			return false;
+
+		for (size_t i = backFirst; i < outRows.size(); ++i)
+			outRows[i] += frontSize;
+
+		const size_t frontFirst = outRows.size();
+		m_FrontIndex.Find(begin, end, outRows);
+		for (size_t i = frontFirst; i < outRows.size(); ++i)
+			outRows[i] = frontSize - 1 - outRows[i];
+
+		return true;
+	}
+
+	git_commit* CommitHandleCache::Get(git_repository* repo, const git_oid& oid)
+	{
+		Entry* victim = &m_Entries[0];
+		for (Entry& entry : m_Entries)
+		{
+			if (entry.Commit && git_oid_equal(&entry.Oid, &oid))
+			{
+				entry.LastUsed = ++m_Tick;
+				return entry.Commit;
+			}
+
+			if (entry.LastUsed < victim->LastUsed)
+				victim = &entry;
+		}
+
+		git_commit* commit = nullptr;
+		if (git_commit_lookup(&commit, repo, &oid) != 0)
+			return nullptr;
+
+		git_commit_free(victim->Commit);
+		victim->Oid = oid;
+		victim->Commit = commit;
+		victim->LastUsed = ++m_Tick;
+		return commit;
+	}
+
+	void CommitHandleCache::Clear()
+	{
+		for (Entry& entry : m_Entries)
+		{
+			git_commit_free(entry.Commit);
+			entry = {};
+		}
+
+		m_Tick = 0;
+	}
+}
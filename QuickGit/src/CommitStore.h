@@ -0,0 +1,152 @@
+#pragma once
+
+#include <git2.h>
+
+#include "Utils.h"
+#include "OidMap.h"
+#include "TrigramIndex.h"
+
+#define COMMIT_MSG_LEN 128
+#define COMMIT_HANDLE_CACHE_SIZE 128
+
+namespace QuickGit
+{
+	// Rows built off the UI thread, strings are kept in one buffer and interned once merged into a store
+	struct CommitBatch
+	{
+		eastl::vector<git_oid> Oids;
+		eastl::vector<git_time_t> Times;
+		eastl::vector<uint32_t> AuthorOffsets;
+		eastl::vector<uint32_t> SummaryOffsets;
+		eastl::vector<char> Strings;
+		// Parent id prefixes of row i start at ParentOffsets[i] and end where the next row's start
+		eastl::vector<uint32_t> ParentOffsets;
+		eastl::vector<uint64_t> Parents;
+		// Trigrams of the summaries, authors and hex ids, built by the loader so the store only has to merge them
+		TrigramRuns Search;
+
+		void Add(git_commit* commit);
+		void BuildSearch();
+		void Append(const CommitBatch& other);
+		void Clear();
+
+		size_t Size() const { return Oids.size(); }
+		bool Empty() const { return Oids.empty(); }
+	};
+
+	// Structure of arrays commit list.
+	// Rows spliced in at the front live in a separate, reversed segment so prepending never moves
+	// the loaded history. Each row has a stable sequence number: negative for the front segment,
+	// row = sequence + front segment size.
+	class CommitStore
+	{
+	public:
+		CommitStore() = default;
+		CommitStore(const CommitStore&) = delete;
+		CommitStore& operator=(const CommitStore&) = delete;
+
+		void Append(CommitBatch& batch);
+		void Prepend(CommitBatch& batch);
+		void Clear();
+
+		size_t Size() const { return m_Front.Oids.size() + m_Back.Oids.size(); }
+		bool Empty() const { return Size() == 0; }
+
+		// Changes whenever existing rows move or go away, appending rows keeps it
+		uint64_t Revision() const { return m_Revision; }
+
+		int64_t Find(const git_oid& oid) const
+		{
+			const int64_t* seq = m_IndexMap.Find(oid);
+			return seq ? *seq + static_cast<int64_t>(m_Front.Oids.size()) : -1;
+		}
+
+		const git_oid& Oid(size_t row) const { size_t i; return Locate(row, i).Oids[i]; }
+		git_time_t Time(size_t row) const { size_t i; return Locate(row, i).Times[i]; }
+		uint32_t AuthorID(size_t row) const { size_t i; return Locate(row, i).Authors[i]; }
+		const char* Author(size_t row) const { return m_AuthorNames[AuthorID(row)]; }
+		const char* Summary(size_t row) const { size_t i; return m_SummaryArena.data() + Locate(row, i).Summaries[i]; }
+		// Parents are kept as OidPrefix values, enough to link rows without holding full ids
+		uint32_t ParentCount(size_t row) const { size_t i; return static_cast<uint32_t>(m_ParentArena[Locate(row, i).Parents[i]]); }
+		const uint64_t* Parents(size_t row) const { size_t i; return m_ParentArena.data() + Locate(row, i).Parents[i] + 1; }
+
+		size_t AuthorCount() const { return m_AuthorNames.size(); }
+
+		// Appends the rows whose summary, author or id may contain the term, unordered and not yet checked.
+		// False when the term is too short for the trigram index.
+		bool Search(const char* begin, const char* end, eastl::vector<uint32_t>& outRows) const;
+
+	private:
+		friend class CommitCache;
+
+		struct Segment
+		{
+			eastl::vector<git_oid> Oids;
+			eastl::vector<git_time_t> Times;
+			eastl::vector<uint32_t> Authors;
+			eastl::vector<uint32_t> Summaries;
+			// Offset into the parent arena where the row's parent count is followed by its parents
+			eastl::vector<uint32_t> Parents;
+
+			void Reserve(size_t size);
+			void Clear();
+		};
+
+		const Segment& Locate(size_t row, size_t& outIndex) const
+		{
+			const size_t frontSize = m_Front.Oids.size();
+			if (row < frontSize)
+			{
+				outIndex = frontSize - 1 - row;
+				return m_Front;
+			}
+
+			outIndex = row - frontSize;
+			return m_Back;
+		}
+
+		void Push(Segment& segment, const CommitBatch& batch, size_t index, int64_t seq);
+		uint32_t InternAuthor(const char* name);
+
+	private:
+		Segment m_Front;
+		Segment m_Back;
+
+		eastl::vector<char> m_SummaryArena;
+		eastl::vector<uint64_t> m_ParentArena;
+		eastl::vector<const char*> m_AuthorNames;
+		eastl::hash_map<eastl::string, uint32_t> m_AuthorIDs;
+
+		OidMap<int64_t> m_IndexMap;
+		uint64_t m_Revision = 0;
+
+		// Keyed on the position within each segment, which never changes for a row
+		TrigramIndex m_FrontIndex;
+		TrigramIndex m_BackIndex;
+	};
+
+	// Least recently used git_commit objects, looked up on demand from the store's oids.
+	// Returned handles are owned by the cache and stay valid until evicted, don't keep them across frames.
+	class CommitHandleCache
+	{
+	public:
+		CommitHandleCache() = default;
+		CommitHandleCache(const CommitHandleCache&) = delete;
+		CommitHandleCache& operator=(const CommitHandleCache&) = delete;
+		~CommitHandleCache() { Clear(); }
+
+		git_commit* Get(git_repository* repo, const git_oid& oid);
+		void Clear();
+
+	private:
+		struct Entry
+		{
+			git_oid Oid;
+			git_commit* Commit = nullptr;
+			uint64_t LastUsed = 0;
+		};
+
+		Entry m_Entries[COMMIT_HANDLE_CACHE_SIZE];
+		uint64_t m_Tick = 0;
+	};
+}
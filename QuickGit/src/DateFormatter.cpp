@@ -0,0 +1,191 @@
+#include "pch.h"
+#include "DateFormatter.h"
+
+namespace QuickGit
+{
+	static constexpr int64_t s_SecondsPerDay = 24 * 60 * 60;
+
+	static constexpr const char* s_MonthNames[12] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	static int64_t FloorDiv(int64_t value, int64_t divisor)
+	{
+		const int64_t quotient = value / divisor;
+		return quotient * divisor > value ? quotient - 1 : quotient;
+	}
+
+	// Proleptic Gregorian calendar conversions from http://howardhinnant.github.io/date_algorithms.html
+	static int64_t DaysFromCivil(int64_t year, uint32_t month, uint32_t day)
+	{
+		year -= month <= 2;
+		const int64_t era = (year >= 0 ? year : year - 399) / 400;
+		const uint32_t yearOfEra = static_cast<uint32_t>(year - era * 400);
+		const uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		const uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+	}
+
+	static void CivilFromDays(int64_t days, int64_t& outYear, uint32_t& outMonth, uint32_t& outDay)
+	{
+		days += 719468;
+		const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+		const uint32_t dayOfEra = static_cast<uint32_t>(days - era * 146097);
+		const uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		const uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+		const uint32_t monthIndex = (5 * dayOfYear + 2) / 153;
+		outDay = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+		outMonth = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+		outYear = static_cast<int64_t>(yearOfEra) + era * 400 + (outMonth <= 2);
+	}
+
+	static char* WriteTwoDigits(char* out, uint32_t value)
+	{
+		out[0] = static_cast<char>('0' + value / 10 % 10);
+		out[1] = static_cast<char>('0' + value % 10);
+		return out + 2;
+	}
+
+	static int64_t QueryLocalOffset(time_t time)
+	{
+		// The offset is the broken down local time read back as if it was UTC
+		tm localTime;
+		localtime_s(&localTime, &time);
+		const int64_t localSeconds = DaysFromCivil(localTime.tm_year + 1900, static_cast<uint32_t>(localTime.tm_mon + 1), static_cast<uint32_t>(localTime.tm_mday)) * s_SecondsPerDay +
+			localTime.tm_hour * 3600 + localTime.tm_min * 60 + localTime.tm_sec;
+		return localSeconds - time;
+	}
+
+	// from has the offset and to doesn't, returns the last time on the side of from that has it
+	static int64_t FindTransition(int64_t from, int64_t to, int64_t offset)
+	{
+		while (from + 1 != to && from - 1 != to)
+		{
+			const int64_t middle = from + (to - from) / 2;
+			if (QueryLocalOffset(static_cast<time_t>(middle)) == offset)
+				from = middle;
+			else
+				to = middle;
+		}
+
+		return from;
+	}
+
+	// Walks from time towards limit a probe step at a time, returns the last time before limit that still has the offset
+	static int64_t FindRangeEnd(int64_t time, int64_t limit, int64_t offset)
+	{
+		const int64_t step = limit > time ? DATE_OFFSET_PROBE_SECONDS : -DATE_OFFSET_PROBE_SECONDS;
+		const int64_t last = limit > time ? limit - 1 : limit;
+		while (time != last)
+		{
+			const int64_t probe = step > 0 ? eastl::min(time + step, last) : eastl::max(time + step, last);
+			if (QueryLocalOffset(static_cast<time_t>(probe)) != offset)
+				return FindTransition(time, probe, offset);
+
+			time = probe;
+		}
+
+		return time;
+	}
+
+	const char* DateFormatter::FormatLocal(git_time_t time)
+	{
+		TextEntry& entry = m_Texts[static_cast<uint64_t>(time) % DATE_TEXT_CACHE_SIZE];
+		if (!entry.Used || entry.Time != time)
+		{
+			Format(time, LocalOffset(time), entry.Text, sizeof(entry.Text));
+			entry.Time = time;
+			entry.Used = true;
+		}
+
+		return entry.Text;
+	}
+
+	void DateFormatter::Format(git_time_t time, int64_t offsetSeconds, char* out, size_t size)
+	{
+		const int64_t local = time + offsetSeconds;
+		const int64_t days = FloorDiv(local, s_SecondsPerDay);
+		const uint32_t secondOfDay = static_cast<uint32_t>(local - days * s_SecondsPerDay);
+
+		int64_t year;
+		uint32_t month, day;
+		CivilFromDays(days, year, month, day);
+
+		// "dd Mon yyyy hh:mm:ss", years outside 0-9999 are not worth a special case
+		char text[DATE_TEXT_LEN];
+		char* it = WriteTwoDigits(text, day);
+		*it++ = ' ';
+		memcpy(it, s_MonthNames[month - 1], 3);
+		it += 3;
+		*it++ = ' ';
+		const uint32_t clampedYear = static_cast<uint32_t>(eastl::clamp<int64_t>(year, 0, 9999));
+		it = WriteTwoDigits(it, clampedYear / 100);
+		it = WriteTwoDigits(it, clampedYear % 100);
+		*it++ = ' ';
+		it = WriteTwoDigits(it, secondOfDay / 3600);
+		*it++ = ':';
+		it = WriteTwoDigits(it, secondOfDay / 60 % 60);
+		*it++ = ':';
+		it = WriteTwoDigits(it, secondOfDay % 60);
+		*it = '\0';
+
+		if (size)
+		{
+			const size_t length = eastl::min(static_cast<size_t>(it - text), size - 1);
+			memcpy(out, text, length);
+			out[length] = '\0';
+		}
+	}
+
+	void DateFormatter::FormatOffset(int offsetMinutes, char* out, size_t size)
+	{
+		const uint32_t minutes = static_cast<uint32_t>(offsetMinutes < 0 ? -offsetMinutes : offsetMinutes);
+		char text[8];
+		text[0] = offsetMinutes < 0 ? '-' : '+';
+		WriteTwoDigits(text + 1, minutes / 60);
+		text[3] = ':';
+		WriteTwoDigits(text + 4, minutes % 60);
+		text[6] = '\0';
+
+		if (size)
+		{
+			const size_t length = eastl::min(static_cast<size_t>(6), size - 1);
+			memcpy(out, text, length);
+			out[length] = '\0';
+		}
+	}
+
+	int64_t DateFormatter::LocalOffset(git_time_t time)
+	{
+		auto next = eastl::upper_bound(m_Offsets.begin(), m_Offsets.end(), time, [](int64_t value, const OffsetRange& range) { return value < range.Start; });
+		if (next != m_Offsets.begin() && time < (next - 1)->End)
+			return (next - 1)->Offset;
+
+		// The range around the time is searched up to the cached ranges next to it, both ends of a transition are
+		// found with a binary search. Two probes with the same offset have no transition between them.
+		const int64_t offset = QueryLocalOffset(static_cast<time_t>(time));
+		const int64_t low = time - DATE_OFFSET_SEARCH_SECONDS;
+		const int64_t high = time + DATE_OFFSET_SEARCH_SECONDS;
+		const int64_t lowLimit = next != m_Offsets.begin() ? eastl::max((next - 1)->End, low) : low;
+		const int64_t highLimit = next != m_Offsets.end() ? eastl::min(next->Start, high) : high;
+		OffsetRange range{ FindRangeEnd(time, lowLimit, offset), FindRangeEnd(time, highLimit, offset) + 1, offset };
+
+		if (m_Offsets.size() >= DATE_OFFSET_MAX_RANGES)
+		{
+			m_Offsets.clear();
+			next = m_Offsets.end();
+		}
+
+		if (next != m_Offsets.end() && next->Start == range.End && next->Offset == offset)
+		{
+			range.End = next->End;
+			next = m_Offsets.erase(next);
+		}
+		if (next != m_Offsets.begin() && (next - 1)->End == range.Start && (next - 1)->Offset == offset)
+		{
+			(next - 1)->End = range.End;
+			return offset;
+		}
+
+		m_Offsets.insert(next, range);
+		return offset;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <git2.h>
+
+#define DATE_TEXT_LEN 24
+#define DATE_TEXT_CACHE_SIZE 256
+// UTC offset transitions are assumed to be at least a probe step apart, a range is searched this far out on each side of a time
+#define DATE_OFFSET_PROBE_SECONDS (24ll * 60 * 60)
+#define DATE_OFFSET_SEARCH_SECONDS (64ll * 24 * 60 * 60)
+#define DATE_OFFSET_MAX_RANGES 4096
+
+namespace QuickGit
+{
+	// Formats times as "%d %b %Y %H:%M:%S" in local time.
+	// localtime is only asked for while finding the range of times around a transition, the calendar math is done here
+	// and the text of recently shown times is kept so visible rows are not formatted again every frame.
+	class DateFormatter
+	{
+	public:
+		// The returned text is owned by the cache, use it before the next call
+		const char* FormatLocal(git_time_t time);
+
+		static void Format(git_time_t time, int64_t offsetSeconds, char* out, size_t size);
+		// Offset in minutes as +hh:mm
+		static void FormatOffset(int offsetMinutes, char* out, size_t size);
+
+	private:
+		int64_t LocalOffset(git_time_t time);
+
+	private:
+		// Times in [Start, End) share a UTC offset
+		struct OffsetRange
+		{
+			int64_t Start;
+			int64_t End;
+			int64_t Offset;
+		};
+
+		struct TextEntry
+		{
+			git_time_t Time = 0;
+			bool Used = false;
+			char Text[DATE_TEXT_LEN];
+		};
+
+		// Sorted and never overlapping, neighbours with the same offset are merged
+		eastl::vector<OffsetRange> m_Offsets;
+		TextEntry m_Texts[DATE_TEXT_CACHE_SIZE];
+	};
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <git2.h>
+
+namespace QuickGit
+{
+	// Cells a byte takes in a monospace font, tabs are drawn four cells wide like ImGui does and UTF-8 continuation bytes take none
+	inline uint32_t DiffColumnWidth(char c)
+	{
+		return c == '\t' ? 4 : (static_cast<uint8_t>(c) & 0xC0) != 0x80;
+	}
+
+	inline uint32_t DiffTextColumns(const char* begin, const char* end)
+	{
+		uint32_t columns = 0;
+		for (const char* c = begin; c < end; ++c)
+			columns += DiffColumnWidth(*c);
+
+		return columns;
+	}
+
+	// Auto diffs minimally and falls back to Myers for big files and for the rest of a diff that ran past its time budget
+	enum class DiffAlgorithm : uint8_t { Auto, Myers, Patience, Minimal };
+
+	inline const char* DiffAlgorithmName(DiffAlgorithm algorithm)
+	{
+		switch (algorithm)
+		{
+			case DiffAlgorithm::Auto: return "Auto";
+			case DiffAlgorithm::Myers: return "Myers";
+			case DiffAlgorithm::Patience: return "Patience";
+			case DiffAlgorithm::Minimal: return "Minimal";
+		}
+
+		return "";
+	}
+
+	// One printed line of a patch, hunk headers included
+	struct DiffLine
+	{
+		// GIT_DIFF_LINE_* origin
+		char Origin;
+		// -1 on the side the line doesn't exist
+		int32_t OldLine;
+		int32_t NewLine;
+		// Position in Diff::Text, the origin prefix is part of the line and the newline isn't
+		uint32_t Offset;
+		uint32_t Length;
+	};
+
+	struct DiffHunk
+	{
+		int32_t OldStart;
+		int32_t OldLines;
+		int32_t NewStart;
+		int32_t NewLines;
+		// Range in Diff::Lines starting with the header line
+		uint32_t FirstLine;
+		uint32_t LineCount;
+	};
+
+	struct Patch
+	{
+		git_delta_t Status;
+		uint64_t OldFileSize;
+		uint64_t NewFileSize;
+		eastl::string File;
+		bool Binary = false;
+		// A commit diff lists its files first, hunks, lines and text are filled in once the file is opened
+		bool Loaded = false;
+		// Diffstat line counts, known before the text
+		bool Counted = false;
+		uint32_t Additions = 0;
+		uint32_t Deletions = 0;
+		// Lines past Limit bytes of text are left out until more is asked for, TotalHunks counts the ones left out too
+		bool Truncated = false;
+		uint32_t TotalHunks = 0;
+		uint64_t Limit = 0;
+		// Algorithm the hunks were generated with, never Auto
+		DiffAlgorithm Algorithm = DiffAlgorithm::Minimal;
+
+		// Ranges in Diff::Hunks and Diff::Lines
+		uint32_t FirstHunk = 0;
+		uint32_t HunkCount = 0;
+		uint32_t FirstLine = 0;
+		uint32_t LineCount = 0;
+
+		// The printed hunks in Diff::Text, followed by a terminator
+		uint32_t TextOffset = 0;
+		uint32_t TextSize = 0;
+		// Widest line in cells, lets a view size itself without measuring every line
+		uint32_t Columns = 0;
+	};
+
+	// Patches of a diff share one text buffer and one array of hunks and lines. Each patch owns a contiguous range of them,
+	// patches filled in later are appended in whatever order they were opened.
+	struct Diff
+	{
+		eastl::vector<Patch> Patches;
+		eastl::vector<DiffHunk> Hunks;
+		eastl::vector<DiffLine> Lines;
+		eastl::vector<char> Text;
+
+		// Held by readers of a diff that a worker still fills patches into, the worker only appends under it
+		mutable std::mutex Mutex;
+		// Bumped each time a patch's text is filled in
+		uint32_t Revision = 0;
+		// Text of patches that were filled in again, their old ranges stay behind until the buffers are compacted
+		size_t StaleText = 0;
+
+		const char* PatchText(const Patch& patch) const { return Text.data() + patch.TextOffset; }
+		char* PatchText(const Patch& patch) { return Text.data() + patch.TextOffset; }
+
+		void Clear()
+		{
+			Patches.clear();
+			Hunks.clear();
+			Lines.clear();
+			Text.clear();
+			StaleText = 0;
+		}
+	};
+}
@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "DiffCache.h"
+
+namespace QuickGit
+{
+	eastl::shared_ptr<Diff> DiffCache::Find(const DiffKey& key)
+	{
+		std::scoped_lock lock(m_Mutex);
+		auto it = m_Index.find(key);
+		if (it == m_Index.end())
+			return nullptr;
+
+		m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+		return it->second->Value;
+	}
+
+	bool DiffCache::Contains(const DiffKey& key) const
+	{
+		std::scoped_lock lock(m_Mutex);
+		return m_Index.find(key) != m_Index.end();
+	}
+
+	void DiffCache::Insert(const DiffKey& key, eastl::shared_ptr<Diff> diff)
+	{
+		const size_t bytes = DiffBytes(*diff);
+
+		std::scoped_lock lock(m_Mutex);
+		auto it = m_Index.find(key);
+		if (it != m_Index.end())
+		{
+			m_Bytes.fetch_sub(it->second->Bytes, std::memory_order_relaxed);
+			m_Entries.erase(it->second);
+			m_Index.erase(it);
+		}
+
+		m_Entries.push_front({ key, eastl::move(diff), bytes });
+		m_Index[key] = m_Entries.begin();
+		m_Bytes.fetch_add(bytes, std::memory_order_relaxed);
+		m_Count.store(m_Entries.size(), std::memory_order_relaxed);
+		Evict();
+	}
+
+	void DiffCache::Charge(const DiffKey& key, const Diff* diff, int64_t bytes)
+	{
+		std::scoped_lock lock(m_Mutex);
+		auto it = m_Index.find(key);
+		if (it == m_Index.end() || it->second->Value.get() != diff)
+			return;
+
+		// Unsigned wrap around adds a negative charge
+		it->second->Bytes += static_cast<size_t>(bytes);
+		m_Bytes.fetch_add(static_cast<size_t>(bytes), std::memory_order_relaxed);
+		Evict();
+	}
+
+	void DiffCache::Pin(const DiffKey& key)
+	{
+		std::scoped_lock lock(m_Mutex);
+		++m_Pins[key];
+	}
+
+	void DiffCache::Unpin(const DiffKey& key)
+	{
+		std::scoped_lock lock(m_Mutex);
+		auto it = m_Pins.find(key);
+		if (it == m_Pins.end())
+			return;
+
+		if (--it->second == 0)
+			m_Pins.erase(it);
+		Evict();
+	}
+
+	void DiffCache::Clear()
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Entries.clear();
+		m_Index.clear();
+		m_Bytes.store(0, std::memory_order_relaxed);
+		m_Count.store(0, std::memory_order_relaxed);
+	}
+
+	void DiffCache::SetBudget(size_t bytes)
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Budget.store(bytes, std::memory_order_relaxed);
+		Evict();
+	}
+
+	size_t DiffCache::DiffBytes(const Diff& diff)
+	{
+		size_t bytes = sizeof(Diff) + diff.Patches.capacity() * sizeof(Patch) + BufferBytes(diff);
+		for (const Patch& patch : diff.Patches)
+			bytes += patch.File.capacity();
+
+		return bytes;
+	}
+
+	size_t DiffCache::BufferBytes(const Diff& diff)
+	{
+		return diff.Hunks.capacity() * sizeof(DiffHunk) + diff.Lines.capacity() * sizeof(DiffLine) + diff.Text.capacity();
+	}
+
+	// Oldest first, pinned entries and the newest one are stepped over
+	void DiffCache::Evict()
+	{
+		auto it = m_Entries.end();
+		while (m_Bytes.load(std::memory_order_relaxed) > m_Budget.load(std::memory_order_relaxed) && --it != m_Entries.begin())
+		{
+			if (m_Pins.find(it->Key) != m_Pins.end())
+				continue;
+
+			m_Bytes.fetch_sub(it->Bytes, std::memory_order_relaxed);
+			m_Index.erase(it->Key);
+			it = m_Entries.erase(it);
+		}
+
+		m_Count.store(m_Entries.size(), std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <EASTL/list.h>
+#include <EASTL/shared_ptr.h>
+
+#include "Diff.h"
+#include "OidMap.h"
+
+#define DIFF_CACHE_DEFAULT_BUDGET (64ull * 1024 * 1024)
+
+namespace QuickGit
+{
+	// A diff is fully described by the trees it compares and the options it was printed with,
+	// commits with the same trees share an entry whatever repository they come from
+	struct DiffKey
+	{
+		git_oid OldTree{};
+		git_oid NewTree{};
+		uint32_t ContextLines = 0;
+		uint32_t Flags = 0;
+		// Auto and Minimal share their flags
+		DiffAlgorithm Algorithm = DiffAlgorithm::Auto;
+
+		bool operator==(const DiffKey& other) const
+		{
+			return git_oid_equal(&OldTree, &other.OldTree) && git_oid_equal(&NewTree, &other.NewTree) && ContextLines == other.ContextLines && Flags == other.Flags && Algorithm == other.Algorithm;
+		}
+	};
+
+	struct DiffKeyHash
+	{
+		size_t operator()(const DiffKey& key) const
+		{
+			return static_cast<size_t>(OidPrefix(key.OldTree) ^ (OidPrefix(key.NewTree) * 31) ^ (static_cast<uint64_t>(key.ContextLines) << 32) ^ key.Flags ^ (static_cast<uint64_t>(key.Algorithm) << 24));
+		}
+	};
+
+	// Least recently used generated diffs within a byte budget, shared by the UI and the diff workers.
+	// Diffs are handed out as shared pointers so an evicted diff stays alive while a panel still shows it.
+	class DiffCache
+	{
+	public:
+		DiffCache() = default;
+		DiffCache(const DiffCache&) = delete;
+		DiffCache& operator=(const DiffCache&) = delete;
+
+		// Makes the entry the most recently used
+		eastl::shared_ptr<Diff> Find(const DiffKey& key);
+		// Leaves the order alone
+		bool Contains(const DiffKey& key) const;
+		// Hits and misses are counted by the caller, polling for a diff that is being generated isn't a lookup
+		void CountLookup(bool hit) { (hit ? m_Hits : m_Misses).fetch_add(1, std::memory_order_relaxed); }
+		// The newest entry is kept even when it is larger than the whole budget
+		void Insert(const DiffKey& key, eastl::shared_ptr<Diff> diff);
+		// Accounts for patches filled into a cached diff and for its buffers shrinking when compacted,
+		// nothing happens once the diff was evicted
+		void Charge(const DiffKey& key, const Diff* diff, int64_t bytes);
+		// A pinned entry is never evicted, pins are counted and outlive the entry
+		void Pin(const DiffKey& key);
+		void Unpin(const DiffKey& key);
+		void Clear();
+
+		void SetBudget(size_t bytes);
+		size_t Budget() const { return m_Budget.load(std::memory_order_relaxed); }
+		size_t Bytes() const { return m_Bytes.load(std::memory_order_relaxed); }
+		size_t Count() const { return m_Count.load(std::memory_order_relaxed); }
+		uint64_t Hits() const { return m_Hits.load(std::memory_order_relaxed); }
+		uint64_t Misses() const { return m_Misses.load(std::memory_order_relaxed); }
+
+		static size_t DiffBytes(const Diff& diff);
+		// Hunks, lines and text only, the part that grows as patches are filled in
+		static size_t BufferBytes(const Diff& diff);
+
+	private:
+		struct Entry
+		{
+			DiffKey Key;
+			eastl::shared_ptr<Diff> Value;
+			size_t Bytes;
+		};
+
+		void Evict();
+
+	private:
+		mutable std::mutex m_Mutex;
+		// Most recently used first
+		eastl::list<Entry> m_Entries;
+		eastl::hash_map<DiffKey, eastl::list<Entry>::iterator, DiffKeyHash> m_Index;
+		eastl::hash_map<DiffKey, uint32_t, DiffKeyHash> m_Pins;
+
+		std::atomic<size_t> m_Budget = DIFF_CACHE_DEFAULT_BUDGET;
+		std::atomic<size_t> m_Bytes = 0;
+		std::atomic<size_t> m_Count = 0;
+		std::atomic<uint64_t> m_Hits = 0;
+		std::atomic<uint64_t> m_Misses = 0;
+	};
+}
@@ -0,0 +1,456 @@
+#include "pch.h"
+#include "FileWatcher.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace QuickGit
+{
+	// How long the watch thread blocks before it looks at the stop flag again
+	static constexpr int s_WaitMs = 100;
+
+	static void EnsureTrailingSlash(eastl::string& path)
+	{
+		if (!path.empty() && path.back() != '/')
+			path.push_back('/');
+	}
+
+	// The git directory of the work tree is watched on its own
+	static bool IsGitDirPath(const eastl::string& path)
+	{
+		return path.compare(0, 4, ".git") == 0 && (path.size() == 4 || path[4] == '/');
+	}
+
+	// Only the files git keeps its state of the whole tree in
+	static bool IsIndexFile(const char* name)
+	{
+		return strcmp(name, "index") == 0 || strcmp(name, "HEAD") == 0;
+	}
+
+#ifdef _WIN32
+	static constexpr DWORD s_TreeFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_ATTRIBUTES;
+	static constexpr DWORD s_GitDirFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	static constexpr DWORD s_BufferSize = 64 * 1024;
+
+	static HANDLE OpenDirectory(const eastl::string& path)
+	{
+		const int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+		eastl::vector<wchar_t> widePath(static_cast<size_t>(eastl::max(length, 1)), L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, widePath.data(), length);
+		return CreateFileW(widePath.data(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	}
+
+	static eastl::string ToUtf8Path(const wchar_t* name, int length)
+	{
+		eastl::string path(static_cast<size_t>(WideCharToMultiByte(CP_UTF8, 0, name, length, nullptr, 0, nullptr, nullptr)), '\0');
+		WideCharToMultiByte(CP_UTF8, 0, name, length, path.data(), static_cast<int>(path.size()), nullptr, nullptr);
+		eastl::replace(path.begin(), path.end(), '\\', '/');
+		return path;
+	}
+#else
+	static constexpr uint32_t s_TreeEvents = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR | IN_EXCL_UNLINK;
+	static constexpr uint32_t s_GitDirEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR;
+
+	static bool IsDirectory(const eastl::string& parent, const dirent* entry)
+	{
+		if (entry->d_type != DT_UNKNOWN)
+			return entry->d_type == DT_DIR;
+
+		struct stat info;
+		return lstat((parent + entry->d_name).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+	}
+#endif
+
+	bool FileWatcher::Start(const char* workDir, const char* gitDir)
+	{
+		Stop();
+		if (!workDir || !gitDir)
+			return false;
+
+		m_WorkDir = workDir;
+		m_GitDir = gitDir;
+		EnsureTrailingSlash(m_WorkDir);
+		EnsureTrailingSlash(m_GitDir);
+
+#ifdef _WIN32
+		m_Directories[0] = OpenDirectory(m_WorkDir);
+		m_Directories[1] = OpenDirectory(m_GitDir);
+		if (m_Directories[0] == INVALID_HANDLE_VALUE || m_Directories[1] == INVALID_HANDLE_VALUE)
+		{
+			Stop();
+			return false;
+		}
+#else
+		m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_Inotify < 0)
+			return false;
+
+		// The work tree's watches take a while on a big tree, Run sets those up
+		m_GitDirWatch = inotify_add_watch(m_Inotify, m_GitDir.c_str(), s_GitDirEvents);
+		if (m_GitDirWatch < 0)
+		{
+			Stop();
+			return false;
+		}
+#endif
+
+		m_Stop.store(false, std::memory_order_relaxed);
+		m_Failed.store(false, std::memory_order_relaxed);
+		m_Thread = std::thread(&FileWatcher::Run, this);
+		return true;
+	}
+
+	void FileWatcher::Stop()
+	{
+		m_Stop.store(true, std::memory_order_relaxed);
+		if (m_Thread.joinable())
+			m_Thread.join();
+
+#ifdef _WIN32
+		for (void*& directory : m_Directories)
+		{
+			if (directory && directory != INVALID_HANDLE_VALUE)
+				CloseHandle(directory);
+			directory = nullptr;
+		}
+#else
+		// Closing the instance drops all of its watches
+		if (m_Inotify >= 0)
+			close(m_Inotify);
+		m_Inotify = -1;
+		m_GitDirWatch = -1;
+		m_Watches.clear();
+		m_Tracked.clear();
+#endif
+
+		m_Failed.store(false, std::memory_order_relaxed);
+		std::scoped_lock lock(m_Mutex);
+		m_Paths.clear();
+		m_IndexChanged = false;
+		m_Rescan = false;
+	}
+
+	bool FileWatcher::Poll(WorkTreeChanges& out)
+	{
+		std::scoped_lock lock(m_Mutex);
+		if (m_Paths.empty() && !m_IndexChanged && !m_Rescan)
+			return false;
+
+		const auto now = std::chrono::steady_clock::now();
+		if (now - m_LastChange < std::chrono::milliseconds(FILE_WATCHER_DEBOUNCE_MS) && now - m_FirstChange < std::chrono::milliseconds(FILE_WATCHER_MAX_DELAY_MS))
+			return false;
+
+		out.IndexChanged |= m_IndexChanged;
+		out.Rescan |= m_Rescan;
+		if (!out.Rescan)
+			out.Paths.insert(out.Paths.end(), m_Paths.begin(), m_Paths.end());
+		else
+			out.Paths.clear();
+
+		m_Paths.clear();
+		m_IndexChanged = false;
+		m_Rescan = false;
+		return true;
+	}
+
+	void FileWatcher::Touch()
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (m_Paths.empty() && !m_IndexChanged && !m_Rescan)
+			m_FirstChange = now;
+		m_LastChange = now;
+	}
+
+	void FileWatcher::AddPath(eastl::string path)
+	{
+		std::scoped_lock lock(m_Mutex);
+		Touch();
+		if (m_Rescan)
+			return;
+
+		if (m_Paths.size() >= FILE_WATCHER_MAX_PATHS)
+		{
+			m_Paths.clear();
+			m_Rescan = true;
+			return;
+		}
+
+		m_Paths.insert(eastl::move(path));
+	}
+
+	void FileWatcher::AddIndexChange()
+	{
+		std::scoped_lock lock(m_Mutex);
+		Touch();
+		m_IndexChanged = true;
+	}
+
+	void FileWatcher::AddRescan()
+	{
+		std::scoped_lock lock(m_Mutex);
+		Touch();
+		m_Paths.clear();
+		m_Rescan = true;
+	}
+
+#ifdef _WIN32
+	void FileWatcher::Run()
+	{
+		// Both directories are read at once, the work tree recursively and the git directory on its own
+		OVERLAPPED overlapped[2] = {};
+		HANDLE events[2] = {};
+		eastl::vector<DWORD> buffers[2];
+		const auto read = [&](DWORD i)
+		{
+			ResetEvent(events[i]);
+			return ReadDirectoryChangesW(m_Directories[i], buffers[i].data(), s_BufferSize, i == 0, i == 0 ? s_TreeFilter : s_GitDirFilter, nullptr, &overlapped[i], nullptr) != 0;
+		};
+
+		for (DWORD i = 0; i < 2; ++i)
+		{
+			buffers[i].resize(s_BufferSize / sizeof(DWORD));
+			events[i] = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+			overlapped[i].hEvent = events[i];
+			if (!read(i))
+				AddRescan();
+		}
+
+		while (!m_Stop.load(std::memory_order_relaxed))
+		{
+			const DWORD wait = WaitForMultipleObjects(2, events, FALSE, s_WaitMs);
+			if (wait != WAIT_OBJECT_0 && wait != WAIT_OBJECT_0 + 1)
+				continue;
+
+			const DWORD i = wait - WAIT_OBJECT_0;
+			DWORD size = 0;
+			// No bytes means the buffer overflowed and the changes were lost
+			if (!GetOverlappedResult(m_Directories[i], &overlapped[i], &size, FALSE) || size == 0)
+			{
+				AddRescan();
+			}
+			else
+			{
+				const uint8_t* entry = reinterpret_cast<const uint8_t*>(buffers[i].data());
+				while (true)
+				{
+					const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+					eastl::string path = ToUtf8Path(info->FileName, static_cast<int>(info->FileNameLength / sizeof(WCHAR)));
+					if (i == 1)
+					{
+						if (IsIndexFile(path.c_str()))
+							AddIndexChange();
+					}
+					else if (!IsGitDirPath(path))
+					{
+						AddPath(eastl::move(path));
+					}
+
+					if (!info->NextEntryOffset)
+						break;
+					entry += info->NextEntryOffset;
+				}
+			}
+
+			if (!read(i))
+				AddRescan();
+		}
+
+		for (DWORD i = 0; i < 2; ++i)
+		{
+			DWORD size = 0;
+			if (CancelIoEx(m_Directories[i], &overlapped[i]) || GetLastError() != ERROR_NOT_FOUND)
+				GetOverlappedResult(m_Directories[i], &overlapped[i], &size, TRUE);
+			CloseHandle(events[i]);
+		}
+	}
+#else
+	void FileWatcher::Run()
+	{
+		// Every directory needs a watch of its own, running out of them leaves changes unseen so nothing is watched then
+		bool watching = git_repository_open(&m_Repository, m_GitDir.c_str()) == 0 && WatchTracked();
+		if (watching)
+			AddRescan();
+
+		alignas(inotify_event) char buffer[64 * 1024];
+		while (watching && !m_Stop.load(std::memory_order_relaxed))
+		{
+			pollfd descriptor{ m_Inotify, POLLIN, 0 };
+			if (poll(&descriptor, 1, s_WaitMs) <= 0)
+				continue;
+
+			const ssize_t size = read(m_Inotify, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < size;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					AddRescan();
+					continue;
+				}
+
+				if (event->wd == m_GitDirWatch)
+				{
+					if (event->len && IsIndexFile(event->name))
+						AddIndexChange();
+					// Files added to the index may be in directories that weren't watched so far
+					if (event->len && strcmp(event->name, "index") == 0 && !WatchTracked())
+						watching = false;
+					continue;
+				}
+
+				auto it = m_Watches.find(event->wd);
+				if (it == m_Watches.end())
+					continue;
+
+				if (event->mask & IN_IGNORED)
+				{
+					m_Watches.erase(it);
+					continue;
+				}
+
+				if (!event->len)
+					continue;
+
+				eastl::string path = it->second + event->name;
+				if (IsGitDirPath(path))
+					continue;
+
+				// A directory moved in may already hold files and one moved out keeps its watches under the old path
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & IN_MOVED_FROM)
+						UnwatchTree(path + "/");
+					else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && !WatchTree(path + "/"))
+						watching = false;
+				}
+
+				AddPath(eastl::move(path));
+			}
+		}
+
+		git_repository_free(m_Repository);
+		m_Repository = nullptr;
+		if (watching)
+			return;
+
+		// Dropping thousands of watches takes a while, it's done here rather than in Stop on the UI thread
+		close(m_Inotify);
+		m_Inotify = -1;
+		m_GitDirWatch = -1;
+		m_Watches.clear();
+		m_Failed.store(true, std::memory_order_release);
+	}
+
+	// Adds a watch to a directory of the work tree and every directory under it that holds index entries
+	bool FileWatcher::WatchTree(const eastl::string& directory)
+	{
+		eastl::vector<eastl::string> pending;
+		pending.push_back(directory);
+		while (!pending.empty())
+		{
+			const eastl::string relative = eastl::move(pending.back());
+			pending.pop_back();
+			if (m_Tracked.find(relative) == m_Tracked.end())
+				continue;
+
+			const eastl::string path = m_WorkDir + relative;
+			const int watch = inotify_add_watch(m_Inotify, path.c_str(), s_TreeEvents);
+			if (watch < 0)
+			{
+				// Gone before it was watched, the event of its parent covers it
+				if (errno == ENOENT || errno == ENOTDIR)
+					continue;
+				return false;
+			}
+			m_Watches[watch] = relative;
+
+			DIR* dir = opendir(path.c_str());
+			if (!dir)
+				continue;
+
+			while (const dirent* entry = readdir(dir))
+			{
+				if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || !IsDirectory(path, entry))
+					continue;
+
+				eastl::string child = relative + entry->d_name;
+				if (!IsGitDirPath(child))
+					pending.push_back(child + "/");
+			}
+			closedir(dir);
+		}
+
+		return true;
+	}
+
+	bool FileWatcher::WatchTracked()
+	{
+		git_index* index = nullptr;
+		if (git_repository_index(&index, m_Repository) != 0)
+			return false;
+
+		// Entries are sorted, so a directory's files come one after the other and its parents only need adding once
+		eastl::hash_set<eastl::string> tracked;
+		tracked.insert("");
+		eastl::string last;
+		const bool read = git_index_read(index, false) == 0;
+		for (size_t i = 0, count = read ? git_index_entrycount(index) : 0; i < count; ++i)
+		{
+			const char* path = git_index_get_byindex(index, i)->path;
+			const char* slash = strrchr(path, '/');
+			if (!slash || last.compare(0, last.size(), path, static_cast<size_t>(slash - path + 1)) == 0)
+				continue;
+
+			last.assign(path, slash + 1);
+			for (const char* end = strchr(path, '/'); end; end = strchr(end + 1, '/'))
+				tracked.insert(eastl::string(path, end + 1));
+		}
+		git_index_free(index);
+		if (!read)
+			return false;
+
+		for (const eastl::string& directory : tracked)
+		{
+			if (m_Tracked.find(directory) != m_Tracked.end())
+				continue;
+
+			// Gone before it was watched, the event of its parent covers it coming back
+			const int watch = inotify_add_watch(m_Inotify, (m_WorkDir + directory).c_str(), s_TreeEvents);
+			if (watch >= 0)
+				m_Watches[watch] = directory;
+			else if (errno != ENOENT && errno != ENOTDIR)
+				return false;
+		}
+
+		m_Tracked.swap(tracked);
+		return true;
+	}
+
+	void FileWatcher::UnwatchTree(const eastl::string& directory)
+	{
+		for (auto it = m_Watches.begin(); it != m_Watches.end();)
+		{
+			if (it->second.compare(0, directory.size(), directory) == 0)
+			{
+				inotify_rm_watch(m_Inotify, it->first);
+				it = m_Watches.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+#endif
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <git2.h>
+
+// Quiet time after the last change before a burst is handed out, and the longest a change waits while changes keep coming
+#define FILE_WATCHER_DEBOUNCE_MS 150
+#define FILE_WATCHER_MAX_DELAY_MS 1000
+// More paths than this in one burst ask for a full rescan instead
+#define FILE_WATCHER_MAX_PATHS 4096
+
+namespace QuickGit
+{
+	// Paths relative to the work tree with forward slashes, a directory stands for everything under it
+	struct WorkTreeChanges
+	{
+		eastl::vector<eastl::string> Paths;
+		// Set when the index or HEAD changed, the paths still hold what changed in the work tree
+		bool IndexChanged = false;
+		// Set when events were lost or when there were too many paths
+		bool Rescan = false;
+
+		bool Empty() const { return Paths.empty() && !IndexChanged && !Rescan; }
+
+		void Clear()
+		{
+			Paths.clear();
+			IndexChanged = false;
+			Rescan = false;
+		}
+
+		// Past FILE_WATCHER_MAX_PATHS paths the whole tree is scanned instead
+		void Merge(const WorkTreeChanges& other)
+		{
+			IndexChanged |= other.IndexChanged;
+			Rescan |= other.Rescan || Paths.size() + other.Paths.size() > FILE_WATCHER_MAX_PATHS;
+			if (Rescan)
+				Paths.clear();
+			else
+				Paths.insert(Paths.end(), other.Paths.begin(), other.Paths.end());
+		}
+	};
+
+	// Watches a repository's work tree and git directory on a thread of its own, changes are collected until they settle.
+	// The git directory is only watched for the index and HEAD, whatever else changes under it is ignored.
+	// Where each directory needs a watch of its own, only the directories holding index entries are watched, like StatusScanner
+	// only reads those. The watches are set up on the watcher's thread, which asks for a rescan once they are in place.
+	class FileWatcher
+	{
+	public:
+		FileWatcher() = default;
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+		~FileWatcher() { Stop(); }
+
+		// Returns false when the tree can't be watched as a whole, the caller keeps scanning on its own then
+		bool Start(const char* workDir, const char* gitDir);
+		void Stop();
+		bool IsRunning() const { return m_Thread.joinable(); }
+		// Set once the watcher thread failed to set up a watch, like when it ran out of them. It stopped looking for changes then.
+		bool Failed() const { return m_Failed.load(std::memory_order_acquire); }
+
+		// Moves the changes that settled into out, returns false while there are none
+		bool Poll(WorkTreeChanges& out);
+
+	private:
+		void Run();
+		void AddPath(eastl::string path);
+		void AddIndexChange();
+		void AddRescan();
+		// Called with the mutex held before a change is recorded
+		void Touch();
+#ifndef _WIN32
+		bool WatchTree(const eastl::string& directory);
+		void UnwatchTree(const eastl::string& directory);
+		// Reads which directories hold index entries and watches the ones that didn't before
+		bool WatchTracked();
+#endif
+
+	private:
+		std::thread m_Thread;
+		std::atomic<bool> m_Stop = false;
+		std::atomic<bool> m_Failed = false;
+
+		std::mutex m_Mutex;
+		eastl::hash_set<eastl::string> m_Paths;
+		bool m_IndexChanged = false;
+		bool m_Rescan = false;
+		std::chrono::steady_clock::time_point m_FirstChange;
+		std::chrono::steady_clock::time_point m_LastChange;
+
+		// With trailing slashes
+		eastl::string m_WorkDir;
+		eastl::string m_GitDir;
+
+#ifdef _WIN32
+		// Directory handles of the work tree and the git directory
+		void* m_Directories[2] = {};
+#else
+		int m_Inotify = -1;
+		int m_GitDirWatch = -1;
+		// Work tree directory of each watch, relative and with a trailing slash unless it is the root
+		eastl::hash_map<int, eastl::string> m_Watches;
+		// Directories holding index entries in the same form, whatever is in the others is untracked or ignored
+		eastl::hash_set<eastl::string> m_Tracked;
+		// Opened by the watcher thread, only its index is read
+		git_repository* m_Repository = nullptr;
+#endif
+	};
+}
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "ImGuiLayer.h"
 
+#include <bit>
+
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -15,6 +17,9 @@
 #include <icons/MaterialDesign.inl>
 
 #include "Client.h"
+#include "DateFormatter.h"
+#include "TextSearch.h"
+#include "LogRing.h"
 
 #include "ImGuiExt.h"
 
@@ -23,8 +28,9 @@ namespace QuickGit
 	GLFWwindow* g_Window;
 	char g_Path[2048];
 	static RepoData* s_SelectedRepository = nullptr;
-	static eastl::vector<eastl::string> s_Logs{};
+	static LogRing s_Logs;
 	static eastl::stack<eastl::string> s_GitErrors;
+	static DateFormatter s_DateFormatter;
 
 	ImFont* g_DefaultFont = nullptr;
 	ImFont* g_SmallFont = nullptr;
@@ -217,11 +223,85 @@ namespace QuickGit
 		}
 	}
 
-	// Define a progress callback function
-	void checkout_progress(const char* path, size_t completedSteps, size_t totalSteps, [[maybe_unused]] void* payload)
+	static void QueueCheckout(RepoData* repoData, const char* branch, const git_oid* commit)
+	{
+		Operation operation;
+		operation.Type = branch ? OperationType::BranchCheckout : OperationType::CommitCheckout;
+		if (branch)
+			operation.Branch = branch;
+		else
+			operation.Target = *commit;
+		Client::QueueOperation(repoData, eastl::move(operation));
+	}
+
+	static void QueueReset(RepoData* repoData, const git_oid& commit, git_reset_t resetType)
+	{
+		Operation operation;
+		operation.Type = OperationType::Reset;
+		operation.Target = commit;
+		operation.ResetType = resetType;
+		Client::QueueOperation(repoData, eastl::move(operation));
+	}
+
+	static eastl::string DescribeOperation(const Operation& operation)
 	{
-		if (path)
-			s_Logs.push_back(std::format("\tCheckout progress: {} - {}/{}", path, completedSteps, totalSteps).c_str());
+		char id[COMMIT_SHORT_ID_LEN + 1];
+		git_oid_tostr(id, sizeof(id), &operation.Target);
+		switch (operation.Type)
+		{
+			case OperationType::BranchCheckout:
+			{
+				const size_t prefix = operation.Branch.find(LOCAL_BRANCH_PREFIX) == 0 ? sizeof(LOCAL_BRANCH_PREFIX) - 1 : 0;
+				return std::format("Checkout Branch {}", operation.Branch.c_str() + prefix).c_str();
+			}
+			case OperationType::CommitCheckout:
+				return std::format("Checkout Commit {}", id).c_str();
+			case OperationType::Reset:
+			{
+				const char* resetType = operation.ResetType == GIT_RESET_HARD ? "Hard" : operation.ResetType == GIT_RESET_MIXED ? "Mixed" : "Soft";
+				return std::format("Reset ({}) to {}", resetType, id).c_str();
+			}
+			case OperationType::Commit:
+				return std::format("Commit \"{}\"", operation.Summary.c_str()).c_str();
+		}
+
+		return {};
+	}
+
+	// Set when a commit queued from Local Changes is done
+	static bool s_CommitFinished = false;
+	static bool s_CommitSucceeded = false;
+
+	// Checkout progress is kept in one record instead of a log line per file, it is written by whichever thread checks out
+	struct CheckoutProgress
+	{
+		std::atomic<uint64_t> Completed = 0;
+		std::atomic<uint64_t> Total = 0;
+		std::atomic<int64_t> StartNs = 0;
+		std::atomic<int64_t> LastNs = 0;
+	};
+	static CheckoutProgress s_CheckoutProgress;
+
+	static int64_t GetSteadyNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void checkout_progress([[maybe_unused]] const char* path, size_t completedSteps, size_t totalSteps, [[maybe_unused]] void* payload)
+	{
+		const int64_t now = GetSteadyNs();
+		if (completedSteps == 0)
+			s_CheckoutProgress.StartNs.store(now, std::memory_order_relaxed);
+		s_CheckoutProgress.Total.store(totalSteps, std::memory_order_relaxed);
+		s_CheckoutProgress.LastNs.store(now, std::memory_order_relaxed);
+		const uint64_t previous = s_CheckoutProgress.Completed.exchange(completedSteps, std::memory_order_release);
+
+		// One line once it is done
+		if (totalSteps != 0 && completedSteps == totalSteps && previous != totalSteps)
+		{
+			const double seconds = static_cast<double>(now - s_CheckoutProgress.StartNs.load(std::memory_order_relaxed)) / 1e9;
+			s_Logs.Write(std::format("\tChecked out {} file(s) in {:.2f}s", totalSteps, seconds).c_str());
+		}
 	}
 
 	bool ImGuiInit(const char** args, int count)
@@ -359,11 +439,620 @@ namespace QuickGit
 		}
 	}
 
+	struct DiffMatch
+	{
+		uint32_t Diff;
+		uint32_t Patch;
+		uint32_t Offset;
+		uint32_t Line;
+		uint32_t LineStart;
+	};
+
+	// Find bar of a diff panel, matches are searched again once the query or the diffs change
+	struct DiffSearch
+	{
+		char Query[256]{};
+		size_t QuerySize = 0;
+		bool MatchCase = false;
+		bool Dirty = true;
+
+		// Sorted by diff, patch and offset
+		eastl::vector<DiffMatch> Matches;
+		size_t Current = 0;
+		bool ScrollToCurrent = false;
+	};
+
+	static void UpdateDiffSearch(DiffSearch& search, const Diff* const* diffs, size_t count)
+	{
+		if (!search.Dirty)
+			return;
+
+		search.Dirty = false;
+		search.Matches.clear();
+		search.Current = 0;
+		search.QuerySize = strlen(search.Query);
+		if (search.QuerySize == 0)
+			return;
+
+		eastl::vector<uint32_t> offsets;
+		for (uint32_t d = 0; d < count; ++d)
+		{
+			const Diff& diff = *diffs[d];
+			for (uint32_t p = 0, patchCount = static_cast<uint32_t>(diff.Patches.size()); p < patchCount; ++p)
+			{
+				const Patch& patch = diff.Patches[p];
+				if (patch.Binary)
+					continue;
+
+				offsets.clear();
+				TextSearch::FindAll(diff.PatchText(patch), patch.TextSize, search.Query, search.QuerySize, search.MatchCase, offsets);
+
+				// Matches come in order, the patch's lines are walked alongside them to find the line of each
+				uint32_t line = 0;
+				for (uint32_t offset : offsets)
+				{
+					while (line + 1 < patch.LineCount && diff.Lines[patch.FirstLine + line + 1].Offset - patch.TextOffset <= offset)
+						++line;
+
+					search.Matches.push_back({ d, p, offset, line, diff.Lines[patch.FirstLine + line].Offset - patch.TextOffset });
+				}
+			}
+		}
+	}
+
+	static void ShowDiffSearchBar(DiffSearch& search)
+	{
+		ImGui::PushID(&search);
+
+		int step = 0;
+		ImGui::SetNextItemWidth(ImGui::GetFontSize() * 16.0f);
+		if (ImGui::InputTextWithHint("##Find", "Find in diff", search.Query, sizeof(search.Query), ImGuiInputTextFlags_EnterReturnsTrue))
+		{
+			step = ImGui::GetIO().KeyShift ? -1 : 1;
+			ImGui::SetKeyboardFocusHere(-1);
+		}
+		if (ImGui::IsItemEdited())
+			search.Dirty = true;
+
+		ImGui::SameLine();
+		if (ImGui::Checkbox(reinterpret_cast<const char*>(ICON_MDI_FORMAT_LETTER_CASE), &search.MatchCase))
+			search.Dirty = true;
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Match case");
+
+		ImGui::SameLine();
+		ImGui::BeginDisabled(search.Matches.empty());
+		if (ImGui::Button(reinterpret_cast<const char*>(ICON_MDI_CHEVRON_UP)))
+			step = -1;
+		ImGui::SameLine();
+		if (ImGui::Button(reinterpret_cast<const char*>(ICON_MDI_CHEVRON_DOWN)))
+			step = 1;
+		ImGui::EndDisabled();
+
+		if (step && !search.Matches.empty())
+		{
+			const size_t size = search.Matches.size();
+			search.Current = (search.Current + size + step) % size;
+			search.ScrollToCurrent = true;
+		}
+
+		ImGui::SameLine();
+		if (!search.Matches.empty())
+			ImGui::Text("%zu of %zu", search.Current + 1, search.Matches.size());
+		else if (search.Query[0])
+			ImGui::TextDisabled("No results");
+
+		ImGui::PopID();
+	}
+
+	static eastl::pair<const DiffMatch*, const DiffMatch*> GetPatchMatches(const DiffSearch& search, uint32_t diff, uint32_t patch)
+	{
+		const DiffMatch key{ diff, patch, 0, 0, 0 };
+		return eastl::equal_range(search.Matches.begin(), search.Matches.end(), key, [](const DiffMatch& a, const DiffMatch& b)
+		{
+			return a.Diff != b.Diff ? a.Diff < b.Diff : a.Patch < b.Patch;
+		});
+	}
+
+	static bool IsCurrentMatchIn(const DiffSearch& search, const DiffMatch* begin, const DiffMatch* end)
+	{
+		const DiffMatch* current = search.Matches.begin() + search.Current;
+		return current >= begin && current < end;
+	}
+
+	// Text selected in a diff view, one selection is shared by all views.
+	// Both ends are packed as the patch line in the upper half and the byte within the line in the lower half.
+	struct DiffSelection
+	{
+		ImGuiID View = 0;
+		uint64_t Anchor = 0;
+		uint64_t Cursor = 0;
+
+		uint64_t Begin() const { return eastl::min(Anchor, Cursor); }
+		uint64_t End() const { return eastl::max(Anchor, Cursor); }
+	};
+
+	static DiffSelection s_DiffSelection;
+
+	static uint64_t DiffPosition(uint32_t line, uint32_t byte)
+	{
+		return (static_cast<uint64_t>(line) << 32) | byte;
+	}
+
+	static uint32_t DiffPositionLine(uint64_t position) { return static_cast<uint32_t>(position >> 32); }
+	static uint32_t DiffPositionByte(uint64_t position) { return static_cast<uint32_t>(position); }
+
+	// Views of the same file keep their ID across diffs, a selection made in another diff is pulled back into this patch
+	static uint64_t ClampDiffPosition(const Diff& diff, const Patch& patch, uint64_t position)
+	{
+		const uint32_t line = eastl::min(DiffPositionLine(position), patch.LineCount - 1);
+		return DiffPosition(line, eastl::min(DiffPositionByte(position), diff.Lines[patch.FirstLine + line].Length));
+	}
+
+	// Byte under a position given in cells from the start of the line, a click past the middle of a character lands after it
+	static uint32_t DiffByteAtColumn(const char* text, uint32_t length, float column)
+	{
+		float columns = 0.0f;
+		for (uint32_t i = 0; i < length; ++i)
+		{
+			const uint32_t width = DiffColumnWidth(text[i]);
+			if (width == 0)
+				continue;
+
+			if (columns + width * 0.5f > column)
+				return i;
+
+			columns += static_cast<float>(width);
+		}
+
+		return length;
+	}
+
+	// Bytes of a line covering the cells [firstColumn, lastColumn), a character is never split
+	static void ClipDiffLine(const char* text, uint32_t length, uint32_t firstColumn, uint32_t lastColumn, uint32_t& begin, uint32_t& end, uint32_t& beginColumn)
+	{
+		uint32_t i = 0;
+		uint32_t column = 0;
+		while (i < length && column < firstColumn)
+			column += DiffColumnWidth(text[i++]);
+		while (i < length && DiffColumnWidth(text[i]) == 0)
+			++i;
+
+		begin = i;
+		beginColumn = column;
+		while (i < length && column < lastColumn)
+			column += DiffColumnWidth(text[i++]);
+		while (i < length && DiffColumnWidth(text[i]) == 0)
+			++i;
+
+		end = i;
+	}
+
+	static void CopyDiffSelection(const Diff& diff, const Patch& patch)
+	{
+		const uint64_t begin = ClampDiffPosition(diff, patch, s_DiffSelection.Begin());
+		const uint64_t end = ClampDiffPosition(diff, patch, s_DiffSelection.End());
+
+		eastl::string text;
+		for (uint32_t i = DiffPositionLine(begin), last = DiffPositionLine(end); i <= last; ++i)
+		{
+			const DiffLine& line = diff.Lines[patch.FirstLine + i];
+			const char* lineText = diff.Text.data() + line.Offset;
+			const uint32_t from = i == DiffPositionLine(begin) ? DiffPositionByte(begin) : 0;
+			const uint32_t to = i == last ? DiffPositionByte(end) : line.Length;
+			if (i != DiffPositionLine(begin))
+				text.push_back('\n');
+
+			text.append(lineText + from, lineText + to);
+		}
+
+		ImGui::SetClipboardText(text.c_str());
+	}
+
+	static uint32_t CountDigits(int32_t value)
+	{
+		uint32_t digits = 1;
+		for (; value >= 10; value /= 10)
+			++digits;
+
+		return digits;
+	}
+
+	// Lines are drawn straight into the draw list with the fixed advance of the monospace font, only the rows and columns
+	// inside the clip rect are touched so a frame costs the same for a ten line patch and a hundred thousand line one
+	static void ShowPatchLines(DiffSearch& search, const Diff& diff, const Patch& patch, const DiffMatch* matchBegin, const DiffMatch* matchEnd)
+	{
+		const ImGuiStyle& style = ImGui::GetStyle();
+		const float lineHeight = ImGui::GetTextLineHeight();
+		const float advance = ImGui::CalcTextSize(" ").x;
+
+		// Hunks are in file order, the last one holds the highest line numbers
+		const DiffHunk& lastHunk = diff.Hunks[patch.FirstHunk + patch.HunkCount - 1];
+		const uint32_t digits = CountDigits(eastl::max(lastHunk.OldStart + lastHunk.OldLines, lastHunk.NewStart + lastHunk.NewLines));
+		const float gutterWidth = (digits * 2 + 1) * advance + style.ItemSpacing.x;
+		const float textIndent = gutterWidth + style.ItemSpacing.x;
+
+		// One extra cell leaves room to show a selected line break
+		const ImVec2 contentSize(textIndent + (patch.Columns + 1) * advance, patch.LineCount * lineHeight);
+		const float width = ImGui::GetContentRegionAvail().x;
+		const float height = contentSize.y + (contentSize.x > width ? style.ScrollbarSize : 0.0f);
+
+		// The view scrolls sideways on its own, the panel around it scrolls vertically
+		const DiffMatch* current = search.Matches.begin() + search.Current;
+		const bool scrollToCurrent = search.ScrollToCurrent && current >= matchBegin && current < matchEnd;
+		if (scrollToCurrent)
+		{
+			ImGui::SetScrollFromPosY(ImGui::GetCursorScreenPos().y + current->Line * lineHeight - ImGui::GetWindowPos().y);
+			search.ScrollToCurrent = false;
+		}
+
+		ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, { 0.0f, 0.0f });
+		ImGui::BeginChild(patch.File.c_str(), { width, height }, false, ImGuiWindowFlags_HorizontalScrollbar);
+		ImGui::PopStyleVar();
+
+		const ImGuiID viewID = ImGui::GetID("##Lines");
+		const char* patchText = diff.PatchText(patch);
+		const ImVec2 windowPos = ImGui::GetWindowPos();
+		const float scrollX = ImGui::GetScrollX();
+		const ImVec2 origin(windowPos.x - scrollX + textIndent, ImGui::GetCursorScreenPos().y);
+
+		if (scrollToCurrent)
+		{
+			const float x = DiffTextColumns(patchText + current->LineStart, patchText + current->Offset) * advance;
+			const float visibleWidth = width - textIndent;
+			if (x < scrollX || x > scrollX + visibleWidth - advance)
+				ImGui::SetScrollX(eastl::max(0.0f, x - visibleWidth * 0.5f));
+		}
+
+		ImGui::InvisibleButton("##Lines", contentSize);
+		const bool hovered = ImGui::IsItemHovered();
+		if (hovered)
+			ImGui::SetMouseCursor(ImGuiMouseCursor_TextInput);
+
+		if (ImGui::IsItemActive())
+		{
+			const ImVec2 mouse = ImGui::GetMousePos();
+			const float row = ImFloor((mouse.y - origin.y) / lineHeight);
+			const uint32_t lineIndex = static_cast<uint32_t>(ImClamp(row, 0.0f, static_cast<float>(patch.LineCount - 1)));
+			const DiffLine& line = diff.Lines[patch.FirstLine + lineIndex];
+			const uint64_t position = DiffPosition(lineIndex, DiffByteAtColumn(diff.Text.data() + line.Offset, line.Length, (mouse.x - origin.x) / advance));
+
+			if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+			{
+				s_DiffSelection.Anchor = DiffPosition(lineIndex, 0);
+				s_DiffSelection.Cursor = DiffPosition(lineIndex, line.Length);
+			}
+			else if (ImGui::IsItemActivated())
+			{
+				if (!ImGui::GetIO().KeyShift || s_DiffSelection.View != viewID)
+					s_DiffSelection.Anchor = position;
+
+				s_DiffSelection.Cursor = position;
+			}
+			else if (ImGui::IsMouseDragging(ImGuiMouseButton_Left))
+			{
+				s_DiffSelection.Cursor = position;
+			}
+
+			s_DiffSelection.View = viewID;
+		}
+
+		const bool selected = s_DiffSelection.View == viewID && s_DiffSelection.Anchor != s_DiffSelection.Cursor;
+		if (ImGui::BeginPopupContextItem())
+		{
+			if (ImGui::MenuItem("Copy", "Ctrl+C", false, selected))
+				CopyDiffSelection(diff, patch);
+			if (ImGui::MenuItem("Select All", "Ctrl+A"))
+			{
+				s_DiffSelection = { viewID, 0, DiffPosition(patch.LineCount - 1, diff.Lines[patch.FirstLine + patch.LineCount - 1].Length) };
+			}
+			ImGui::EndPopup();
+		}
+
+		if (s_DiffSelection.View == viewID && ImGui::IsWindowFocused() && ImGui::GetIO().KeyCtrl)
+		{
+			if (selected && ImGui::IsKeyPressed(ImGuiKey_C, false))
+				CopyDiffSelection(diff, patch);
+			if (ImGui::IsKeyPressed(ImGuiKey_A, false))
+				s_DiffSelection = { viewID, 0, DiffPosition(patch.LineCount - 1, diff.Lines[patch.FirstLine + patch.LineCount - 1].Length) };
+		}
+
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		const ImVec2 clipMin = drawList->GetClipRectMin();
+		const ImVec2 clipMax = drawList->GetClipRectMax();
+		const uint32_t firstLine = static_cast<uint32_t>(ImClamp(ImFloor((clipMin.y - origin.y) / lineHeight), 0.0f, static_cast<float>(patch.LineCount)));
+		const uint32_t lastLine = static_cast<uint32_t>(ImClamp(ImCeil((clipMax.y - origin.y) / lineHeight), 0.0f, static_cast<float>(patch.LineCount)));
+		const uint32_t firstColumn = static_cast<uint32_t>(eastl::max(0.0f, ImFloor((clipMin.x - origin.x) / advance)));
+		const uint32_t lastColumn = static_cast<uint32_t>(eastl::max(0.0f, ImCeil((clipMax.x - origin.x) / advance)));
+
+		ImVec4 addedColor = GetPatchStatusColor(GIT_DELTA_ADDED);
+		ImVec4 deletedColor = GetPatchStatusColor(GIT_DELTA_DELETED);
+		addedColor.w = deletedColor.w = 0.2f;
+		const ImU32 addedBackground = ImGui::GetColorU32(addedColor);
+		const ImU32 deletedBackground = ImGui::GetColorU32(deletedColor);
+		const ImU32 headerBackground = ImGui::GetColorU32(ImGuiCol_FrameBg);
+		const ImU32 selectionColor = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
+		const ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+		const ImU32 dimColor = ImGui::GetColorU32(ImGuiCol_TextDisabled);
+
+		const uint64_t selectionBegin = s_DiffSelection.View == viewID ? ClampDiffPosition(diff, patch, s_DiffSelection.Begin()) : 0;
+		const uint64_t selectionEnd = s_DiffSelection.View == viewID ? ClampDiffPosition(diff, patch, s_DiffSelection.End()) : 0;
+
+		// Text scrolls under the line numbers, which stay put at the left edge
+		drawList->PushClipRect({ windowPos.x + gutterWidth, clipMin.y }, clipMax, true);
+		for (uint32_t i = firstLine; i < lastLine; ++i)
+		{
+			const DiffLine& line = diff.Lines[patch.FirstLine + i];
+			const char* text = diff.Text.data() + line.Offset;
+			const float y = origin.y + i * lineHeight;
+
+			ImU32 background = 0;
+			ImU32 color = textColor;
+			switch (line.Origin)
+			{
+				case GIT_DIFF_LINE_ADDITION	: background = addedBackground; break;
+				case GIT_DIFF_LINE_DELETION	: background = deletedBackground; break;
+				case GIT_DIFF_LINE_CONTEXT	: break;
+				case GIT_DIFF_LINE_HUNK_HDR	: background = headerBackground; color = dimColor; break;
+				default						: color = dimColor; break;
+			}
+
+			if (background)
+				drawList->AddRectFilled({ clipMin.x, y }, { clipMax.x, y + lineHeight }, background);
+
+			const uint64_t lineBegin = DiffPosition(i, 0);
+			const uint64_t lineEnd = DiffPosition(i, line.Length);
+			if (selectionBegin != selectionEnd && selectionBegin <= lineEnd && selectionEnd >= lineBegin)
+			{
+				const uint32_t from = selectionBegin > lineBegin ? DiffPositionByte(selectionBegin) : 0;
+				const uint32_t to = selectionEnd < lineEnd ? DiffPositionByte(selectionEnd) : line.Length;
+				const float x0 = origin.x + DiffTextColumns(text, text + from) * advance;
+				float x1 = origin.x + DiffTextColumns(text, text + to) * advance;
+				if (selectionEnd > lineEnd)
+					x1 += advance;
+
+				drawList->AddRectFilled({ x0, y }, { x1, y + lineHeight }, selectionColor);
+			}
+
+			uint32_t begin, end, column;
+			ClipDiffLine(text, line.Length, firstColumn, lastColumn, begin, end, column);
+			if (begin != end)
+				drawList->AddText({ origin.x + column * advance, y }, color, text + begin, text + end);
+		}
+
+		if (matchBegin != matchEnd)
+		{
+			// Matches of a patch are sorted by line, the ones above the clip rect are skipped with a binary search
+			const DiffMatch* match = eastl::lower_bound(matchBegin, matchEnd, firstLine, [](const DiffMatch& m, uint32_t line) { return m.Line < line; });
+			for (; match != matchEnd && match->Line < lastLine; ++match)
+			{
+				const float y = origin.y + match->Line * lineHeight;
+				const float x = origin.x + DiffTextColumns(patchText + match->LineStart, patchText + match->Offset) * advance;
+				const float matchWidth = DiffTextColumns(patchText + match->Offset, patchText + match->Offset + search.QuerySize) * advance;
+				drawList->AddRectFilled({ x, y }, { x + matchWidth, y + lineHeight }, match == current ? IM_COL32(255, 140, 0, 140) : IM_COL32(255, 200, 0, 70));
+			}
+		}
+		drawList->PopClipRect();
+
+		// Old and new line numbers, blank on the side a line doesn't exist
+		drawList->AddRectFilled({ windowPos.x, clipMin.y }, { windowPos.x + gutterWidth, clipMax.y }, ImGui::GetColorU32(ImGuiCol_WindowBg));
+		drawList->AddLine({ windowPos.x + gutterWidth, clipMin.y }, { windowPos.x + gutterWidth, clipMax.y }, ImGui::GetColorU32(ImGuiCol_Separator));
+		for (uint32_t i = firstLine; i < lastLine; ++i)
+		{
+			const DiffLine& line = diff.Lines[patch.FirstLine + i];
+			const float y = origin.y + i * lineHeight;
+			char number[16];
+			if (line.OldLine >= 0)
+			{
+				snprintf(number, sizeof(number), "%*d", static_cast<int>(digits), line.OldLine);
+				drawList->AddText({ windowPos.x, y }, dimColor, number);
+			}
+			if (line.NewLine >= 0)
+			{
+				snprintf(number, sizeof(number), "%*d", static_cast<int>(digits), line.NewLine);
+				drawList->AddText({ windowPos.x + (digits + 1) * advance, y }, dimColor, number);
+			}
+		}
+
+		ImGui::EndChild();
+	}
+
+	// Diffstat after a file's tree node, left out until the worker counted the file. Hovering the node tells the patch's algorithm.
+	static void ShowPatchStats(const Patch& patch)
+	{
+		if (!patch.Counted || patch.Binary)
+			return;
+
+		if (patch.Loaded && ImGui::IsItemHovered())
+			ImGui::SetTooltip("%s diff", DiffAlgorithmName(patch.Algorithm));
+
+		ImGui::SameLine();
+		ImGui::TextColored(GetPatchStatusColor(GIT_DELTA_ADDED), "+%u", patch.Additions);
+		ImGui::SameLine();
+		ImGui::TextColored(GetPatchStatusColor(GIT_DELTA_DELETED), "-%u", patch.Deletions);
+	}
+
+	// Returns true when another algorithm was picked
+	static bool ShowDiffAlgorithmCombo(const char* label, DiffAlgorithm& algorithm)
+	{
+		bool changed = false;
+		if (ImGui::BeginCombo(label, DiffAlgorithmName(algorithm)))
+		{
+			for (DiffAlgorithm option : { DiffAlgorithm::Auto, DiffAlgorithm::Myers, DiffAlgorithm::Patience, DiffAlgorithm::Minimal })
+			{
+				if (ImGui::Selectable(DiffAlgorithmName(option), option == algorithm) && option != algorithm)
+				{
+					algorithm = option;
+					changed = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::IsItemHovered())
+			ImGui::SetTooltip("Auto diffs minimally, big files and diffs that take too long fall back to Myers");
+
+		return changed;
+	}
+
+	// Returns true when more of a truncated patch is asked for
+	static bool ShowPatch(DiffSearch& search, const Diff& diff, const Patch& patch, const DiffMatch* matchBegin, const DiffMatch* matchEnd, float indent)
+	{
+		bool loadMore = false;
+		ImGui::Indent(indent);
+		if (patch.Binary)
+		{
+			ImGui::TextUnformatted("Binary file");
+			if (patch.NewFileSize)
+			{
+				ImGui::Indent(indent);
+				if (patch.OldFileSize)
+				{
+					ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_DELETED));
+					ImGui::Text("Old: %u Bytes", patch.OldFileSize);
+					ImGui::PopStyleColor();
+					ImGui::SameLine(0, indent);
+				}
+
+				ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_ADDED));
+				ImGui::Text("New: %u Bytes", patch.NewFileSize);
+				ImGui::PopStyleColor();
+				ImGui::Unindent(indent);
+			}
+		}
+		else
+		{
+			if (patch.HunkCount)
+				ShowPatchLines(search, diff, patch, matchBegin, matchEnd);
+
+			if (patch.Truncated)
+			{
+				ImGui::TextDisabled("%u of %u hunks, %.1f MB shown", patch.HunkCount, patch.TotalHunks, patch.TextSize / (1024.0f * 1024.0f));
+				ImGui::SameLine();
+				loadMore = ImGui::SmallButton("Load more");
+			}
+		}
+
+		ImGui::Unindent(indent);
+		return loadMore;
+	}
+
+	static bool PassCommitsFilter(const CommitStore& commits, size_t row)
+	{
+		char commitID[COMMIT_ID_LEN];
+		git_oid_tostr(commitID, sizeof(commitID), &commits.Oid(row));
+		return CommitsFilter.PassFilter(commitID) || CommitsFilter.PassFilter(commits.Summary(row)) || CommitsFilter.PassFilter(commits.Author(row));
+	}
+
+	// Rows that can pass the filter, sorted. A row only passes when one of the terms is in it,
+	// false when a term is too short for the index or there are only exclusions and every row has to be checked.
+	static bool CollectFilterCandidates(const CommitStore& commits, eastl::vector<uint32_t>& outRows)
+	{
+		if (CommitsFilter.CountGrep == 0)
+			return false;
+
+		for (const ImGuiTextFilter::ImGuiTextRange& range : CommitsFilter.Filters)
+		{
+			if (range.empty() || range.b[0] == '-')
+				continue;
+
+			if (!commits.Search(range.b, range.e, outRows))
+				return false;
+		}
+
+		eastl::sort(outRows.begin(), outRows.end());
+		outRows.erase(eastl::unique(outRows.begin(), outRows.end()), outRows.end());
+		return true;
+	}
+
+	static void UpdateFilteredRows(RepoData* repoData)
+	{
+		const CommitStore& commits = repoData->Commits;
+		if (repoData->FilteredText != CommitsFilter.InputBuf || repoData->FilteredRevision != commits.Revision() || repoData->FilteredSize > commits.Size())
+		{
+			repoData->FilteredRows.clear();
+			repoData->FilteredText = CommitsFilter.InputBuf;
+			repoData->FilteredRevision = commits.Revision();
+			repoData->FilteredSize = 0;
+
+			// The index narrows a rebuild down to the rows containing the terms, only those are run through the filter
+			eastl::vector<uint32_t> candidates;
+			if (CollectFilterCandidates(commits, candidates))
+			{
+				for (uint32_t row : candidates)
+				{
+					if (PassCommitsFilter(commits, row))
+						repoData->FilteredRows.push_back(row);
+				}
+
+				repoData->FilteredSize = commits.Size();
+			}
+		}
+
+		// Rows appended since the last update are few, they are checked directly
+		for (size_t i = repoData->FilteredSize, size = commits.Size(); i < size; ++i)
+		{
+			if (PassCommitsFilter(commits, i))
+				repoData->FilteredRows.push_back(static_cast<uint32_t>(i));
+		}
+
+		repoData->FilteredSize = commits.Size();
+	}
+
+	static constexpr ImU32 s_LaneColors[] =
+	{
+		IM_COL32(0, 145, 255, 255),
+		IM_COL32(255, 160, 0, 255),
+		IM_COL32(80, 200, 120, 255),
+		IM_COL32(230, 80, 160, 255),
+		IM_COL32(150, 120, 255, 255),
+		IM_COL32(0, 200, 200, 255),
+		IM_COL32(240, 220, 60, 255),
+		IM_COL32(255, 100, 90, 255)
+	};
+
+	static ImU32 LaneColor(uint32_t lane)
+	{
+		return s_LaneColors[lane % IM_ARRAYSIZE(s_LaneColors)];
+	}
+
+	// Lanes passing the row run straight through it, lanes ending or starting at the commit bend into its node
+	static void DrawCommitLanes(const LaneLayout::RowLanes& row, const ImVec2& rowMin, float laneWidth, float rowHeight)
+	{
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		const float thickness = eastl::max(1.0f, laneWidth * 0.12f);
+		const float top = rowMin.y;
+		const float bottom = rowMin.y + rowHeight;
+		auto laneX = [&](uint32_t lane) { return rowMin.x + (static_cast<float>(lane) + 0.5f) * laneWidth; };
+
+		for (uint64_t lanes = row.Before & ~row.In; lanes; lanes &= lanes - 1)
+		{
+			const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+			drawList->AddLine({ laneX(lane), top }, { laneX(lane), bottom }, LaneColor(lane), thickness);
+		}
+
+		if (row.Lane == LaneLayout::NoLane)
+			return;
+
+		const ImVec2 node = { laneX(row.Lane), top + rowHeight * 0.5f };
+		for (uint64_t lanes = row.In; lanes; lanes &= lanes - 1)
+		{
+			const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+			drawList->AddLine({ laneX(lane), top }, node, LaneColor(lane), thickness);
+		}
+
+		for (uint64_t lanes = row.Out; lanes; lanes &= lanes - 1)
+		{
+			const uint32_t lane = static_cast<uint32_t>(std::countr_zero(lanes));
+			drawList->AddLine(node, { laneX(lane), bottom }, LaneColor(lane), thickness);
+		}
+
+		drawList->AddCircleFilled(node, laneWidth * 0.3f, LaneColor(row.Lane));
+	}
+
 	struct Commit
 	{
-		git_commit* CommitPtr = nullptr;
 		char CommitID[41];
-		UUID ID;
+		git_oid ID{};
 
 		eastl::string AuthorName;
 		eastl::string AuthorEmail;
@@ -383,11 +1072,9 @@ namespace QuickGit
 
 	void GetCommit(git_commit* commit, Commit* out)
 	{
-		out->CommitPtr = commit;
-
 		const git_oid* oid = git_commit_id(commit);
 		strncpy_s(out->CommitID, git_oid_tostr_s(oid), sizeof(out->CommitID) - 1);
-		out->ID = Utils::GenUUID(commit);
+		out->ID = *oid;
 
 		const git_signature* author = git_commit_author(commit);
 		const git_signature* committer = git_commit_committer(commit);
@@ -396,25 +1083,16 @@ namespace QuickGit
 
 		out->AuthorName = author->name;
 		out->AuthorEmail = author->email;
-		char sign = committer->when.offset >= 0 ? '+' : '-';
-		out->AuthorTimezoneOffset = std::format("{}{:02d}:{:02d}", sign, abs(author->when.offset) / 60, author->when.offset % 60).c_str();
-
-		git_time_t timestamp = author->when.time;
-		tm localTime;
-		localtime_s(&localTime, &timestamp);
-		char dateTime[COMMIT_DATE_LEN];
-		strftime(dateTime, sizeof(dateTime), "%d %b %Y %H:%M:%S", &localTime);
-		out->AuthorDateTime = dateTime;
+		char offset[8];
+		DateFormatter::FormatOffset(author->when.offset, offset, sizeof(offset));
+		out->AuthorTimezoneOffset = offset;
+		out->AuthorDateTime = s_DateFormatter.FormatLocal(author->when.time);
 
 		out->CommitterName = committer->name;
 		out->CommitterEmail = committer->email;
-		sign = committer->when.offset >= 0 ? '+' : '-';
-		out->CommitterTimezoneOffset = std::format("{}{:02d}:{:02d}", sign, abs(committer->when.offset) / 60, committer->when.offset % 60).c_str();
-
-		timestamp = committer->when.time;
-		localtime_s(&localTime, &timestamp);
-		strftime(dateTime, sizeof(dateTime), "%d %b %Y %H:%M:%S", &localTime);
-		out->CommitterDateTime = dateTime;
+		DateFormatter::FormatOffset(committer->when.offset, offset, sizeof(offset));
+		out->CommitterTimezoneOffset = offset;
+		out->CommitterDateTime = s_DateFormatter.FormatLocal(committer->when.time);
 
 		out->Message = commitSummary ? commitSummary : "";
 		out->Description = commitDesc ? commitDesc : "";
@@ -520,7 +1198,6 @@ namespace QuickGit
 		{
 			None = 0,
 			BranchCreate,
-			BranchCheckout,
 			BranchRename,
 			BranchReset,
 			BranchDelete,
@@ -529,7 +1206,7 @@ namespace QuickGit
 
 		Action action = Action::None;
 		static git_reference* selectedBranch = nullptr;
-		CommitData* selectedCommit = nullptr;
+		int64_t selectedCommit = -1;
 
 		ImGuiExt::Begin(repoData->Name.c_str(), opened);
 
@@ -559,15 +1236,14 @@ namespace QuickGit
 				ImGui::TextUnformatted(repoData->Filepath.c_str());
 				ImGui::Text("%u", repoData->UncommittedFiles);
 				ImGui::Text("%u", repoData->Branches.size());
-				ImGui::Text("%u", repoData->Commits.size());
+				ImGui::Text("%u", repoData->Commits.Size());
 				if (repoData->HeadBranch)
 				{
 					ImGui::TextUnformatted(repoData->Branches.at(repoData->HeadBranch).ShortName());
 				}
 				else
 				{
-					uint64_t commitIndex = repoData->CommitsIndexMap.at(repoData->Head);
-					ImGui::Text("%s (Detached)", repoData->Commits.at(commitIndex).CommitID);
+					ImGui::Text("%s (Detached)", git_oid_tostr_s(&repoData->Head));
 				}
 
 				ImGui::EndTable();
@@ -594,7 +1270,7 @@ namespace QuickGit
 			ImGui::SameLine();
 			if (ImGui::Button(reinterpret_cast<const char*>(ICON_MDI_REFRESH)))
 			{
-				Client::Fill(repoData, repoData->Repository);
+				Client::Refresh(repoData);
 			}
 
 			const float cursorPosX = ImGui::GetCursorPosX();
@@ -616,12 +1292,18 @@ namespace QuickGit
 
 			const float lineHeightWithSpacing = ImGui::GetTextLineHeightWithSpacing();
 
-			constexpr uint32_t maxRows = 25000;
-			constexpr uint32_t startPage = 0;
-			const uint32_t totalPages = static_cast<uint32_t>(repoData->Commits.size()) / maxRows;
-			static uint32_t currentPage = 0;
-			if (totalPages > 1)
-				ImGui::SliderScalar("Pages", ImGuiDataType_U32, &currentPage, &startPage, &totalPages);
+			CommitStore& commits = repoData->Commits;
+			const int64_t headRow = commits.Find(repoData->Head);
+			if (git_oid_is_zero(&repoData->SelectedCommit) && headRow >= 0)
+				repoData->SelectedCommit = repoData->Head;
+
+			const bool filtered = CommitsFilter.IsActive();
+			if (filtered)
+				UpdateFilteredRows(repoData);
+
+			// Only rows appended since the last frame are laid out
+			LaneLayout& lanes = repoData->Lanes;
+			lanes.Update(commits);
 
 			ImGui::Unindent();
 			ImGui::Spacing();
@@ -631,230 +1313,264 @@ namespace QuickGit
 			ImGui::PushStyleColor(ImGuiCol_Header, { 0.000f, 0.439f, 0.878f, 0.824f });
 			ImGui::PushStyleColor(ImGuiCol_HeaderActive, { 0.000f, 0.439f, 0.878f, 0.824f });
 			ImGui::PushStyleColor(ImGuiCol_HeaderHovered, { 0.000f, 0.539f, 0.900f, 0.824f });
-			if (ImGui::BeginTable(repoData->Name.c_str(), 4, tableFlags))
+			const float laneWidth = ImGui::GetTextLineHeight() * 0.75f;
+			const float rowHeight = ImGui::GetTextLineHeight() + cellPadding.y * 2.0f;
+			eastl::vector<LaneLayout::RowLanes> visibleLanes;
+
+			if (ImGui::BeginTable(repoData->Name.c_str(), 5, tableFlags))
 			{
+				ImGui::TableSetupColumn("Graph", columnFlags | ImGuiTableColumnFlags_WidthFixed);
 				ImGui::TableSetupColumn("Message", columnFlags);
 				ImGui::TableSetupColumn("AuthorName", columnFlags | ImGuiTableColumnFlags_WidthFixed);
 				ImGui::TableSetupColumn("CommitID", columnFlags | ImGuiTableColumnFlags_WidthFixed);
 				ImGui::TableSetupColumn("AuthorDate", columnFlags | ImGuiTableColumnFlags_WidthFixed);
 
-				bool disabled = true;
-				uint32_t start = maxRows * currentPage;
-				uint32_t end = start + (currentPage == totalPages ? static_cast<uint32_t>(repoData->Commits.size()) % maxRows : maxRows);
-				for (uint32_t i = start; i < end; ++i)
-				{
-					CommitData& data = repoData->Commits[i];
-
-					if (CommitsFilter.IsActive() && !(CommitsFilter.PassFilter(data.CommitID) || CommitsFilter.PassFilter(data.Message) || CommitsFilter.PassFilter(data.AuthorName)))
-						continue;
+				uint32_t firstVisible = UINT32_MAX;
+				uint32_t lastVisible = 0;
 
-					ImGui::TableNextRow();
-					ImGui::TableNextColumn();
+				// Only the rows in view are laid out, the filtered view scrolls through the matching rows
+				ImGuiListClipper clipper;
+				clipper.Begin(static_cast<int>(filtered ? repoData->FilteredRows.size() : commits.Size()));
+				while (clipper.Step())
+				{
+					// The filtered view skips rows so its lanes don't connect, only the nodes are drawn there
+					if (!filtered)
+						lanes.GetRows(static_cast<size_t>(clipper.DisplayStart), static_cast<size_t>(clipper.DisplayEnd), visibleLanes);
 
-					if (repoData->BranchHeads.find(data.ID) != repoData->BranchHeads.end())
+					for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
 					{
-						eastl::vector<git_reference*>& branchHeads = repoData->BranchHeads.at(data.ID);
-						for (git_reference* branch : branchHeads)
+						const uint32_t i = filtered ? repoData->FilteredRows[row] : static_cast<uint32_t>(row);
+						const git_oid& id = commits.Oid(i);
+						const char* summary = commits.Summary(i);
+						const char* authorName = commits.Author(i);
+						char commitID[COMMIT_ID_LEN];
+						git_oid_tostr(commitID, sizeof(commitID), &id);
+
+						ImGui::TableNextRow(ImGuiTableRowFlags_None, rowHeight);
+						ImGui::TableNextColumn();
+
+						const ImVec2 rowMin = ImGui::GetCursorScreenPos() - ImVec2(0.0f, cellPadding.y);
+						ImGui::Dummy({ laneWidth * static_cast<float>(eastl::max(lanes.Width(), 1u)), ImGui::GetTextLineHeight() });
+						if (!filtered)
+						{
+							DrawCommitLanes(visibleLanes[static_cast<size_t>(row - clipper.DisplayStart)], rowMin, laneWidth, rowHeight);
+						}
+						else if (lanes.Lane(i) != LaneLayout::NoLane)
 						{
-							const bool isHeadBranch = branch == repoData->HeadBranch;
-							BranchData& branchData = repoData->Branches.at(branch);
-							const char* branchName = branchData.ShortName();
+							const ImVec2 node = { rowMin.x + (static_cast<float>(lanes.Lane(i)) + 0.5f) * laneWidth, rowMin.y + rowHeight * 0.5f };
+							ImGui::GetWindowDrawList()->AddCircleFilled(node, laneWidth * 0.3f, LaneColor(lanes.Lane(i)));
+						}
 
-							if (isHeadBranch)
-							{
-								ImGui::PushFont(g_BoldFont);
-								ImVec2 size = ImGui::CalcTextSize(branchName);
-								size.x += lineHeightWithSpacing;
-								ImGuiExt::FramedText(size, branchData.Color, true, 2.0f, "%s%s", ICON_MDI_CHECK_ALL, branchName);
-								ImGui::PopFont();
-								ImGui::SameLine(0, ImGui::GetTextLineHeight());
-							}
-							else
+						ImGui::TableNextColumn();
+
+						if (eastl::vector<git_reference*>* branchHeads = repoData->BranchHeads.Find(id))
+						{
+							for (git_reference* branch : *branchHeads)
 							{
-								ImGuiExt::FramedTextUnformatted({ 0, 0 }, branchData.Color, true, 2.0f, branchName);
-								ImGui::SameLine(0, lineHeightWithSpacing * 0.5f);
+								const bool isHeadBranch = branch == repoData->HeadBranch;
+								BranchData& branchData = repoData->Branches.at(branch);
+								const char* branchName = branchData.ShortName();
+
+								if (isHeadBranch)
+								{
+									ImGui::PushFont(g_BoldFont);
+									ImVec2 size = ImGui::CalcTextSize(branchName);
+									size.x += lineHeightWithSpacing;
+									ImGuiExt::FramedText(size, branchData.Color, true, 2.0f, "%s%s", ICON_MDI_CHECK_ALL, branchName);
+									ImGui::PopFont();
+									ImGui::SameLine(0, ImGui::GetTextLineHeight());
+								}
+								else
+								{
+									ImGuiExt::FramedTextUnformatted({ 0, 0 }, branchData.Color, true, 2.0f, branchName);
+									ImGui::SameLine(0, lineHeightWithSpacing * 0.5f);
+								}
 							}
 						}
-					}
 
-					const bool isHead = data.ID == repoData->Head;
-					if (repoData->SelectedCommit == 0 && isHead)
-						repoData->SelectedCommit = data.ID;
-					bool selected = repoData->SelectedCommit == data.ID;
-					ImGui::PushID(&data.ID);
-					if (ImGui::Selectable("##CommitSelectable", &selected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowOverlap))
-					{
-						s_SelectedRepository = repoData;
-						repoData->SelectedCommit = data.ID;
-					}
+						const bool isHead = static_cast<int64_t>(i) == headRow;
+						// Commits newer than HEAD are shown disabled
+						const bool disabled = headRow < 0 || static_cast<int64_t>(i) < headRow;
+						bool selected = git_oid_equal(&repoData->SelectedCommit, &id);
+						ImGui::PushID(static_cast<int>(i));
+						if (ImGui::Selectable("##CommitSelectable", &selected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowOverlap))
+						{
+							s_SelectedRepository = repoData;
+							repoData->SelectedCommit = id;
+						}
 
-					if (!selected && ImGui::IsItemHovered() && ImGui::IsMouseReleased(1))
-					{
-						selected = true;
-						s_SelectedRepository = repoData;
-						repoData->SelectedCommit = data.ID;
-					}
-					ImGui::PopID();
+						if (!selected && ImGui::IsItemHovered() && ImGui::IsMouseReleased(1))
+						{
+							selected = true;
+							s_SelectedRepository = repoData;
+							repoData->SelectedCommit = id;
+						}
+						const bool rowVisible = ImGui::IsItemVisible();
+						ImGui::PopID();
 
-					if (disabled && isHead)
-						disabled = false;
+						if (rowVisible)
+						{
+							firstVisible = eastl::min(firstVisible, i);
+							lastVisible = i + 1;
+						}
 
-					if (isHead)	ImGui::PushFont(g_BoldFont);
-					if (selected) ImGui::PushStyleColor(ImGuiCol_Text, { 0.9f, 0.9f, 0.9f, 1.0f });
-					ImGui::BeginDisabled(disabled);
+						if (isHead)	ImGui::PushFont(g_BoldFont);
+						if (selected) ImGui::PushStyleColor(ImGuiCol_Text, { 0.9f, 0.9f, 0.9f, 1.0f });
+						ImGui::BeginDisabled(disabled);
 					
-					ImGui::SameLine();
-					float textSize = ImGui::CalcTextSize(data.Message).x;
-					textSize -= data.MessageSize == COMMIT_MSG_LEN - 1 ? 5.0f : 0.0f;
-					ImGuiExt::TextEllipsis(data.Message, { textSize, 0 });
-					ImGui::TableNextColumn();
-					ImGui::TextUnformatted(data.AuthorName);
-					ImGui::TableNextColumn();
-					ImGui::TextUnformatted(data.CommitID, data.CommitID + COMMIT_SHORT_ID_LEN);
-					ImGui::TableNextColumn();
-					ImGui::TextUnformatted(data.AuthorDate, data.AuthorDate + strlen(data.AuthorDate) - 3);
+						ImGui::SameLine();
+						float textSize = ImGui::CalcTextSize(summary).x;
+						textSize -= strlen(summary) == COMMIT_MSG_LEN - 1 ? 5.0f : 0.0f;
+						ImGuiExt::TextEllipsis(summary, { textSize, 0 });
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(authorName);
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(commitID, commitID + COMMIT_SHORT_ID_LEN);
+						ImGui::TableNextColumn();
+						// Formatted only for rows in view and cached, seconds are left out
+						const char* authorDate = s_DateFormatter.FormatLocal(commits.Time(i));
+						ImGui::TextUnformatted(authorDate, authorDate + strlen(authorDate) - 3);
 
-					ImGui::EndDisabled();
-					if (selected) ImGui::PopStyleColor();
-					if (isHead)	ImGui::PopFont();
+						ImGui::EndDisabled();
+						if (selected) ImGui::PopStyleColor();
+						if (isHead)	ImGui::PopFont();
 
-					if (selected)
-					{
-						if (ImGui::IsWindowHovered() && ImGui::IsMouseReleased(1))
-							ImGui::OpenPopup("CommitPopup", ImGuiPopupFlags_NoOpenOverExistingPopup);
-						if (ImGui::BeginPopup("CommitPopup"))
+						if (selected)
 						{
-							if (repoData->BranchHeads.find(data.ID) != repoData->BranchHeads.end())
+							if (ImGui::IsWindowHovered() && ImGui::IsMouseReleased(1))
+								ImGui::OpenPopup("CommitPopup", ImGuiPopupFlags_NoOpenOverExistingPopup);
+							if (ImGui::BeginPopup("CommitPopup"))
 							{
-								eastl::vector<git_reference*>& branchHeads = repoData->BranchHeads.at(data.ID);
-								for (git_reference* branch : branchHeads)
+								git_commit* commit = Client::LookupCommit(repoData, i);
+								if (eastl::vector<git_reference*>* branchHeads = repoData->BranchHeads.Find(id))
 								{
-									BranchData& branchData = repoData->Branches.at(branch);
-									if (ImGui::BeginMenu(branchData.ShortName()))
+									for (git_reference* branch : *branchHeads)
 									{
-										if (branchData.Type == BranchType::Local)
+										BranchData& branchData = repoData->Branches.at(branch);
+										if (ImGui::BeginMenu(branchData.ShortName()))
 										{
-											if (ImGui::MenuItem("Checkout"))
-											{
-												action = Action::BranchCheckout;
-												s_Logs.push_back(std::format("Checkout Branch: {}", branchData.ShortName()).c_str());
-
-												if (!Client::BranchCheckout(branch))
-													RegisterLastGitError();
-											}
-											ImGui::Separator();
-											if (ImGui::MenuItem("Rename"))
+											if (branchData.Type == BranchType::Local)
 											{
-												action = Action::BranchRename;
-												selectedBranch = branch;
+												if (ImGui::MenuItem("Checkout"))
+												{
+													s_Logs.Write(std::format("Checkout Branch: {}", branchData.ShortName()).c_str());
+													QueueCheckout(repoData, branchData.Name.c_str(), nullptr);
+												}
+												ImGui::Separator();
+												if (ImGui::MenuItem("Rename"))
+												{
+													action = Action::BranchRename;
+													selectedBranch = branch;
+												}
+												ImGui::BeginDisabled(repoData->HeadBranch == branch);
+												if (ImGui::MenuItem("Delete"))
+												{
+													action = Action::BranchDelete;
+													selectedBranch = branch;
+												}
+												ImGui::EndDisabled();
 											}
-											ImGui::BeginDisabled(repoData->HeadBranch == branch);
-											if (ImGui::MenuItem("Delete"))
+											if (ImGui::MenuItem("Copy Branch Name"))
 											{
-												action = Action::BranchDelete;
-												selectedBranch = branch;
+												ImGui::SetClipboardText(branchData.ShortName());
 											}
-											ImGui::EndDisabled();
-										}
-										if (ImGui::MenuItem("Copy Branch Name"))
-										{
-											ImGui::SetClipboardText(branchData.ShortName());
-										}
 
-										ImGui::EndMenu();
+											ImGui::EndMenu();
+										}
 									}
+									ImGui::Separator();
+								}
+								// Items that need the commit object are disabled when it can't be looked up
+								if (ImGui::MenuItem("New Branch", nullptr, false, commit != nullptr))
+								{
+									action = Action::BranchCreate;
 								}
-								ImGui::Separator();
-							}
-							if (ImGui::MenuItem("New Branch"))
-							{
-								action = Action::BranchCreate;
-							}
 
-							if (repoData->HeadBranch && !isHead)
-							{
-								char resetString[512];
-								snprintf(resetString, 512, "Reset \"%s\" to here...", repoData->Branches.at(repoData->HeadBranch).ShortName());
-								ImGui::Separator();
-								if (ImGui::BeginMenu(resetString))
+								if (repoData->HeadBranch && !isHead)
 								{
-									if (ImGui::MenuItem("Soft (Move the head to the given commit)"))
+									char resetString[512];
+									snprintf(resetString, 512, "Reset \"%s\" to here...", repoData->Branches.at(repoData->HeadBranch).ShortName());
+									ImGui::Separator();
+									if (ImGui::BeginMenu(resetString))
 									{
-										if (!Client::BranchReset(repoData, data.Commit, GIT_RESET_SOFT))
-											RegisterLastGitError();
+										if (ImGui::MenuItem("Soft (Move the head to the given commit)"))
+										{
+											QueueReset(repoData, id, GIT_RESET_SOFT);
 
-										action = Action::BranchReset;
-									}
-									if (ImGui::MenuItem("Mixed (Soft + reset index to the commit)"))
-									{
-										if (!Client::BranchReset(repoData, data.Commit, GIT_RESET_MIXED))
-											RegisterLastGitError();
+											action = Action::BranchReset;
+										}
+										if (ImGui::MenuItem("Mixed (Soft + reset index to the commit)"))
+										{
+											QueueReset(repoData, id, GIT_RESET_MIXED);
 
-										action = Action::BranchReset;
-									}
-									if (ImGui::MenuItem("Hard (Mixed + changes in working tree discarded)"))
-									{
-										if (!Client::BranchReset(repoData, data.Commit, GIT_RESET_HARD))
-											RegisterLastGitError();
+											action = Action::BranchReset;
+										}
+										if (ImGui::MenuItem("Hard (Mixed + changes in working tree discarded)"))
+										{
+											QueueReset(repoData, id, GIT_RESET_HARD);
+
+											action = Action::BranchReset;
+										}
 
-										action = Action::BranchReset;
+										ImGui::EndMenu();
 									}
+								}
 
-									ImGui::EndMenu();
+								ImGui::Separator();
+								if (ImGui::MenuItem("Checkout Commit"))
+								{
+									action = Action::CommitCheckout;
+								}
+								if (ImGui::MenuItem("Copy as Patch", nullptr, false, commit != nullptr))
+								{
+									eastl::string patch;
+									if (Client::CreatePatch(commit, patch))
+										ImGui::SetClipboardText(patch.c_str());
+									else
+										RegisterLastGitError();
 								}
-							}
 
-							ImGui::Separator();
-							if (ImGui::MenuItem("Checkout Commit"))
-							{
-								action = Action::CommitCheckout;
-							}
-							if (ImGui::MenuItem("Copy as Patch"))
-							{
-								eastl::string patch;
-								if (Client::CreatePatch(data.Commit, patch))
-									ImGui::SetClipboardText(patch.c_str());
-								else
+								ImGui::Separator();
+								if (ImGui::MenuItem("Copy Commit SHA"))
+								{
+									ImGui::SetClipboardText(commitID);
+								}
+								if (ImGui::MenuItem("Copy Commit Info", nullptr, false, commit != nullptr))
+								{
+									Commit c;
+									GetCommit(commit, &c);
+									char shortSHA[8];
+									strncpy_s(shortSHA, c.CommitID, COMMIT_SHORT_ID_LEN);
+									eastl::string info = "SHA: ";
+									info += shortSHA;
+									info += "\nAuthor: ";
+									info += c.AuthorName;
+									info += " (";
+									info += c.AuthorEmail;
+									info += ")\nDate: ";
+									info += c.AuthorDateTime;
+									info += "\nMessage: ";
+									info += c.Message;
+									info += "\n";
+									info += c.Description;
+									ImGui::SetClipboardText(info.c_str());
+								}
+								if (ImGui::MenuItem("Simulate Error"))
+								{
+									git_error_set(GIT_ERROR_NONE, "Simulated Error: %s", summary);
 									RegisterLastGitError();
-							}
+								}
 
-							ImGui::Separator();
-							if (ImGui::MenuItem("Copy Commit SHA"))
-							{
-								ImGui::SetClipboardText(data.CommitID);
+								ImGui::EndPopup();
 							}
-							if (ImGui::MenuItem("Copy Commit Info"))
-							{
-								Commit c;
-								GetCommit(data.Commit, &c);
-								char shortSHA[8];
-								strncpy_s(shortSHA, c.CommitID, COMMIT_SHORT_ID_LEN);
-								eastl::string info = "SHA: ";
-								info += shortSHA;
-								info += "\nAuthor: ";
-								info += c.AuthorName;
-								info += " (";
-								info += c.AuthorEmail;
-								info += ")\nDate: ";
-								info += c.AuthorDateTime;
-								info += "\nMessage: ";
-								info += c.Message;
-								info += "\n";
-								info += c.Description;
-								ImGui::SetClipboardText(info.c_str());
-							}
-							if (ImGui::MenuItem("Simulate Error"))
-							{
-								git_error_set(GIT_ERROR_NONE, "Simulated Error: %s", data.Message);
-								RegisterLastGitError();
-							}
-
-							ImGui::EndPopup();
 						}
 					}
 				}
 
 				ImGui::EndTable();
+
+				if (firstVisible < lastVisible)
+					Client::PrefetchCommits(repoData, firstVisible, lastVisible);
 			}
 			ImGui::PopStyleColor(3);
 			ImGui::PopStyleVar();
@@ -862,11 +1578,14 @@ namespace QuickGit
 			ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, { 16.0f, 16.0f });
 
 			char invalidNameError[] = "Branch name is invalid!";
-			auto it = repoData->CommitsIndexMap.find(repoData->SelectedCommit);
-			if (it != repoData->CommitsIndexMap.end())
-				selectedCommit = &(repoData->Commits[it->second]);
-			if (selectedCommit)
+			selectedCommit = repoData->Commits.Find(repoData->SelectedCommit);
+			if (selectedCommit >= 0)
 			{
+				const char* selectedSummary = commits.Summary(selectedCommit);
+				git_commit* selectedHandle = Client::LookupCommit(repoData, selectedCommit);
+				char selectedCommitID[COMMIT_ID_LEN];
+				git_oid_tostr(selectedCommitID, sizeof(selectedCommitID), &commits.Oid(selectedCommit));
+
 				if (action == Action::BranchCreate)
 				{
 					ImGui::OpenPopup("Create Branch");
@@ -875,10 +1594,6 @@ namespace QuickGit
 				{
 					ImGui::OpenPopup("Rename Branch");
 				}
-				if (action == Action::BranchCheckout)
-				{
-					Client::UpdateHead(*repoData);
-				}
 				if (action == Action::BranchDelete)
 				{
 					ImGui::OpenPopup("Delete Branch");
@@ -888,8 +1603,8 @@ namespace QuickGit
 					ImGui::OpenPopup("Checkout Commit");
 				}
 
-				float commitMessageTextSize = ImGui::CalcTextSize(selectedCommit->Message).x;
-				if (selectedCommit->MessageSize == COMMIT_MSG_LEN - 1)
+				float commitMessageTextSize = ImGui::CalcTextSize(selectedSummary).x;
+				if (strlen(selectedSummary) == COMMIT_MSG_LEN - 1)
 					commitMessageTextSize -= 20.0f;
 				commitMessageTextSize = eastl::max(commitMessageTextSize, 700.0f);
 
@@ -907,9 +1622,9 @@ namespace QuickGit
 
 						ImGui::TextUnformatted("Create Branch at:");
 						ImGui::TableNextColumn();
-						ImGui::Text("%s %.*s", ICON_MDI_SOURCE_COMMIT, COMMIT_SHORT_ID_LEN, selectedCommit->CommitID);
+						ImGui::Text("%s %.*s", ICON_MDI_SOURCE_COMMIT, COMMIT_SHORT_ID_LEN, selectedCommitID);
 						ImGui::SameLine();
-						ImGuiExt::TextEllipsis(selectedCommit->Message);
+						ImGuiExt::TextEllipsis(selectedSummary);
 
 						ImGui::TableNextRow();
 						ImGui::TableNextColumn();
@@ -933,22 +1648,19 @@ namespace QuickGit
 
 						ImGui::Spacing();
 						ImGui::SetCursorPosX(ImGui::GetCursorPosX() + ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize("Create Cancel").x - lineHeightWithSpacing);
-						ImGui::BeginDisabled(branchName[0] == 0);
+						ImGui::BeginDisabled(branchName[0] == 0 || !selectedHandle);
 						if (ImGui::Button("Create"))
 						{
 							bool validName = false;
-							git_reference* branch = Client::BranchCreate(repoData, branchName, selectedCommit->Commit, validName);
-							bool success = branch;
+							git_reference* branch = Client::BranchCreate(repoData, branchName, selectedHandle, validName);
 							if (branch && checkoutAfterCreate)
-								success = Client::BranchCheckout(branch);
+								QueueCheckout(repoData, git_reference_name(branch), nullptr);
 
 							if (!validName)
 								s_GitErrors.push(invalidNameError);
-							else if (!success)
+							else if (!branch)
 								RegisterLastGitError();
 
-							Client::UpdateHead(*repoData);
-
 							memset(branchName, 0, 256);
 							ImGui::CloseCurrentPopup();
 						}
@@ -1042,20 +1754,16 @@ namespace QuickGit
 
 					ImGui::TextUnformatted("Commit to checkout:");
 					ImGui::SameLine();
-					ImGui::Text("%s %.*s", ICON_MDI_SOURCE_COMMIT, COMMIT_SHORT_ID_LEN, selectedCommit->CommitID);
+					ImGui::Text("%s %.*s", ICON_MDI_SOURCE_COMMIT, COMMIT_SHORT_ID_LEN, selectedCommitID);
 					ImGui::SameLine();
-					ImGuiExt::TextEllipsis(selectedCommit->Message);
+					ImGuiExt::TextEllipsis(selectedSummary);
 
 					ImGui::Spacing();
 					ImGui::SetCursorPosX(ImGui::GetContentRegionAvail().x - ImGui::CalcTextSize("Checkout Commit Cancel").x);
 					if (ImGui::Button("Checkout Commit"))
 					{
-						s_Logs.push_back(std::format("Checkout Commit: {} {}", selectedCommit->CommitID, selectedCommit->Message).c_str());
-
-						if (!Client::CommitCheckout(selectedCommit->Commit, false))
-							RegisterLastGitError();
-
-						Client::UpdateHead(*repoData);
+						s_Logs.Write(std::format("Checkout Commit: {} {}", selectedCommitID, selectedSummary).c_str());
+						QueueCheckout(repoData, nullptr, &commits.Oid(selectedCommit));
 
 						ImGui::CloseCurrentPopup();
 					}
@@ -1081,6 +1789,44 @@ namespace QuickGit
 
 	void ImGuiRender()
 	{
+		Client::Update();
+
+		// Checkouts, resets and commits run on each repository's operation worker, their outcome is reported here along with a failed work tree watcher
+		for (const auto& repoData : Client::GetRepositories())
+		{
+			if (Client::TakeWatchFailure(repoData.get()))
+				s_Logs.Write(std::format("{}: Can't watch the work tree for changes, they show up on Refresh", repoData->Name.c_str()).c_str());
+
+			eastl::vector<OperationResult> results;
+			if (!Client::TakeOperationResults(repoData.get(), results))
+				continue;
+
+			for (const OperationResult& result : results)
+			{
+				const eastl::string description = DescribeOperation(result.Op);
+				if (result.Success)
+				{
+					s_Logs.Write(std::format("{}: Done", description.c_str()).c_str());
+				}
+				else if (result.Cancelled)
+				{
+					s_Logs.Write(std::format("{}: Cancelled", description.c_str()).c_str());
+				}
+				else
+				{
+					s_Logs.Write(std::format("{}: Failed", description.c_str()).c_str());
+					s_GitErrors.push(result.Error);
+					QG_LOG_ERROR("[GIT ERROR]: {}", result.Error.c_str());
+				}
+
+				if (result.Op.Type == OperationType::Commit)
+				{
+					s_CommitFinished = true;
+					s_CommitSucceeded = result.Success;
+				}
+			}
+		}
+
 		constexpr ImGuiWindowFlags sideBarFlags = ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_MenuBar | ImGuiWindowFlags_NoNavFocus;
 		
 		const float frameHeight = ImGui::GetFrameHeight();
@@ -1111,6 +1857,32 @@ namespace QuickGit
 				}
 				if (ImGui::BeginMenu("Edit"))
 				{
+					DiffCache& diffCache = Client::GetDiffCache();
+					int budgetMB = static_cast<int>(diffCache.Budget() / (1024 * 1024));
+					if (ImGui::SliderInt("Diff Cache", &budgetMB, 8, 1024, "%d MB"))
+						diffCache.SetBudget(static_cast<size_t>(budgetMB) * 1024 * 1024);
+
+					// Oversized files show their first hunks with a button to load more, whole diffs stop filling in at the diff limit
+					int fileLimitMB = static_cast<int>(Client::GetDiffFileLimit() / (1024 * 1024));
+					int diffLimitMB = static_cast<int>(Client::GetDiffTotalLimit() / (1024 * 1024));
+					bool limitsChanged = ImGui::SliderInt("Diff File Limit", &fileLimitMB, 1, 256, "%d MB");
+					limitsChanged |= ImGui::SliderInt("Diff Limit", &diffLimitMB, 8, 1024, "%d MB");
+					if (limitsChanged)
+						Client::SetDiffLimits(static_cast<uint64_t>(fileLimitMB) * 1024 * 1024, static_cast<uint64_t>(diffLimitMB) * 1024 * 1024);
+
+					ImGui::EndMenu();
+				}
+				if (ImGui::BeginMenu("Repository"))
+				{
+					ImGui::BeginDisabled(!s_SelectedRepository);
+					if (ImGui::MenuItem("Write Commit Graph"))
+					{
+						s_Logs.Write(std::format("Write Commit Graph: {}", s_SelectedRepository->Name.c_str()).c_str());
+						if (!Client::WriteCommitGraph(s_SelectedRepository))
+							RegisterLastGitError();
+					}
+					ImGui::EndDisabled();
+
 					ImGui::EndMenu();
 				}
 
@@ -1137,6 +1909,21 @@ namespace QuickGit
 				accum += dt;
 				ImGui::Text("FPS: %.2lf (%.3lfms)  MEM: %.2lfMB", 1.0f / dt, dt, mem);
 
+				const DiffCache& diffCache = Client::GetDiffCache();
+				ImGui::SameLine(0, frameHeight);
+				ImGui::Text("DIFFS: %zu (%.2lfMB)  HITS: %llu  MISSES: %llu", diffCache.Count(), static_cast<double>(diffCache.Bytes()) / (1024.0 * 1024.0),
+					static_cast<unsigned long long>(diffCache.Hits()), static_cast<unsigned long long>(diffCache.Misses()));
+
+				for (const auto& repoData : Client::GetRepositories())
+				{
+					const CommitLoader& loader = repoData->Loader;
+					if (!loader.Running.load(std::memory_order_relaxed))
+						continue;
+
+					ImGui::SameLine(0, frameHeight);
+					ImGui::Text("%s Loading %s: %llu commits", ICON_MDI_LOADING, repoData->Name.c_str(), static_cast<unsigned long long>(loader.Walked.load(std::memory_order_relaxed)));
+				}
+
 				ImGui::EndMenuBar();
 			}
 			ImGui::End();
@@ -1171,30 +1958,44 @@ namespace QuickGit
 			}
 		}
 
-		CommitData* selectedCommit = nullptr;
-		if (s_SelectedRepository && s_SelectedRepository->SelectedCommit)
+		const git_oid* selectedCommit = nullptr;
+		int64_t selectedRow = -1;
+		if (s_SelectedRepository && !git_oid_is_zero(&s_SelectedRepository->SelectedCommit))
 		{
-			if (s_SelectedRepository->CommitsIndexMap.find(s_SelectedRepository->SelectedCommit) != s_SelectedRepository->CommitsIndexMap.end())
-			{
-				size_t index = s_SelectedRepository->CommitsIndexMap.at(s_SelectedRepository->SelectedCommit);
-				selectedCommit = &s_SelectedRepository->Commits[index];
-			}
+			selectedRow = s_SelectedRepository->Commits.Find(s_SelectedRepository->SelectedCommit);
+			if (selectedRow >= 0)
+				selectedCommit = &s_SelectedRepository->SelectedCommit;
 		}
 
 		ImGuiExt::Begin("Commit\t\t");
 		{
 			ImGui::Indent();
 			static Commit cd;
-			static Diff diffs;
+			static eastl::shared_ptr<Diff> diffs;
+			static DiffSearch diffSearch;
+			static bool diffLoading = false;
 
-			if (selectedCommit && selectedCommit->Commit != cd.CommitPtr)
+			if (selectedCommit && !git_oid_equal(selectedCommit, &cd.ID))
 			{
-				GetCommit(selectedCommit->Commit, &cd);
-				diffs.Patches.clear();
-				Client::GenerateDiff(selectedCommit->Commit, diffs);
+				if (git_commit* commit = Client::LookupCommit(s_SelectedRepository, selectedRow))
+				{
+					GetCommit(commit, &cd);
+					diffs = Client::RequestDiff(s_SelectedRepository, static_cast<size_t>(selectedRow));
+					diffLoading = !diffs;
+					diffSearch.Dirty = true;
+				}
+			}
+
+			// A diff that wasn't cached is generated on the repository's worker, the panel shows a placeholder until it arrives
+			if (diffLoading && s_SelectedRepository)
+			{
+				diffs = Client::FindDiff(s_SelectedRepository, cd.ID);
+				diffLoading = !diffs;
+				if (diffs)
+					diffSearch.Dirty = true;
 			}
 
-			if (cd.CommitPtr)
+			if (!git_oid_is_zero(&cd.ID))
 			{
 				if (ImGui::BeginTable("CommitTopTable", 2))
 				{
@@ -1238,7 +2039,6 @@ namespace QuickGit
 					if (!cd.Refs.empty())
 						ImGui::TextUnformatted("REFS");
 					ImGui::TextUnformatted("SHA");
-					ImGui::TextUnformatted("Internal ID");
 
 					ImGui::TableNextColumn();
 
@@ -1249,7 +2049,6 @@ namespace QuickGit
 							ImGui::SameLine(0, ImGui::GetTextLineHeight());
 					}
 					ImGui::TextUnformatted(cd.CommitID);
-					ImGui::Text("%llu", cd.ID);
 
 					ImGui::EndTable();
 				}
@@ -1269,43 +2068,66 @@ namespace QuickGit
 
 				ImGui::Separator();
 
+				// The worker fills patches into the diff while it is shown, it only appends under this lock
+				static const Diff emptyDiff;
+				static uint32_t diffRevision = 0;
+				std::unique_lock diffLock = diffs ? std::unique_lock(diffs->Mutex) : std::unique_lock<std::mutex>();
+				if (diffs && diffs->Revision != diffRevision)
+				{
+					diffRevision = diffs->Revision;
+					diffSearch.Dirty = true;
+				}
+
 				ImGui::Spacing();
-				for (auto& diff : diffs.Patches)
+				if (s_SelectedRepository)
 				{
+					// The diff is asked for again with the new algorithm on the next frame
+					DiffAlgorithm algorithm = Client::GetDiffAlgorithm(s_SelectedRepository);
+					ImGui::SetNextItemWidth(ImGui::GetFontSize() * 7.0f);
+					if (ShowDiffAlgorithmCombo("##DiffAlgorithm", algorithm))
+					{
+						Client::SetDiffAlgorithm(s_SelectedRepository, algorithm);
+						cd.ID = {};
+					}
+					ImGui::SameLine();
+				}
+				ShowDiffSearchBar(diffSearch);
+				const Diff* searchedDiffs[] = { diffs ? diffs.get() : &emptyDiff };
+				UpdateDiffSearch(diffSearch, searchedDiffs, 1);
+				// Only files with text can be searched, searching fills in the rest in the background
+				if (diffs && diffSearch.QuerySize)
+					Client::RequestAllPatches(s_SelectedRepository, diffs);
+
+				ImGui::Spacing();
+				if (diffLoading)
+					ImGui::TextDisabled("%s Generating diff...", ICON_MDI_LOADING);
+
+				for (uint32_t p = 0, patchCount = diffs ? static_cast<uint32_t>(diffs->Patches.size()) : 0; p < patchCount; ++p)
+				{
+					const Patch& diff = diffs->Patches[p];
+					const auto [matchBegin, matchEnd] = GetPatchMatches(diffSearch, 0, p);
+					if (diffSearch.ScrollToCurrent && IsCurrentMatchIn(diffSearch, matchBegin, matchEnd))
+						ImGui::SetNextItemOpen(true);
+
 					ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(diff.Status));
-					bool open = ImGui::TreeNodeEx(diff.File.c_str(), ImGuiTreeNodeFlags_SpanAvailWidth);
+					const ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanAvailWidth;
+					bool open = matchBegin != matchEnd ? ImGui::TreeNodeEx(diff.File.c_str(), flags, "%s  (%zu)", diff.File.c_str(), static_cast<size_t>(matchEnd - matchBegin)) : ImGui::TreeNodeEx(diff.File.c_str(), flags);
 					ImGui::PopStyleColor();
+					ShowPatchStats(diff);
 					if (open)
 					{
-						ImGui::Indent(frameHeightWithSpacing);
-						if (diff.Patch == "@@BinaryData")
+						if (diff.Loaded)
 						{
-							ImGui::TextUnformatted(diff.Patch.c_str());
-							if (diff.NewFileSize)
-							{
-								ImGui::Indent(frameHeightWithSpacing);
-								if (diff.OldFileSize)
-								{
-									ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_DELETED));
-									ImGui::Text("Old: %u Bytes", diff.OldFileSize);
-									ImGui::PopStyleColor();
-									ImGui::SameLine(0, frameHeightWithSpacing);
-								}
-
-								ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_ADDED));
-								ImGui::Text("New: %u Bytes", diff.NewFileSize);
-								ImGui::PopStyleColor();
-								ImGui::Unindent(frameHeightWithSpacing);
-							}
+							if (ShowPatch(diffSearch, *diffs, diff, matchBegin, matchEnd, frameHeightWithSpacing))
+								Client::RequestMorePatch(s_SelectedRepository, diffs, p);
 						}
 						else
 						{
-							ImVec2 size = ImGui::CalcTextSize(diff.Patch.c_str());
-							size.y += ImGui::GetFrameHeightWithSpacing();
-							ImGui::InputTextMultiline(diff.File.c_str(), &diff.Patch[0], diff.Patch.size(), { ImGui::GetContentRegionAvail().x, size.y }, ImGuiInputTextFlags_ReadOnly);
+							Client::RequestPatch(s_SelectedRepository, diffs, p);
+							ImGui::Indent(frameHeightWithSpacing);
+							ImGui::TextDisabled("%s Generating patch...", ICON_MDI_LOADING);
+							ImGui::Unindent(frameHeightWithSpacing);
 						}
-
-						ImGui::Unindent(frameHeightWithSpacing);
 						ImGui::TreePop();
 					}
 				}
@@ -1318,14 +2140,20 @@ namespace QuickGit
 		{
 			ImGui::Indent();
 
-			static git_commit* head = nullptr;
+			static git_oid head{};
+			static git_repository* headRepository = nullptr;
 			static Diff unstaged;
 			static Diff staged;
+			static DiffSearch diffSearch;
 			static uint32_t contextLines = 3;
 			static bool showFullContent = false;
+			static DiffAlgorithm algorithm = DiffAlgorithm::Auto;
+			// Selected files of the unstaged and staged lists, and the file a shift click selects from
+			static eastl::hash_set<eastl::string> selection[2];
+			static uint32_t selectionAnchor[2] = {};
 
 			if (ImGui::Button(reinterpret_cast<const char*>(ICON_MDI_REFRESH)))
-				head = nullptr;
+				head = {};
 			ImGui::SameLine();
 			if (ImGui::Button(reinterpret_cast<const char*>(ICON_MDI_COGS)))
 				ImGui::OpenPopup("Changes Prefs");
@@ -1333,85 +2161,142 @@ namespace QuickGit
 			if (ImGui::BeginPopup("Changes Prefs"))
 			{
 				if (ImGui::Checkbox("Full Content", &showFullContent))
-					head = nullptr;
+					head = {};
 				ImGui::BeginDisabled(showFullContent);
 				static const uint32_t step = 1;
 				static const uint32_t fastStep = 3;
 				if (ImGui::InputScalar("Context Lines", ImGuiDataType_U32, &contextLines, &step, &fastStep))
-					head = nullptr;
+					head = {};
 				ImGui::EndDisabled();
+				if (ShowDiffAlgorithmCombo("Algorithm", algorithm))
+					head = {};
 				ImGui::EndPopup();
 			}
 			
-			if (selectedCommit && selectedCommit->Commit != head)
+			// Files saved since the diff was made are diffed again on their own, a changed index or HEAD rebuilds it
+			WorkTreeChanges changes;
+			if (s_SelectedRepository && s_SelectedRepository->Repository == headRepository && Client::TakeWorkTreeChanges(s_SelectedRepository, changes))
+			{
+				if (changes.Rescan || changes.IndexChanged)
+				{
+					head = {};
+				}
+				else if (!git_oid_is_zero(&head))
+				{
+					Client::UpdateWorkDirDiff(headRepository, changes.Paths, unstaged, showFullContent ? INT_MAX : contextLines, algorithm);
+					diffSearch.Dirty = true;
+				}
+			}
+
+			if (selectedCommit && !git_oid_equal(selectedCommit, &head))
 			{
-				head = selectedCommit->Commit;
-				unstaged.Patches.clear();
-				staged.Patches.clear();
-				Client::GenerateDiffWithWorkDir(git_commit_owner(head), unstaged, staged, showFullContent ? INT_MAX : contextLines);
+				head = *selectedCommit;
+				headRepository = s_SelectedRepository->Repository;
+				unstaged.Clear();
+				staged.Clear();
+				selection[0].clear();
+				selection[1].clear();
+				Client::GenerateDiffWithWorkDir(headRepository, unstaged, staged, showFullContent ? INT_MAX : contextLines, algorithm);
+				diffSearch.Dirty = true;
 			}
 			
-			if (head)
+			if (!git_oid_is_zero(&head))
 			{
-				for (int i = 0; i < 2; ++i)
+				ImGui::SameLine();
+				ShowDiffSearchBar(diffSearch);
+				const Diff* searchedDiffs[] = { &unstaged, &staged };
+				UpdateDiffSearch(diffSearch, searchedDiffs, 2);
+
+				// Files staged or unstaged this frame, written to the index at once after the lists are drawn
+				eastl::vector<eastl::string> indexPaths;
+				bool unstage = false;
+				for (uint32_t i = 0; i < 2; ++i)
 				{
 					bool stageArea = i != 0;
 					auto& diffs = stageArea ? staged : unstaged;
+					auto& selected = selection[i];
+					const uint32_t patchCount = static_cast<uint32_t>(diffs.Patches.size());
+					const size_t selectedCount = eastl::count_if(diffs.Patches.begin(), diffs.Patches.end(), [&](const Patch& patch) { return selected.find(patch.File) != selected.end(); });
 					ImGui::TextUnformatted(i == 0 ? "Unstaged" : "Staged");
-					for (auto& diff : diffs.Patches)
+					ImGui::SameLine();
+					ImGui::BeginDisabled(patchCount == 0);
+					const char* action = stageArea ? "Unstage" : "Stage";
+					const eastl::string actionLabel = selectedCount == 0 ? std::format("{} All###IndexAction{}", action, i).c_str() : std::format("{} {} File(s)###IndexAction{}", action, selectedCount, i).c_str();
+					if (ImGui::SmallButton(actionLabel.c_str()))
 					{
-						ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(diff.Status));
-						bool open = ImGui::TreeNodeEx(diff.File.c_str(), ImGuiTreeNodeFlags_SpanAvailWidth | ImGuiTreeNodeFlags_OpenOnArrow);
-						if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(0))
+						unstage = stageArea;
+						for (const Patch& patch : diffs.Patches)
 						{
-							bool success = false;
-							if (stageArea)
-								success = Client::RemoveFromIndex(git_commit_owner(head), diff.File.c_str());
-							else
-								success = Client::AddToIndex(git_commit_owner(head), diff.File.c_str());
+							if (selectedCount == 0 || selected.find(patch.File) != selected.end())
+								indexPaths.push_back(patch.File);
+						}
+					}
+					ImGui::EndDisabled();
 
-							if (!success)
-								RegisterLastGitError();
+					for (uint32_t p = 0; p < patchCount; ++p)
+					{
+						const Patch& diff = diffs.Patches[p];
+						const auto [matchBegin, matchEnd] = GetPatchMatches(diffSearch, i, p);
+						if (diffSearch.ScrollToCurrent && IsCurrentMatchIn(diffSearch, matchBegin, matchEnd))
+							ImGui::SetNextItemOpen(true);
 
-							if (success)
-								head = nullptr;
-						}
-						ImGui::PopStyleColor();
-						if (open)
+						ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(diff.Status));
+						const bool isSelected = selected.find(diff.File) != selected.end();
+						const ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanAvailWidth | ImGuiTreeNodeFlags_OpenOnArrow | (isSelected ? ImGuiTreeNodeFlags_Selected : 0);
+						bool open = matchBegin != matchEnd ? ImGui::TreeNodeEx(diff.File.c_str(), flags, "%s  (%zu)", diff.File.c_str(), static_cast<size_t>(matchEnd - matchBegin)) : ImGui::TreeNodeEx(diff.File.c_str(), flags);
+						// Ctrl click toggles a file, shift click selects a range, a plain click selects only the file
+						if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen())
 						{
-							ImGui::Indent(frameHeightWithSpacing);
-							if (diff.Patch == "@@BinaryData")
+							const ImGuiIO& io = ImGui::GetIO();
+							if (io.KeyShift && selectionAnchor[i] < patchCount)
 							{
-								ImGui::TextUnformatted(diff.Patch.c_str());
-								if (diff.NewFileSize)
+								if (!io.KeyCtrl)
+									selected.clear();
+								for (uint32_t r = eastl::min(p, selectionAnchor[i]), last = eastl::max(p, selectionAnchor[i]); r <= last; ++r)
+									selected.insert(diffs.Patches[r].File);
+							}
+							else
+							{
+								if (io.KeyCtrl && isSelected)
+									selected.erase(diff.File);
+								else if (io.KeyCtrl)
+									selected.insert(diff.File);
+								else
 								{
-									ImGui::Indent(frameHeightWithSpacing);
-									if (diff.OldFileSize)
-									{
-										ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_DELETED));
-										ImGui::Text("Old: %u Bytes", diff.OldFileSize);
-										ImGui::PopStyleColor();
-										ImGui::SameLine(0, frameHeightWithSpacing);
-									}
-
-									ImGui::PushStyleColor(ImGuiCol_Text, GetPatchStatusColor(GIT_DELTA_ADDED));
-									ImGui::Text("New: %u Bytes", diff.NewFileSize);
-									ImGui::PopStyleColor();
-									ImGui::Unindent(frameHeightWithSpacing);
+									selected.clear();
+									selected.insert(diff.File);
 								}
+								selectionAnchor[i] = p;
 							}
-							else
+						}
+						if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(0))
+						{
+							unstage = stageArea;
+							indexPaths = { diff.File };
+						}
+						ImGui::PopStyleColor();
+						ShowPatchStats(diff);
+						if (open)
+						{
+							if (ShowPatch(diffSearch, diffs, diff, matchBegin, matchEnd, frameHeightWithSpacing))
 							{
-								ImVec2 size = ImGui::CalcTextSize(diff.Patch.c_str());
-								size.y += ImGui::GetFrameHeightWithSpacing();
-								ImGui::InputTextMultiline(diff.File.c_str(), &diff.Patch[0], diff.Patch.size(), { ImGui::GetContentRegionAvail().x, size.y }, ImGuiInputTextFlags_ReadOnly);
+								Client::ExtendWorkDirPatch(headRepository, stageArea, showFullContent ? INT_MAX : contextLines, diffs, p);
+								diffSearch.Dirty = true;
 							}
-
-							ImGui::Unindent(frameHeightWithSpacing);
 							ImGui::TreePop();
 						}
 					}
 				}
+
+				if (!indexPaths.empty())
+				{
+					const bool success = unstage ? Client::RemoveFromIndex(headRepository, indexPaths) : Client::AddToIndex(headRepository, indexPaths);
+					if (success)
+						head = {};
+					else
+						RegisterLastGitError();
+				}
+
 				static char subject[512];
 				static char desc[2048];
 
@@ -1423,22 +2308,30 @@ namespace QuickGit
 				descriptionInputBoxSize.y -= frameHeightWithSpacing;
 				descriptionInputBoxSize.y = eastl::max(descriptionInputBoxSize.y, frameHeightWithSpacing);
 				ImGui::InputTextMultiline("##CommitDescription", desc, 2048, descriptionInputBoxSize);
-				ImGui::BeginDisabled(staged.Patches.empty() || subject[0] == 0);
-				eastl::string commitLabel = (staged.Patches.empty() ? "Commit" : std::format("Commit {} File(s)", staged.Patches.size()).c_str());
-				if (ImGui::Button(commitLabel.c_str()))
+				// The message stays until the commit is made, so a failed one can be tried again
+				static bool commitQueued = false;
+				if (s_CommitFinished)
 				{
-					bool success = Client::Commit(s_SelectedRepository, subject, desc);
-
-					if (success)
+					if (s_CommitSucceeded)
 					{
 						memset(subject, 0, sizeof(subject));
 						memset(desc, 0, sizeof(desc));
-						head = nullptr;
-					}
-					else
-					{
-						RegisterLastGitError();
+						head = {};
 					}
+					commitQueued = false;
+					s_CommitFinished = false;
+				}
+
+				ImGui::BeginDisabled(commitQueued || staged.Patches.empty() || subject[0] == 0);
+				eastl::string commitLabel = (staged.Patches.empty() ? "Commit" : std::format("Commit {} File(s)", staged.Patches.size()).c_str());
+				if (ImGui::Button(commitLabel.c_str()))
+				{
+					Operation operation;
+					operation.Type = OperationType::Commit;
+					operation.Summary = subject;
+					operation.Description = desc;
+					Client::QueueOperation(s_SelectedRepository, eastl::move(operation));
+					commitQueued = true;
 				}
 				ImGui::EndDisabled();
 			}
@@ -1449,8 +2342,62 @@ namespace QuickGit
 
 		ImGuiExt::Begin("Log\t\t");
 		{
-			for (auto& l : s_Logs)
-				ImGui::TextWrapped("%s", l.c_str());
+			const uint64_t completed = s_CheckoutProgress.Completed.load(std::memory_order_acquire);
+			const uint64_t total = s_CheckoutProgress.Total.load(std::memory_order_relaxed);
+			const int64_t lastNs = s_CheckoutProgress.LastNs.load(std::memory_order_relaxed);
+			// A checkout that failed part way never completes, its bar goes once it stopped reporting for a while
+			if (completed < total && GetSteadyNs() - lastNs < 5'000'000'000)
+			{
+				const double seconds = static_cast<double>(lastNs - s_CheckoutProgress.StartNs.load(std::memory_order_relaxed)) / 1e9;
+				const double rate = seconds > 0.0 ? static_cast<double>(completed) / seconds : 0.0;
+				const eastl::string overlay = rate > 0.0
+					? std::format("Checkout {}/{}  {:.0f} files/s  ETA {:.0f}s", completed, total, rate, static_cast<double>(total - completed) / rate).c_str()
+					: std::format("Checkout {}/{}", completed, total).c_str();
+				ImGui::ProgressBar(static_cast<float>(completed) / static_cast<float>(total), { -FLT_MIN, 0.0f }, overlay.c_str());
+			}
+
+			for (const auto& repoData : Client::GetRepositories())
+			{
+				Operation running;
+				size_t queued = 0;
+				const bool isRunning = Client::GetRunningOperation(repoData.get(), running, queued);
+				if (!isRunning && queued == 0)
+					continue;
+
+				ImGui::PushID(repoData.get());
+				const eastl::string description = isRunning ? DescribeOperation(running) : "Waiting";
+				if (queued)
+					ImGui::TextDisabled("%s %s: %s (%zu queued)", ICON_MDI_LOADING, repoData->Name.c_str(), description.c_str(), queued);
+				else
+					ImGui::TextDisabled("%s %s: %s", ICON_MDI_LOADING, repoData->Name.c_str(), description.c_str());
+				if (running.IsCheckout() || queued)
+				{
+					ImGui::SameLine();
+					if (ImGui::SmallButton("Cancel Checkouts"))
+						Client::CancelCheckouts(repoData.get());
+				}
+				ImGui::PopID();
+			}
+
+			// Only the visible lines are copied out of the ring, the view follows new lines while it is scrolled to the end
+			ImGui::BeginChild("##LogLines", { 0.0f, 0.0f }, false, ImGuiWindowFlags_HorizontalScrollbar);
+			const bool atEnd = ImGui::GetScrollY() >= ImGui::GetScrollMaxY();
+			const uint64_t first = s_Logs.First();
+			static eastl::string line;
+			ImGuiListClipper clipper;
+			clipper.Begin(static_cast<int>(s_Logs.Count() - first));
+			while (clipper.Step())
+			{
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+				{
+					if (!s_Logs.Read(first + static_cast<uint64_t>(row), line))
+						line.clear();
+					ImGui::TextUnformatted(line.c_str(), line.c_str() + line.size());
+				}
+			}
+			if (atEnd)
+				ImGui::SetScrollHereY(1.0f);
+			ImGui::EndChild();
 		}
 		ImGuiExt::End();
 
@@ -0,0 +1,146 @@
+#include "pch.h"
+#include "LaneLayout.h"
+
+namespace QuickGit
+{
+	static uint64_t LaneBit(size_t lane)
+	{
+		return lane < LANE_LAYOUT_MAX_LANES ? 1ull << lane : 0;
+	}
+
+	static size_t FindLane(const eastl::vector<uint64_t>& lanes, uint64_t parent)
+	{
+		return static_cast<size_t>(eastl::find(lanes.begin(), lanes.end(), parent) - lanes.begin());
+	}
+
+	static size_t TakeFreeLane(eastl::vector<uint64_t>& lanes)
+	{
+		const size_t lane = FindLane(lanes, 0);
+		if (lane == lanes.size())
+			lanes.push_back(0);
+
+		return lane;
+	}
+
+	void LaneLayout::Update(const CommitStore& commits)
+	{
+		if (m_Revision != commits.Revision())
+		{
+			Clear();
+			m_Revision = commits.Revision();
+		}
+
+		// Grown geometrically, rows arrive a batch at a time
+		const size_t count = commits.Size();
+		if (count > m_Rows.capacity())
+			m_Rows.reserve(eastl::max(count, m_Rows.capacity() * 2));
+		for (size_t row = m_Rows.size(); row < count; ++row)
+		{
+			if (row % LANE_LAYOUT_CHECKPOINT_ROWS == 0)
+				m_Checkpoints.push_back(m_Active);
+
+			// The commit takes the leftmost lane waiting for it, every other lane waiting for it ends here
+			const uint64_t key = OidPrefix(commits.Oid(row));
+			size_t lane = m_Lanes.size();
+			uint64_t in = 0;
+			for (size_t k = 0; k < m_Lanes.size(); ++k)
+			{
+				if (m_Lanes[k] != key)
+					continue;
+
+				lane = eastl::min(lane, k);
+				in |= LaneBit(k);
+				m_Lanes[k] = 0;
+			}
+
+			if (lane == m_Lanes.size())
+				lane = TakeFreeLane(m_Lanes);
+
+			// The first parent carries on in the commit's lane unless a lane already waits for it
+			uint64_t out = 0;
+			const uint32_t parentCount = commits.ParentCount(row);
+			const uint64_t* parents = commits.Parents(row);
+			for (uint32_t p = 0; p < parentCount; ++p)
+			{
+				size_t parentLane = FindLane(m_Lanes, parents[p]);
+				if (parentLane == m_Lanes.size())
+				{
+					parentLane = p == 0 ? lane : TakeFreeLane(m_Lanes);
+					m_Lanes[parentLane] = parents[p];
+				}
+
+				out |= LaneBit(parentLane);
+			}
+
+			while (!m_Lanes.empty() && m_Lanes.back() == 0)
+				m_Lanes.pop_back();
+
+			m_Active = (m_Active & ~in) | out;
+			m_Width = eastl::max(m_Width, static_cast<uint32_t>(eastl::min<size_t>(eastl::max<size_t>(m_Lanes.size(), lane + 1), LANE_LAYOUT_MAX_LANES)));
+
+			Row& entry = m_Rows.push_back();
+			entry.Lane = lane < LANE_LAYOUT_MAX_LANES ? static_cast<uint8_t>(lane) : static_cast<uint8_t>(NoLane);
+			entry.Flags = 0;
+
+			const uint64_t self = LaneBit(lane);
+			if (in & self)
+				entry.Flags |= RowFlags_LaneIn;
+			if (out & self)
+				entry.Flags |= RowFlags_LaneOut;
+
+			if ((in | out) & ~self)
+			{
+				entry.Flags |= RowFlags_Extra;
+				m_Extras.push_back({ static_cast<uint32_t>(row), in & ~self, out & ~self });
+			}
+		}
+	}
+
+	void LaneLayout::Clear()
+	{
+		m_Rows.clear();
+		m_Extras.clear();
+		m_Checkpoints.clear();
+		m_Lanes.clear();
+		m_Active = 0;
+		m_Width = 0;
+		m_Revision = UINT64_MAX;
+	}
+
+	void LaneLayout::GetMasks(size_t row, uint64_t& outIn, uint64_t& outOut) const
+	{
+		const Row& entry = m_Rows[row];
+		const uint64_t self = entry.Lane == NoLane ? 0 : 1ull << entry.Lane;
+		outIn = entry.Flags & RowFlags_LaneIn ? self : 0;
+		outOut = entry.Flags & RowFlags_LaneOut ? self : 0;
+
+		if (entry.Flags & RowFlags_Extra)
+		{
+			auto it = eastl::lower_bound(m_Extras.begin(), m_Extras.end(), static_cast<uint32_t>(row), [](const Extra& extra, uint32_t r) { return extra.Row < r; });
+			outIn |= it->In;
+			outOut |= it->Out;
+		}
+	}
+
+	void LaneLayout::GetRows(size_t begin, size_t end, eastl::vector<RowLanes>& outRows) const
+	{
+		outRows.clear();
+		end = eastl::min(end, m_Rows.size());
+		if (begin >= end)
+			return;
+
+		// Replayed from the checkpoint before the first row, never more than LANE_LAYOUT_CHECKPOINT_ROWS rows
+		size_t row = begin - begin % LANE_LAYOUT_CHECKPOINT_ROWS;
+		uint64_t active = m_Checkpoints[row / LANE_LAYOUT_CHECKPOINT_ROWS];
+		outRows.reserve(end - begin);
+		for (; row < end; ++row)
+		{
+			uint64_t in, out;
+			GetMasks(row, in, out);
+			if (row >= begin)
+				outRows.push_back({ m_Rows[row].Lane, active, in, out });
+
+			active = (active & ~in) | out;
+		}
+	}
+}
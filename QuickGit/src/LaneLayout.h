@@ -0,0 +1,75 @@
+#pragma once
+
+#include "CommitStore.h"
+
+#define LANE_LAYOUT_MAX_LANES 64
+#define LANE_LAYOUT_CHECKPOINT_ROWS 64
+
+namespace QuickGit
+{
+	// Lanes of the branch and merge graph drawn next to the commit list.
+	// Rows are laid out in one pass as the store grows, a row keeps its lane and whether the lane runs into and out of it,
+	// the rare rows that merge or branch keep their other lanes on the side. Lane masks are rebuilt only for the rows in view.
+	class LaneLayout
+	{
+	public:
+		// Lanes of one row as bit masks: running down into the row, ending at its node, leaving its node
+		struct RowLanes
+		{
+			uint32_t Lane;
+			uint64_t Before;
+			uint64_t In;
+			uint64_t Out;
+		};
+
+		static constexpr uint32_t NoLane = UINT8_MAX;
+
+		// Lays out rows appended since the last call, everything again once rows moved
+		void Update(const CommitStore& commits);
+		void Clear();
+
+		size_t Size() const { return m_Rows.size(); }
+		// Lanes in use by the widest row so far, at most LANE_LAYOUT_MAX_LANES
+		uint32_t Width() const { return m_Width; }
+		uint32_t Lane(size_t row) const { return m_Rows[row].Lane; }
+
+		// Replaces outRows with rows [begin, end)
+		void GetRows(size_t begin, size_t end, eastl::vector<RowLanes>& outRows) const;
+
+	private:
+		enum RowFlags : uint8_t
+		{
+			RowFlags_LaneIn = 1 << 0,
+			RowFlags_LaneOut = 1 << 1,
+			RowFlags_Extra = 1 << 2
+		};
+
+		struct Row
+		{
+			uint8_t Lane;
+			uint8_t Flags;
+		};
+
+		// Lanes other than the row's own
+		struct Extra
+		{
+			uint32_t Row;
+			uint64_t In;
+			uint64_t Out;
+		};
+
+		void GetMasks(size_t row, uint64_t& outIn, uint64_t& outOut) const;
+
+	private:
+		eastl::vector<Row> m_Rows;
+		eastl::vector<Extra> m_Extras;
+		// Lanes running into every LANE_LAYOUT_CHECKPOINT_ROWS-th row
+		eastl::vector<uint64_t> m_Checkpoints;
+
+		// The parent each lane is waiting for, 0 when free
+		eastl::vector<uint64_t> m_Lanes;
+		uint64_t m_Active = 0;
+		uint32_t m_Width = 0;
+		uint64_t m_Revision = UINT64_MAX;
+	};
+}
@@ -0,0 +1,42 @@
+#include "pch.h"
+#include "LogRing.h"
+
+namespace QuickGit
+{
+	void LogRing::Write(eastl::string_view text)
+	{
+		const uint64_t index = m_Next.fetch_add(1, std::memory_order_relaxed);
+		Entry& entry = m_Entries[index % LOG_RING_CAPACITY];
+		entry.Sequence.store(index * 2 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		uint64_t words[WordCount] = {};
+		const size_t size = eastl::min(text.size(), static_cast<size_t>(LOG_RING_ENTRY_SIZE));
+		memcpy(words, text.data(), size);
+		for (size_t i = 0, count = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t); i < count; ++i)
+			entry.Words[i].store(words[i], std::memory_order_relaxed);
+		entry.Size.store(static_cast<uint32_t>(size), std::memory_order_relaxed);
+
+		entry.Sequence.store(index * 2 + 2, std::memory_order_release);
+	}
+
+	bool LogRing::Read(uint64_t index, eastl::string& out) const
+	{
+		const Entry& entry = m_Entries[index % LOG_RING_CAPACITY];
+		const uint64_t sequence = entry.Sequence.load(std::memory_order_acquire);
+		if (sequence != index * 2 + 2)
+			return false;
+
+		uint64_t words[WordCount];
+		const size_t size = eastl::min(static_cast<size_t>(entry.Size.load(std::memory_order_relaxed)), static_cast<size_t>(LOG_RING_ENTRY_SIZE));
+		for (size_t i = 0, count = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t); i < count; ++i)
+			words[i] = entry.Words[i].load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (entry.Sequence.load(std::memory_order_relaxed) != sequence)
+			return false;
+
+		out.assign(reinterpret_cast<const char*>(words), size);
+		return true;
+	}
+}
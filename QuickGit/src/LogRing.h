@@ -0,0 +1,40 @@
+#pragma once
+
+// Entries kept before the oldest is overwritten, and bytes of text per entry, longer text is cut
+#define LOG_RING_CAPACITY 4096
+#define LOG_RING_ENTRY_SIZE 256
+
+namespace QuickGit
+{
+	// Fixed ring of log lines any thread can write to without a lock. Each entry carries a sequence number that is odd
+	// while it is written, a reader copies the text and drops it when the number changed meanwhile.
+	class LogRing
+	{
+	public:
+		void Write(eastl::string_view text);
+
+		// Entries written so far and the oldest one still held
+		uint64_t Count() const { return m_Next.load(std::memory_order_acquire); }
+		uint64_t First() const
+		{
+			const uint64_t count = Count();
+			return count > LOG_RING_CAPACITY ? count - LOG_RING_CAPACITY : 0;
+		}
+
+		// Returns false while the entry is written or once it was overwritten
+		bool Read(uint64_t index, eastl::string& out) const;
+
+	private:
+		static constexpr size_t WordCount = LOG_RING_ENTRY_SIZE / sizeof(uint64_t);
+
+		struct Entry
+		{
+			std::atomic<uint64_t> Sequence = 0;
+			std::atomic<uint32_t> Size = 0;
+			std::atomic<uint64_t> Words[WordCount] = {};
+		};
+
+		Entry m_Entries[LOG_RING_CAPACITY];
+		std::atomic<uint64_t> m_Next = 0;
+	};
+}
@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace QuickGit
+{
+	bool MappedFile::Open(const char* filepath)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+
+		if (!mapping)
+			return false;
+
+		m_Data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		CloseHandle(mapping);
+		m_Size = m_Data ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+		const int file = open(filepath, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat info;
+		void* data = MAP_FAILED;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+			data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+
+		if (data == MAP_FAILED)
+			return false;
+
+		m_Data = static_cast<const uint8_t*>(data);
+		m_Size = static_cast<size_t>(info.st_size);
+#endif
+
+		return m_Data != nullptr;
+	}
+
+	void MappedFile::Close()
+	{
+		if (!m_Data)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(m_Data);
+#else
+		munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+}
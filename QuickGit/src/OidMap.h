@@ -0,0 +1,152 @@
+#pragma once
+
+#include <git2.h>
+
+namespace QuickGit
+{
+	// First 8 bytes of an object id, unique enough to tell commits of one repository apart
+	inline uint64_t OidPrefix(const git_oid& oid)
+	{
+		uint64_t prefix;
+		memcpy(&prefix, oid.id, sizeof(prefix));
+		return prefix;
+	}
+
+	// Open addressing hash table keyed on the raw object id.
+	// Object ids are already uniformly distributed so the first 8 bytes are used as the hash,
+	// keys are compared in full so distinct commits never share a slot.
+	template<typename T>
+	class OidMap
+	{
+	public:
+		T* Find(const git_oid& oid)
+		{
+			const int64_t slot = FindSlot(oid);
+			return slot >= 0 ? &m_Slots[slot].Value : nullptr;
+		}
+
+		const T* Find(const git_oid& oid) const
+		{
+			const int64_t slot = FindSlot(oid);
+			return slot >= 0 ? &m_Slots[slot].Value : nullptr;
+		}
+
+		bool Contains(const git_oid& oid) const { return FindSlot(oid) >= 0; }
+
+		// Returns the existing value or a default constructed one
+		T& operator[](const git_oid& oid)
+		{
+			if ((m_Size + 1) * 4 > m_Slots.size() * 3)
+				Rehash(eastl::max(m_Slots.size() * 2, static_cast<size_t>(16)));
+
+			size_t i = Hash(oid) & m_Mask;
+			while (m_Slots[i].Used)
+			{
+				if (git_oid_equal(&m_Slots[i].Key, &oid))
+					return m_Slots[i].Value;
+
+				i = (i + 1) & m_Mask;
+			}
+
+			Slot& slot = m_Slots[i];
+			slot.Key = oid;
+			slot.Used = true;
+			++m_Size;
+			return slot.Value;
+		}
+
+		bool Erase(const git_oid& oid)
+		{
+			int64_t found = FindSlot(oid);
+			if (found < 0)
+				return false;
+
+			// Shift following entries back so probe sequences stay unbroken, no tombstones
+			size_t hole = static_cast<size_t>(found);
+			for (size_t i = (hole + 1) & m_Mask; m_Slots[i].Used; i = (i + 1) & m_Mask)
+			{
+				const size_t home = Hash(m_Slots[i].Key) & m_Mask;
+				if (((i - home) & m_Mask) >= ((i - hole) & m_Mask))
+				{
+					m_Slots[hole] = eastl::move(m_Slots[i]);
+					hole = i;
+				}
+			}
+
+			m_Slots[hole] = Slot{};
+			--m_Size;
+			return true;
+		}
+
+		void Reserve(size_t count)
+		{
+			size_t capacity = 16;
+			while (capacity * 3 < count * 4)
+				capacity *= 2;
+
+			if (capacity > m_Slots.size())
+				Rehash(capacity);
+		}
+
+		void Clear()
+		{
+			m_Slots.clear();
+			m_Mask = 0;
+			m_Size = 0;
+		}
+
+		size_t Size() const { return m_Size; }
+		bool Empty() const { return m_Size == 0; }
+
+	private:
+		struct Slot
+		{
+			git_oid Key{};
+			T Value{};
+			bool Used = false;
+		};
+
+		static size_t Hash(const git_oid& oid)
+		{
+			return static_cast<size_t>(OidPrefix(oid));
+		}
+
+		int64_t FindSlot(const git_oid& oid) const
+		{
+			if (m_Size == 0)
+				return -1;
+
+			for (size_t i = Hash(oid) & m_Mask; m_Slots[i].Used; i = (i + 1) & m_Mask)
+			{
+				if (git_oid_equal(&m_Slots[i].Key, &oid))
+					return static_cast<int64_t>(i);
+			}
+
+			return -1;
+		}
+
+		void Rehash(size_t capacity)
+		{
+			eastl::vector<Slot> slots(capacity);
+			eastl::swap(slots, m_Slots);
+			m_Mask = capacity - 1;
+
+			for (Slot& slot : slots)
+			{
+				if (!slot.Used)
+					continue;
+
+				size_t i = Hash(slot.Key) & m_Mask;
+				while (m_Slots[i].Used)
+					i = (i + 1) & m_Mask;
+
+				m_Slots[i] = eastl::move(slot);
+			}
+		}
+
+	private:
+		eastl::vector<Slot> m_Slots;
+		size_t m_Mask = 0;
+		size_t m_Size = 0;
+	};
+}
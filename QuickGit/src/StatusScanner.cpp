@@ -0,0 +1,427 @@
+#include "pch.h"
+#include "StatusScanner.h"
+
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace QuickGit
+{
+	// Stat data an index entry is compared against
+	struct FileStat
+	{
+		uint64_t Size = 0;
+		int64_t Seconds = 0;
+		uint32_t Nanoseconds = 0;
+		bool Link = false;
+		bool Executable = false;
+	};
+
+	// Entry of a directory being read, the stat data of a file is only read once it turned out to be tracked
+	struct DirectoryEntry
+	{
+		const char* Name;
+		bool Directory;
+#ifdef _WIN32
+		const WIN32_FIND_DATAW* Data;
+#else
+		int Parent;
+#endif
+	};
+
+#ifdef _WIN32
+	static eastl::wstring ToWide(const eastl::string& path)
+	{
+		eastl::wstring wide(static_cast<size_t>(MultiByteToWideChar(CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), nullptr, 0)), L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), wide.data(), static_cast<int>(wide.size()));
+		return wide;
+	}
+
+	static void ToUtf8(const wchar_t* name, eastl::string& out)
+	{
+		out.resize(static_cast<size_t>(WideCharToMultiByte(CP_UTF8, 0, name, -1, nullptr, 0, nullptr, nullptr)));
+		WideCharToMultiByte(CP_UTF8, 0, name, -1, out.data(), static_cast<int>(out.size()), nullptr, nullptr);
+		// The terminator came along
+		if (!out.empty())
+			out.pop_back();
+	}
+
+	// FILETIME counts 100ns ticks since 1601
+	static void ToUnixTime(const FILETIME& time, FileStat& out)
+	{
+		const uint64_t ticks = ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) - 116444736000000000ull;
+		out.Seconds = static_cast<int64_t>(ticks / 10000000);
+		out.Nanoseconds = static_cast<uint32_t>(ticks % 10000000 * 100);
+	}
+
+	// One FindFirstFileEx pass hands out the size and times of every entry, no file is opened
+	template<typename Func>
+	static void ReadDirectory(const eastl::string& path, Func&& func)
+	{
+		WIN32_FIND_DATAW data;
+		HANDLE find = FindFirstFileExW(ToWide(path + "*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+		if (find == INVALID_HANDLE_VALUE)
+			return;
+
+		eastl::string name;
+		do
+		{
+			if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0)
+				continue;
+
+			// Junctions and directory links aren't followed
+			ToUtf8(data.cFileName, name);
+			const bool directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+			func(DirectoryEntry{ name.c_str(), directory, &data });
+		} while (FindNextFileW(find, &data));
+
+		FindClose(find);
+	}
+
+	static bool GetFileStat(const DirectoryEntry& entry, FileStat& out)
+	{
+		out.Size = (static_cast<uint64_t>(entry.Data->nFileSizeHigh) << 32) | entry.Data->nFileSizeLow;
+		ToUnixTime(entry.Data->ftLastWriteTime, out);
+		return true;
+	}
+
+	static bool GetPathStat(const eastl::string& path, FileStat& out)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExW(ToWide(path).c_str(), GetFileExInfoStandard, &data))
+			return false;
+
+		out.Size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		ToUnixTime(data.ftLastWriteTime, out);
+		return true;
+	}
+#else
+	static void ToFileStat(const struct stat& info, FileStat& out)
+	{
+		out.Size = static_cast<uint64_t>(info.st_size);
+		out.Seconds = info.st_mtim.tv_sec;
+		out.Nanoseconds = static_cast<uint32_t>(info.st_mtim.tv_nsec);
+		out.Link = S_ISLNK(info.st_mode);
+		out.Executable = (info.st_mode & S_IXUSR) != 0;
+	}
+
+	template<typename Func>
+	static void ReadDirectory(const eastl::string& path, Func&& func)
+	{
+		DIR* dir = opendir(path.c_str());
+		if (!dir)
+			return;
+
+		const int parent = dirfd(dir);
+		while (const dirent* entry = readdir(dir))
+		{
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+
+			bool directory = entry->d_type == DT_DIR;
+			if (entry->d_type == DT_UNKNOWN)
+			{
+				struct stat info;
+				directory = fstatat(parent, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+			}
+
+			func(DirectoryEntry{ entry->d_name, directory, parent });
+		}
+
+		closedir(dir);
+	}
+
+	static bool GetFileStat(const DirectoryEntry& entry, FileStat& out)
+	{
+		struct stat info;
+		if (fstatat(entry.Parent, entry.Name, &info, AT_SYMLINK_NOFOLLOW) != 0)
+			return false;
+
+		ToFileStat(info, out);
+		return true;
+	}
+
+	static bool GetPathStat(const eastl::string& path, FileStat& out)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return false;
+
+		ToFileStat(info, out);
+		return true;
+	}
+#endif
+
+	// Index order, byte wise or ASCII case insensitive like libgit2 on a case insensitive file system
+	static int ComparePaths(const char* a, const char* b, size_t length, bool ignoreCase)
+	{
+		if (!ignoreCase)
+			return strncmp(a, b, length);
+
+		for (size_t i = 0; i < length; ++i)
+		{
+			const int x = tolower(static_cast<uint8_t>(a[i]));
+			const int y = tolower(static_cast<uint8_t>(b[i]));
+			if (x != y || !x)
+				return x - y;
+		}
+
+		return 0;
+	}
+
+	struct ScanState
+	{
+		eastl::string WorkDir;
+		eastl::string RepositoryPath;
+		// Stage 0 entries of regular files and links in index order, Seen is set for the ones found in the work tree
+		eastl::vector<const git_index_entry*> Files;
+		eastl::vector<uint8_t> Seen;
+		bool IgnoreCase = false;
+		bool FileMode = true;
+		bool Symlinks = true;
+		// Files changed in the same second the index was written may have changed again unnoticed, those are hashed
+		FileStat Index;
+
+		// Entries of [begin, end) at or after path
+		size_t LowerBound(const eastl::string& path, size_t begin, size_t end) const
+		{
+			return static_cast<size_t>(eastl::lower_bound(Files.begin() + begin, Files.begin() + end, path.c_str(), [this](const git_index_entry* entry, const char* value)
+			{
+				return ComparePaths(entry->path, value, SIZE_MAX, IgnoreCase) < 0;
+			}) - Files.begin());
+		}
+
+		// End of the entries under a directory given with its trailing slash
+		size_t PrefixEnd(const eastl::string& directory, size_t begin) const
+		{
+			return static_cast<size_t>(eastl::partition_point(Files.begin() + begin, Files.end(), [&](const git_index_entry* entry)
+			{
+				return ComparePaths(entry->path, directory.c_str(), directory.size(), IgnoreCase) <= 0;
+			}) - Files.begin());
+		}
+
+		size_t Find(const eastl::string& path, size_t begin, size_t end) const
+		{
+			const size_t i = LowerBound(path, begin, end);
+			return i < end && ComparePaths(Files[i]->path, path.c_str(), SIZE_MAX, IgnoreCase) == 0 ? i : SIZE_MAX;
+		}
+
+		bool HasTracked(const eastl::string& directory, size_t begin, size_t end) const
+		{
+			const size_t i = LowerBound(directory, begin, end);
+			return i < end && ComparePaths(Files[i]->path, directory.c_str(), directory.size(), IgnoreCase) == 0;
+		}
+
+		bool IsRacy(const git_index_entry& entry) const
+		{
+			return entry.mtime.seconds > Index.Seconds || (entry.mtime.seconds == Index.Seconds && entry.mtime.nanoseconds >= Index.Nanoseconds);
+		}
+	};
+
+	// Per ThreadPool thread, libgit2 objects are never shared between threads
+	struct ScanWorker
+	{
+		git_repository* Repository = nullptr;
+		// Directories with tracked files found on the current level, read on the next one
+		eastl::vector<eastl::string> Directories;
+		eastl::vector<eastl::pair<eastl::string, uint32_t>> Changes;
+		eastl::string Path;
+	};
+
+	static bool HashFile(const ScanState& state, ScanWorker& worker, const git_index_entry& entry, const FileStat& stat, git_oid& out)
+	{
+		const eastl::string filepath = state.WorkDir + worker.Path;
+#ifndef _WIN32
+		if (stat.Link)
+		{
+			char target[4096];
+			const ssize_t length = readlink(filepath.c_str(), target, sizeof(target));
+			return length >= 0 && git_odb_hash(&out, target, static_cast<size_t>(length), GIT_OBJECT_BLOB) == 0;
+		}
+#else
+		(void)stat;
+#endif
+
+		// Line endings and other filters are applied the way they are when the file is added
+		if (!worker.Repository && git_repository_open(&worker.Repository, state.RepositoryPath.c_str()) != 0)
+			return false;
+
+		return git_repository_hashfile(&out, worker.Repository, filepath.c_str(), GIT_OBJECT_BLOB, entry.path) == 0;
+	}
+
+	static uint32_t CompareFile(const ScanState& state, ScanWorker& worker, const git_index_entry& entry, const FileStat& stat)
+	{
+		const bool trackedLink = entry.mode == GIT_FILEMODE_LINK;
+		if (state.Symlinks && trackedLink != stat.Link)
+			return GIT_STATUS_WT_TYPECHANGE;
+		if (state.FileMode && !trackedLink && (entry.mode == GIT_FILEMODE_BLOB_EXECUTABLE) != stat.Executable)
+			return GIT_STATUS_WT_MODIFIED;
+
+		// Index sizes are truncated to 32 bits, entries written without nanoseconds only compare seconds
+		const bool sameStat = static_cast<uint32_t>(stat.Size) == entry.file_size && stat.Seconds == entry.mtime.seconds && (!entry.mtime.nanoseconds || stat.Nanoseconds == entry.mtime.nanoseconds);
+		if (sameStat && !state.IsRacy(entry))
+			return 0;
+
+		git_oid id;
+		if (!HashFile(state, worker, entry, stat, id))
+			return GIT_STATUS_WT_MODIFIED;
+
+		return git_oid_equal(&id, &entry.id) ? 0 : GIT_STATUS_WT_MODIFIED;
+	}
+
+	static void ScanDirectory(ScanState& state, ScanWorker& worker, const eastl::string& directory)
+	{
+		// Lookups only search the entries under the directory
+		const size_t begin = state.LowerBound(directory, 0, state.Files.size());
+		const size_t end = directory.empty() ? state.Files.size() : state.PrefixEnd(directory, begin);
+		ReadDirectory(state.WorkDir + directory, [&](const DirectoryEntry& entry)
+		{
+			worker.Path.assign(directory).append(entry.Name);
+			if (entry.Directory)
+			{
+				// Directories without tracked files are never read, whatever is in them is untracked or ignored
+				worker.Path.push_back('/');
+				if (!(directory.empty() && worker.Path == ".git/") && state.HasTracked(worker.Path, begin, end))
+					worker.Directories.push_back(worker.Path);
+				return;
+			}
+
+			const size_t i = state.Find(worker.Path, begin, end);
+			FileStat stat;
+			if (i == SIZE_MAX || !GetFileStat(entry, stat))
+				return;
+
+			state.Seen[i] = 1;
+			const git_index_entry& indexEntry = *state.Files[i];
+			if (indexEntry.flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE)
+				return;
+
+			// Keyed like the index, the name on disk may differ in case from it
+			if (const uint32_t status = CompareFile(state, worker, indexEntry, stat))
+				worker.Changes.push_back({ indexEntry.path, status });
+		});
+	}
+
+	static uint32_t GetIndexStatus(git_delta_t status)
+	{
+		switch (status)
+		{
+			case GIT_DELTA_ADDED: return GIT_STATUS_INDEX_NEW;
+			case GIT_DELTA_DELETED: return GIT_STATUS_INDEX_DELETED;
+			case GIT_DELTA_MODIFIED: return GIT_STATUS_INDEX_MODIFIED;
+			case GIT_DELTA_RENAMED: return GIT_STATUS_INDEX_RENAMED;
+			case GIT_DELTA_TYPECHANGE: return GIT_STATUS_INDEX_TYPECHANGE;
+			default: return 0;
+		}
+	}
+
+	bool StatusScanner::Scan(git_repository* repo, eastl::hash_map<eastl::string, uint32_t>& out, eastl::vector<eastl::string>& outDeferred)
+	{
+		const char* workDir = git_repository_workdir(repo);
+		git_index* index = nullptr;
+		if (!workDir || git_repository_index(&index, repo) != 0)
+			return false;
+
+		// Picks up what another process wrote to the index since it was last read
+		git_index_read(index, false);
+
+		ScanState state;
+		state.WorkDir = workDir;
+		state.RepositoryPath = git_repository_path(repo);
+		state.IgnoreCase = (git_index_caps(index) & GIT_INDEX_CAPABILITY_IGNORE_CASE) != 0;
+		if (git_index_path(index))
+			GetPathStat(git_index_path(index), state.Index);
+
+		git_config* config = nullptr;
+		if (git_repository_config_snapshot(&config, repo) == 0)
+		{
+			int value = 0;
+			if (git_config_get_bool(&value, config, "core.filemode") == 0)
+				state.FileMode = value != 0;
+			if (git_config_get_bool(&value, config, "core.symlinks") == 0)
+				state.Symlinks = value != 0;
+			git_config_free(config);
+		}
+
+		// Conflicts and submodules need more than a stat, libgit2 looks at those afterwards
+		outDeferred.clear();
+		const size_t entryCount = git_index_entrycount(index);
+		state.Files.reserve(entryCount);
+		for (size_t i = 0; i < entryCount; ++i)
+		{
+			const git_index_entry* entry = git_index_get_byindex(index, i);
+			if (GIT_INDEX_ENTRY_STAGE(entry) != 0 || entry->mode == GIT_FILEMODE_COMMIT)
+			{
+				if (outDeferred.empty() || outDeferred.back() != entry->path)
+					outDeferred.push_back(entry->path);
+				continue;
+			}
+
+			state.Files.push_back(entry);
+		}
+
+		const auto less = [&state](const git_index_entry* a, const git_index_entry* b) { return ComparePaths(a->path, b->path, SIZE_MAX, state.IgnoreCase) < 0; };
+		if (!eastl::is_sorted(state.Files.begin(), state.Files.end(), less))
+			eastl::sort(state.Files.begin(), state.Files.end(), less);
+		state.Seen.resize(state.Files.size(), 0);
+
+		// A level of the tree at a time, the directories of a level spread over the threads
+		eastl::vector<ScanWorker> workers(ThreadPool::Size());
+		eastl::vector<eastl::string> level;
+		level.push_back("");
+		while (!level.empty())
+		{
+			ThreadPool::ParallelFor(static_cast<uint32_t>(level.size()), [&](uint32_t i, uint32_t worker) { ScanDirectory(state, workers[worker], level[i]); });
+
+			level.clear();
+			for (ScanWorker& worker : workers)
+			{
+				for (eastl::string& directory : worker.Directories)
+					level.push_back(eastl::move(directory));
+				worker.Directories.clear();
+			}
+		}
+
+		out.clear();
+		for (ScanWorker& worker : workers)
+		{
+			for (const auto& [path, status] : worker.Changes)
+				out[path] |= status;
+			git_repository_free(worker.Repository);
+		}
+
+		for (size_t i = 0; i < state.Files.size(); ++i)
+		{
+			if (!state.Seen[i] && !(state.Files[i]->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE))
+				out[state.Files[i]->path] |= GIT_STATUS_WT_DELETED;
+		}
+
+		// HEAD against the index only reads trees, no file is touched
+		git_object* headTree = nullptr;
+		git_revparse_single(&headTree, repo, "HEAD^{tree}");
+		git_diff_options diffOp = GIT_DIFF_OPTIONS_INIT;
+		diffOp.flags = GIT_DIFF_INCLUDE_TYPECHANGE;
+		git_diff* staged = nullptr;
+		const int err = git_diff_tree_to_index(&staged, repo, reinterpret_cast<git_tree*>(headTree), index, &diffOp);
+		for (size_t i = 0, count = err == 0 ? git_diff_num_deltas(staged) : 0; i < count; ++i)
+		{
+			const git_diff_delta* delta = git_diff_get_delta(staged, i);
+			if (const uint32_t status = GetIndexStatus(delta->status))
+				out[delta->new_file.path] |= status;
+		}
+
+		git_diff_free(staged);
+		git_object_free(headTree);
+		git_index_free(index);
+		return err == 0;
+	}
+}
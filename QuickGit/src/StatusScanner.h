@@ -0,0 +1,18 @@
+#pragma once
+
+#include <git2.h>
+
+namespace QuickGit
+{
+	// Full work tree status on every ThreadPool thread. The tree is walked a directory level at a time with the directories
+	// of a level spread over the threads, only directories holding tracked files are read and a file is only hashed when
+	// its stat data doesn't match its index entry or is too recent to be trusted.
+	// Waits while the pool runs another loop, so it is called from the status worker and never from the UI thread.
+	class StatusScanner
+	{
+	public:
+		// Fills out with the git_status_t of each tracked path that differs from HEAD or the index, like git_status_list_new
+		// without untracked files. Conflicts and submodules go to outDeferred for libgit2 to look at, they aren't in out.
+		static bool Scan(git_repository* repo, eastl::hash_map<eastl::string, uint32_t>& out, eastl::vector<eastl::string>& outDeferred);
+	};
+}
@@ -0,0 +1,178 @@
+#include "pch.h"
+#include "TextSearch.h"
+
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define QG_TEXT_SEARCH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#define QG_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define QG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace QuickGit
+{
+	struct SearchPattern
+	{
+		const uint8_t* Text;
+		size_t Size;
+		bool MatchCase;
+
+		// A text byte b is a candidate when (b | mask) == value, the mask folds case for letters
+		uint8_t First;
+		uint8_t FirstMask;
+		uint8_t Last;
+		uint8_t LastMask;
+	};
+
+	static uint8_t FoldCase(uint8_t c)
+	{
+		return c >= 'A' && c <= 'Z' ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+	}
+
+	static void SetCandidateByte(uint8_t c, bool matchCase, uint8_t& outValue, uint8_t& outMask)
+	{
+		outValue = matchCase ? c : FoldCase(c);
+		outMask = !matchCase && outValue >= 'a' && outValue <= 'z' ? 0x20 : 0;
+	}
+
+	static bool MatchAt(const uint8_t* text, const SearchPattern& pattern)
+	{
+		if (pattern.MatchCase)
+			return memcmp(text, pattern.Text, pattern.Size) == 0;
+
+		for (size_t i = 0; i < pattern.Size; ++i)
+		{
+			if (FoldCase(text[i]) != FoldCase(pattern.Text[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	static size_t FindScalar(const uint8_t* text, size_t size, const SearchPattern& pattern, size_t from)
+	{
+		for (size_t i = from; i + pattern.Size <= size; ++i)
+		{
+			if ((text[i] | pattern.FirstMask) == pattern.First && MatchAt(text + i, pattern))
+				return i;
+		}
+
+		return TextSearch::NPos;
+	}
+
+#ifdef QG_TEXT_SEARCH_X86
+	static size_t FindSSE2(const uint8_t* text, size_t size, const SearchPattern& pattern, size_t from)
+	{
+		const __m128i first = _mm_set1_epi8(static_cast<char>(pattern.First));
+		const __m128i firstMask = _mm_set1_epi8(static_cast<char>(pattern.FirstMask));
+		const __m128i last = _mm_set1_epi8(static_cast<char>(pattern.Last));
+		const __m128i lastMask = _mm_set1_epi8(static_cast<char>(pattern.LastMask));
+
+		size_t i = from;
+		for (; i + pattern.Size - 1 + 16 <= size; i += 16)
+		{
+			const __m128i blockFirst = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), firstMask);
+			const __m128i blockLast = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + pattern.Size - 1)), lastMask);
+			uint32_t candidates = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+			while (candidates)
+			{
+				const size_t offset = i + std::countr_zero(candidates);
+				if (MatchAt(text + offset, pattern))
+					return offset;
+
+				candidates &= candidates - 1;
+			}
+		}
+
+		return FindScalar(text, size, pattern, i);
+	}
+
+	QG_TARGET_AVX2 static size_t FindAVX2(const uint8_t* text, size_t size, const SearchPattern& pattern, size_t from)
+	{
+		const __m256i first = _mm256_set1_epi8(static_cast<char>(pattern.First));
+		const __m256i firstMask = _mm256_set1_epi8(static_cast<char>(pattern.FirstMask));
+		const __m256i last = _mm256_set1_epi8(static_cast<char>(pattern.Last));
+		const __m256i lastMask = _mm256_set1_epi8(static_cast<char>(pattern.LastMask));
+
+		size_t i = from;
+		for (; i + pattern.Size - 1 + 32 <= size; i += 32)
+		{
+			const __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), firstMask);
+			const __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + pattern.Size - 1)), lastMask);
+			uint32_t candidates = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+			while (candidates)
+			{
+				const size_t offset = i + std::countr_zero(candidates);
+				if (MatchAt(text + offset, pattern))
+					return offset;
+
+				candidates &= candidates - 1;
+			}
+		}
+
+		return FindScalar(text, size, pattern, i);
+	}
+
+	static bool HasAVX2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// The OS has to save the upper halves of the ymm registers as well
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	using FindKernel = size_t(*)(const uint8_t* text, size_t size, const SearchPattern& pattern, size_t from);
+
+	static FindKernel SelectKernel()
+	{
+#ifdef QG_TEXT_SEARCH_X86
+		return HasAVX2() ? FindAVX2 : FindSSE2;
+#else
+		return FindScalar;
+#endif
+	}
+
+	static const FindKernel s_FindKernel = SelectKernel();
+
+	size_t TextSearch::Find(const char* text, size_t size, const char* pattern, size_t patternSize, bool matchCase, size_t from /*= 0*/)
+	{
+		if (patternSize == 0 || patternSize > size || from > size - patternSize)
+			return NPos;
+
+		SearchPattern searchPattern;
+		searchPattern.Text = reinterpret_cast<const uint8_t*>(pattern);
+		searchPattern.Size = patternSize;
+		searchPattern.MatchCase = matchCase;
+		SetCandidateByte(searchPattern.Text[0], matchCase, searchPattern.First, searchPattern.FirstMask);
+		SetCandidateByte(searchPattern.Text[patternSize - 1], matchCase, searchPattern.Last, searchPattern.LastMask);
+
+		return s_FindKernel(reinterpret_cast<const uint8_t*>(text), size, searchPattern, from);
+	}
+
+	void TextSearch::FindAll(const char* text, size_t size, const char* pattern, size_t patternSize, bool matchCase, eastl::vector<uint32_t>& outOffsets)
+	{
+		for (size_t at = Find(text, size, pattern, patternSize, matchCase); at != NPos; at = Find(text, size, pattern, patternSize, matchCase, at + patternSize))
+			outOffsets.push_back(static_cast<uint32_t>(at));
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace QuickGit
+{
+	// Substring search over large buffers such as a commit's patches.
+	// Candidates are found 16 or 32 bytes at a time by comparing the pattern's first and last byte,
+	// the AVX2 kernel is picked at runtime when the CPU supports it.
+	class TextSearch
+	{
+	public:
+		static constexpr size_t NPos = SIZE_MAX;
+
+		// First match at or after from, ASCII letters compare case insensitively unless matchCase is set
+		static size_t Find(const char* text, size_t size, const char* pattern, size_t patternSize, bool matchCase, size_t from = 0);
+		// Offsets of every non overlapping match
+		static void FindAll(const char* text, size_t size, const char* pattern, size_t patternSize, bool matchCase, eastl::vector<uint32_t>& outOffsets);
+	};
+}
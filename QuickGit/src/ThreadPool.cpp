@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+namespace QuickGit
+{
+	static eastl::vector<std::thread> s_Threads;
+	// Serializes loops, the job state below belongs to the running one
+	static std::mutex s_RunMutex;
+
+	static std::mutex s_Mutex;
+	static std::condition_variable s_Wake;
+	static std::condition_variable s_Done;
+	static uint64_t s_Job = 0;
+	static uint32_t s_Active = 0;
+	static bool s_Stop = false;
+
+	static void (*s_Task)(void*, uint32_t, uint32_t) = nullptr;
+	static void* s_Context = nullptr;
+	static uint32_t s_Count = 0;
+	static std::atomic<uint32_t> s_Next = 0;
+
+	// Iterations are handed out one at a time, a slow one doesn't hold back a whole block of others
+	static void RunIterations(uint32_t worker)
+	{
+		for (uint32_t index = s_Next.fetch_add(1, std::memory_order_relaxed); index < s_Count; index = s_Next.fetch_add(1, std::memory_order_relaxed))
+			s_Task(s_Context, index, worker);
+	}
+
+	static void WorkerMain(uint32_t worker)
+	{
+		uint64_t seen = 0;
+		std::unique_lock lock(s_Mutex);
+		while (true)
+		{
+			s_Wake.wait(lock, [&seen]() { return s_Stop || s_Job != seen; });
+			if (s_Stop)
+				return;
+
+			// A thread that wakes after the loop ran out of iterations stays out, the caller may already have returned
+			seen = s_Job;
+			if (s_Next.load(std::memory_order_relaxed) >= s_Count)
+				continue;
+
+			++s_Active;
+			lock.unlock();
+			RunIterations(worker);
+			lock.lock();
+
+			if (--s_Active == 0)
+				s_Done.notify_all();
+		}
+	}
+
+	void ThreadPool::Init()
+	{
+		const uint32_t threadCount = eastl::max(std::thread::hardware_concurrency(), 1u) - 1;
+		s_Stop = false;
+		s_Threads.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+			s_Threads.push_back(std::thread(WorkerMain, i + 1));
+	}
+
+	void ThreadPool::Shutdown()
+	{
+		{
+			std::scoped_lock lock(s_Mutex);
+			s_Stop = true;
+		}
+
+		s_Wake.notify_all();
+		for (std::thread& thread : s_Threads)
+			thread.join();
+
+		s_Threads.clear();
+	}
+
+	uint32_t ThreadPool::Size()
+	{
+		return static_cast<uint32_t>(s_Threads.size()) + 1;
+	}
+
+	void ThreadPool::Run(uint32_t count, Task task, void* context)
+	{
+		if (count == 0)
+			return;
+
+		if (count == 1 || s_Threads.empty())
+		{
+			for (uint32_t i = 0; i < count; ++i)
+				task(context, i, 0);
+
+			return;
+		}
+
+		std::scoped_lock run(s_RunMutex);
+		{
+			std::scoped_lock lock(s_Mutex);
+			s_Task = task;
+			s_Context = context;
+			s_Count = count;
+			s_Next.store(0, std::memory_order_relaxed);
+			++s_Job;
+		}
+
+		s_Wake.notify_all();
+		RunIterations(0);
+
+		std::unique_lock lock(s_Mutex);
+		s_Done.wait(lock, []() { return s_Active == 0; });
+	}
+}
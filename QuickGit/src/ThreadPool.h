@@ -0,0 +1,32 @@
+#pragma once
+
+namespace QuickGit
+{
+	// Fixed set of threads that run the iterations of a parallel loop alongside the calling thread.
+	// One loop runs on the pool at a time, a second caller waits for the first loop to finish.
+	class ThreadPool
+	{
+	public:
+		// Starts one thread less than the hardware threads, the caller of a loop is the remaining one
+		static void Init();
+		static void Shutdown();
+
+		// Threads taking part in a loop, the caller included
+		static uint32_t Size();
+
+		// Calls func(index, worker) for every index in [0, count) and returns once all calls are done.
+		// worker is below Size() and no two concurrent calls of the same loop share it, so state owned by the loop can be indexed by it.
+		// A loop of one iteration, or any loop without pool threads, runs inline as worker 0 even while another loop is running,
+		// so per worker state must not be shared between callers.
+		template<typename Func>
+		static void ParallelFor(uint32_t count, Func&& func)
+		{
+			Run(count, [](void* context, uint32_t index, uint32_t worker) { (*static_cast<Func*>(context))(index, worker); }, &func);
+		}
+
+	private:
+		using Task = void(*)(void* context, uint32_t index, uint32_t worker);
+
+		static void Run(uint32_t count, Task task, void* context);
+	};
+}
@@ -0,0 +1,232 @@
+#include "pch.h"
+#include "TrigramIndex.h"
+
+namespace QuickGit
+{
+	// Same folding as ImGuiTextFilter, only ASCII letters are case insensitive
+	static uint32_t FoldCase(uint8_t c)
+	{
+		return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+	}
+
+	static uint32_t MakeTrigram(const char* text)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text);
+		return (FoldCase(bytes[0]) << 16) | (FoldCase(bytes[1]) << 8) | FoldCase(bytes[2]);
+	}
+
+	static void PushVarint(eastl::vector<uint8_t>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	static uint32_t ReadVarint(const uint8_t*& data)
+	{
+		uint32_t value = 0;
+		for (uint32_t shift = 0;; shift += 7)
+		{
+			const uint8_t byte = *data++;
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+	}
+
+	static void PushU32(eastl::vector<uint8_t>& out, uint32_t value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(value));
+	}
+
+	static bool ReadU32(const uint8_t*& data, const uint8_t* end, uint32_t& out)
+	{
+		if (static_cast<size_t>(end - data) < sizeof(out))
+			return false;
+
+		memcpy(&out, data, sizeof(out));
+		data += sizeof(out);
+		return true;
+	}
+
+	void TrigramRuns::Add(uint32_t row, const char* text)
+	{
+		const size_t length = text ? strlen(text) : 0;
+		for (size_t i = 0; i + TRIGRAM_MIN_TERM <= length; ++i)
+			m_Entries.push_back((static_cast<uint64_t>(MakeTrigram(text + i)) << 32) | row);
+	}
+
+	void TrigramRuns::Finish()
+	{
+		eastl::sort(m_Entries.begin(), m_Entries.end());
+		m_Entries.erase(eastl::unique(m_Entries.begin(), m_Entries.end()), m_Entries.end());
+
+		for (uint64_t entry : m_Entries)
+		{
+			const uint32_t trigram = static_cast<uint32_t>(entry >> 32);
+			const uint32_t row = static_cast<uint32_t>(entry);
+			if (Runs.empty() || Runs.back().Trigram != trigram)
+			{
+				Runs.push_back({ trigram, row, row, 1, static_cast<uint32_t>(Bytes.size()), 0 });
+				continue;
+			}
+
+			Run& run = Runs.back();
+			PushVarint(Bytes, row - run.Last);
+			run.Last = row;
+			++run.Count;
+			run.Size = static_cast<uint32_t>(Bytes.size()) - run.Offset;
+		}
+
+		m_Entries.clear();
+		m_Entries.shrink_to_fit();
+	}
+
+	void TrigramRuns::Append(const TrigramRuns& other, uint32_t rowOffset)
+	{
+		const uint32_t byteOffset = static_cast<uint32_t>(Bytes.size());
+		for (Run run : other.Runs)
+		{
+			run.First += rowOffset;
+			run.Last += rowOffset;
+			run.Offset += byteOffset;
+			Runs.push_back(run);
+		}
+
+		Bytes.insert(Bytes.end(), other.Bytes.begin(), other.Bytes.end());
+	}
+
+	void TrigramRuns::Clear()
+	{
+		Runs.clear();
+		Bytes.clear();
+		m_Entries.clear();
+	}
+
+	void TrigramIndex::Merge(uint32_t base, const TrigramRuns& runs)
+	{
+		for (const TrigramRuns::Run& run : runs.Runs)
+		{
+			PostingList& list = m_Lists[run.Trigram];
+			const uint32_t first = base + run.First;
+			if (list.Count && first <= list.Last)
+				continue;
+
+			// Only the first row of the run is re-encoded, the rest are deltas already
+			PushVarint(list.Bytes, list.Count ? first - list.Last : first);
+			list.Bytes.insert(list.Bytes.end(), runs.Bytes.begin() + run.Offset, runs.Bytes.begin() + run.Offset + run.Size);
+			list.Count += run.Count;
+			list.Last = base + run.Last;
+		}
+	}
+
+	bool TrigramIndex::Find(const char* begin, const char* end, eastl::vector<uint32_t>& outIds) const
+	{
+		if (end - begin < TRIGRAM_MIN_TERM)
+			return false;
+
+		eastl::vector<const PostingList*> lists;
+		for (const char* text = begin; text + TRIGRAM_MIN_TERM <= end; ++text)
+		{
+			auto it = m_Lists.find(MakeTrigram(text));
+			if (it == m_Lists.end())
+				return true;
+
+			lists.push_back(&it->second);
+		}
+
+		eastl::sort(lists.begin(), lists.end());
+		lists.erase(eastl::unique(lists.begin(), lists.end()), lists.end());
+		eastl::sort(lists.begin(), lists.end(), [](const PostingList* a, const PostingList* b) { return a->Count < b->Count; });
+
+		eastl::vector<uint32_t> ids;
+		ids.reserve(lists[0]->Count);
+		const uint8_t* data = lists[0]->Bytes.data();
+		for (uint32_t i = 0, id = 0; i < lists[0]->Count; ++i)
+		{
+			id += ReadVarint(data);
+			ids.push_back(id);
+		}
+
+		eastl::vector<uint32_t> intersection;
+		for (size_t k = 1; k < lists.size() && !ids.empty(); ++k)
+		{
+			// Once few candidates are left checking them directly beats decoding a long list
+			const PostingList& list = *lists[k];
+			if (ids.size() * 16 < list.Count)
+				break;
+
+			intersection.clear();
+			data = list.Bytes.data();
+			size_t next = 0;
+			for (uint32_t i = 0, id = 0; i < list.Count && next < ids.size(); ++i)
+			{
+				id += ReadVarint(data);
+				while (next < ids.size() && ids[next] < id)
+					++next;
+
+				if (next < ids.size() && ids[next] == id)
+					intersection.push_back(id);
+			}
+
+			eastl::swap(ids, intersection);
+		}
+
+		outIds.insert(outIds.end(), ids.begin(), ids.end());
+		return true;
+	}
+
+	void TrigramIndex::Serialize(eastl::vector<uint8_t>& out) const
+	{
+		PushU32(out, static_cast<uint32_t>(m_Lists.size()));
+		for (const auto& [trigram, list] : m_Lists)
+		{
+			PushU32(out, trigram);
+			PushU32(out, list.Count);
+			PushU32(out, list.Last);
+			PushU32(out, static_cast<uint32_t>(list.Bytes.size()));
+			out.insert(out.end(), list.Bytes.begin(), list.Bytes.end());
+		}
+	}
+
+	bool TrigramIndex::Deserialize(const uint8_t* data, size_t size)
+	{
+		Clear();
+
+		const uint8_t* end = data + size;
+		uint32_t count = 0;
+		if (!ReadU32(data, end, count))
+			return false;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t trigram, listCount, last, byteCount;
+			if (!ReadU32(data, end, trigram) || !ReadU32(data, end, listCount) || !ReadU32(data, end, last) || !ReadU32(data, end, byteCount) ||
+				byteCount > static_cast<size_t>(end - data))
+			{
+				Clear();
+				return false;
+			}
+
+			// Every varint ends in a byte without the continuation bit, a list holding fewer would decode past its end
+			const uint32_t terminators = static_cast<uint32_t>(eastl::count_if(data, data + byteCount, [](uint8_t byte) { return (byte & 0x80) == 0; }));
+			if (terminators != listCount || (byteCount && (data[byteCount - 1] & 0x80)))
+			{
+				Clear();
+				return false;
+			}
+
+			PostingList& list = m_Lists[trigram];
+			list.Bytes.assign(data, data + byteCount);
+			list.Count = listCount;
+			list.Last = last;
+			data += byteCount;
+		}
+
+		return data == end;
+	}
+}
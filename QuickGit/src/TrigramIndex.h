@@ -0,0 +1,64 @@
+#pragma once
+
+#define TRIGRAM_MIN_TERM 3
+
+namespace QuickGit
+{
+	// Trigram postings for a block of consecutive rows, built off the UI thread and merged into a TrigramIndex.
+	// Rows are relative to the start of the block, each run lists the rows containing one trigram.
+	struct TrigramRuns
+	{
+		struct Run
+		{
+			uint32_t Trigram;
+			uint32_t First;
+			uint32_t Last;
+			uint32_t Count;
+			// Varint deltas of the rows after the first one
+			uint32_t Offset;
+			uint32_t Size;
+		};
+
+		eastl::vector<Run> Runs;
+		eastl::vector<uint8_t> Bytes;
+
+		// Collects the trigrams of the text, Finish turns everything added so far into runs
+		void Add(uint32_t row, const char* text);
+		void Finish();
+
+		void Append(const TrigramRuns& other, uint32_t rowOffset);
+		void Clear();
+
+		bool Empty() const { return Runs.empty() && m_Entries.empty(); }
+
+	private:
+		// Trigram in the upper half, row in the lower half
+		eastl::vector<uint64_t> m_Entries;
+	};
+
+	// Case insensitive trigram posting lists, ids have to be merged in increasing order.
+	// Lists are delta and varint encoded, a lookup intersects the lists of every trigram in the term
+	// so only rows that can contain it have to be checked.
+	class TrigramIndex
+	{
+	public:
+		void Merge(uint32_t base, const TrigramRuns& runs);
+		void Clear() { m_Lists.clear(); }
+
+		// Ids that may contain the term, false when the term is shorter than a trigram
+		bool Find(const char* begin, const char* end, eastl::vector<uint32_t>& outIds) const;
+
+		void Serialize(eastl::vector<uint8_t>& out) const;
+		bool Deserialize(const uint8_t* data, size_t size);
+
+	private:
+		struct PostingList
+		{
+			eastl::vector<uint8_t> Bytes;
+			uint32_t Count = 0;
+			uint32_t Last = 0;
+		};
+
+		eastl::hash_map<uint32_t, PostingList> m_Lists;
+	};
+}
@@ -1,10 +1,10 @@
 #include "pch.h"
 
-size_t g_ArcAllocationSize = 0;
+std::atomic<size_t> g_ArcAllocationSize = 0;
 
 namespace QuickGit::Allocation
 {
-	size_t GetSize() { return g_ArcAllocationSize; }
+	size_t GetSize() { return g_ArcAllocationSize.load(std::memory_order_relaxed); }
 
 	void* New(size_t size)
 	{
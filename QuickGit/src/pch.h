@@ -8,10 +8,16 @@
 #include <EASTL/hash_set.h>
 #include <EASTL/stack.h>
 #include <EASTL/queue.h>
+#include <EASTL/deque.h>
 #include <EASTL/unique_ptr.h>
 #include <EASTL/sort.h>
 
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 #include <git2.h>
 
@@ -59,3 +59,8 @@ group "Dependencies"
 group ""
 
 include "QuickGit"
+
+group "Tools"
+	include "QuickGit/bench"
+
+group ""